@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <sstream>
+#include <cstdint>       // uint64_t
+#include <unordered_map>
 
 #include "constants.hpp"
 #include "construction.hpp"
@@ -22,13 +24,26 @@ template<class T> std::ostream& operator<<(std::ostream& os, const Basis<T>& out
 template<class T>
 class Basis {
     std::vector<T> basisVectors;
+    // optional map from Mono::Key() to position; see BuildIndex()
+    std::unordered_multimap<std::uint64_t, unsigned int> index;
+    bool indexed = false;
+
+    unsigned int Position(const T& wildVector) const;
+    void DropIndex() { index.clear(); indexed = false; }
 
     public:
         explicit Basis(const std::vector<T>& basisVectors): basisVectors(basisVectors) {}
-        Basis(const int numP, int degree, const Arguments& args);
+        Basis(const int numP, int degree, const Arguments& args,
+                const Parity parity = Parity::All);
         //explicit Basis(const Basis&) = default;
         //Basis(Basis&&) = default;
 
+        // makes finding a vector in the basis (and so expressing things on
+        // it) a hash lookup instead of a scan through the whole basis. 
+        // Anything which could change the basis vectors drops the index again
+        void BuildIndex();
+        bool Indexed() const { return indexed; }
+
         unsigned int FindInBasis(const std::vector<int>& pm,
                         const std::vector<int>& pt) const;
         unsigned int FindInBasis(const T& wildVector) const;
@@ -43,11 +58,11 @@ class Basis {
         typename std::vector<T>::const_iterator		begin() const noexcept
                         { return basisVectors.begin(); }
         typename std::vector<T>::iterator			begin() noexcept
-                        { return basisVectors.begin(); }
+                        { DropIndex(); return basisVectors.begin(); }
         typename std::vector<T>::const_iterator		end()	const noexcept
                         { return basisVectors.end(); }
         typename std::vector<T>::iterator			end()	noexcept
-                        { return basisVectors.end(); }
+                        { DropIndex(); return basisVectors.end(); }
 
         // Triplet ExpressMono(const Mono& toExpress, const int column,
                         // const int rowOffset) const;
@@ -90,97 +105,33 @@ class splitBasis {
 bool EoMAllowed(const std::vector<particle>& cfg);
 
 template<class T>
-inline Basis<T>::Basis(const int, int, const Arguments&) {
+inline Basis<T>::Basis(const int, int, const Arguments&, const Parity) {
     std::cerr << "Error: ordered to construct a basis by degree for an "
         << "underlying type which has not been specialized. Please construct "
         << "with a different type or write a specialization for this type."
         << std::endl;
 }
 
+// the states come straight out of a DirichletCfgs, so only the ones with the
+// requested parity are ever made; see construction.hpp for the order
 template<>
-inline Basis<Mono>::Basis(const int numP, int degree, const Arguments& args) {
-    // 1: generate all possibilities for P_-
-    // 2: identify nodes in P_-, generate possible distributions of P_\perp to
-    // 		the nodes and then P_\perp within each node, adding each at top level
-    // 3: identify nodes in (P_- and P_\perp), repeating step 2 for P_+
-    // 4: take list from step 3 and create a mono from each entry, then store
-    // 		the list of these as basisMonos
-    // NOTE: this does not make any use of the symmetries between the components
-    // 		in constructing the basis; for instance, the states where every
-    // 		pm = 0 are followed by a copy of the earlier parts of the basis
-
-    int options = args.options;
+inline Basis<Mono>::Basis(const int numP, int degree, const Arguments& args,
+        const Parity parity) {
     OStream& console = *args.console;
-    const bool debug = ((options & OPT_DEBUG) != 0);
+    const bool debug = ((args.options & OPT_DEBUG) != 0);
     if(debug) console << "***Generating basis at N=" << numP << ", D="
             << degree << "***" << endl;
 
-    // subtract off the required Dirichlet derivatives
-    degree -= numP;
-
-    if(degree < 0){
+    if(degree < numP){
         console << "Error: there are no Dirichlet states with degree "
                 << "<= the number of particles." << endl;
         return;
     }
 
-    // start with all possible configurations of P_-
-    if(degree == 0){
-        std::vector<particle> onlyMono;
-        onlyMono.resize(numP);
-        for(auto& part : onlyMono){
-            part.pm = 1;
-        }
-        basisVectors.emplace_back(onlyMono);
-        return;
-    }
-    std::vector<std::vector<int>> minus;
-    if(options & OPT_ALLMINUS){
-        minus = GetStatesAtDegree<int>(numP, degree);
-    } else {
-        minus = GetStatesUpToDegree<int>(numP, degree);
-    }
-    std::vector<std::vector<particle>> particleCfgs;
-    for(auto& minusCfg : minus){
-        if(debug) console << "Here's a configuration of minuses: "
-            << minusCfg << endl;
-        std::vector<particle> newCfg(minusCfg.size());
-        for(auto i = 0u; i < newCfg.size(); ++i) newCfg[i].pm = minusCfg[i];
-        particleCfgs.push_back(newCfg);
-    }
-
-    // for each P_- configuration, generate all possible P_\perp configs
-    std::vector<int> nodes;
-    std::vector<std::vector<particle>> newCfgs;
-    for(auto& configuration : particleCfgs){
-        if(options & OPT_ALLMINUS){
-            newCfgs.push_back(configuration);
-            continue;
-        }
-        nodes = IdentifyNodes(configuration);
-        int remainingEnergy = degree;
-        for(auto& part : configuration) remainingEnergy -= part.pm;
-        std::vector<std::vector<int>> perp(CfgsFromNodes(remainingEnergy, nodes,
-                                                                        true));
-        if(debug) console << "COMBINING SUBCONFIGS OF " << configuration 
-            << endl;
-        for(auto& newCfg : CombinedCfgs(configuration, perp, 2)){
-            if(debug) console << "NEW CONFIGURATION: " << newCfg << endl;
-            newCfgs.push_back(newCfg);
-        }
-    }
-
-    // finally, add in the required P_- from being Dirichlet
-    particleCfgs.clear();
-    for(auto& cfg : newCfgs){
-        for(auto& part : cfg) ++part.pm;
-        particleCfgs.push_back(cfg);
-    }
-
-    //console << "Tick." << endl;
-    for(auto& cfg : particleCfgs){
-        basisVectors.emplace_back(cfg);
-        //console << cfg << endl;
+    for(DirichletCfgs cfgs(numP, degree, args.options & OPT_ALLMINUS, parity);
+            cfgs.Next(); ){
+        if(debug) console << "NEW CONFIGURATION: " << cfgs.Current() << endl;
+        basisVectors.emplace_back(cfgs.Current());
     }
 }
 
@@ -222,16 +173,56 @@ inline DVector Basis<T>::DenseExpressPoly(const Poly& toExpress) const {
     return DVector(toExpress.size());
 }
 
+// only Monos have keys to index, so other bases are always scanned
 template<class T>
-inline unsigned int Basis<T>::FindInBasis(const T& wildVector) const{
+inline void Basis<T>::BuildIndex() {
+}
+
+template<>
+inline void Basis<Mono>::BuildIndex() {
+    index.clear();
+    index.reserve(basisVectors.size());
+    for(auto i = 0u; i < basisVectors.size(); ++i){
+        index.emplace(basisVectors[i].Key(), i);
+    }
+    indexed = true;
+}
+
+// -1u if wildVector isn't in the basis
+template<class T>
+inline unsigned int Basis<T>::Position(const T& wildVector) const{
     for(auto i = 0u; i < basisVectors.size(); ++i){
         if(basisVectors[i] == wildVector) return i;
     }
-    std::cerr << "Warning! Failed to find the following vector in our basis: "
-        << wildVector << std::endl;
     return -1u;
 }
 
+// index is keyed by Mono::Key(), which isn't unique (see mono.hpp)
+template<>
+inline unsigned int Basis<Mono>::Position(const Mono& wildVector) const{
+    if(!indexed){
+        for(auto i = 0u; i < basisVectors.size(); ++i){
+            if(basisVectors[i] == wildVector) return i;
+        }
+        return -1u;
+    }
+    auto range = index.equal_range(wildVector.Key());
+    for(auto it = range.first; it != range.second; ++it){
+        if(basisVectors[it->second] == wildVector) return it->second;
+    }
+    return -1u;
+}
+
+template<class T>
+inline unsigned int Basis<T>::FindInBasis(const T& wildVector) const{
+    const unsigned int position = Position(wildVector);
+    if(position == -1u){
+        std::cerr << "Warning! Failed to find the following vector in our "
+            << "basis: " << wildVector << std::endl;
+    }
+    return position;
+}
+
 template<>
 inline unsigned int Basis<Mono>::FindInBasis(const std::vector<int>& pm, 
 		const std::vector<int>& pt) const{
@@ -240,12 +231,14 @@ inline unsigned int Basis<Mono>::FindInBasis(const std::vector<int>& pm,
 
 template<>
 inline void Basis<Mono>::DeleteOdd(){
+    DropIndex();
     basisVectors.erase(std::remove_if(basisVectors.begin(), basisVectors.end(), 
                             splitBasis<Mono>::IsOdd), basisVectors.end());
 }
 
 template<>
 inline void Basis<Mono>::DeleteEven(){
+    DropIndex();
     basisVectors.erase(std::remove_if(basisVectors.begin(), basisVectors.end(),
                             splitBasis<Mono>::IsEven), basisVectors.end());
 }
@@ -325,21 +318,30 @@ inline std::list<Triplet> Basis<Mono>::ExpressPoly(const Poly& toExpress,
 template<>
 inline DVector Basis<Mono>::DenseExpressMono(const Mono& toExpress) const {
     DVector output = DVector::Zero(this->size());
-    for (std::size_t i = 0; i < this->size(); ++i) {
-        if ((*this)[i] == toExpress) {
-            output(i) = toExpress.Coeff();
-            return output;
-        }
+    const unsigned int position = Position(toExpress);
+    if (position != -1u) {
+        output(position) = toExpress.Coeff();
+        return output;
     }
     std::cerr << "Error: attempted to express " << toExpress << " on the basis "
             << *this << " but was not able to." << std::endl;
     return output;
 }
 
+// each term goes straight into its row, so this is O(#terms) with an index
 template<>
 inline DVector Basis<Mono>::DenseExpressPoly(const Poly& toExpress) const {
     DVector output = DVector::Zero(this->size());
-    for (const auto& term : toExpress) output += DenseExpressMono(term);
+    for (const auto& term : toExpress) {
+        const unsigned int position = Position(term);
+        if (position == -1u) {
+            std::cerr << "Error: attempted to express " << term 
+                << " on the basis " << *this << " but was not able to." 
+                << std::endl;
+            continue;
+        }
+        output(position) += term.Coeff();
+    }
     return output;
 }
 
@@ -387,18 +389,10 @@ inline bool splitBasis<T>::IsEven(const Mono& toTest){
     return !IsOdd(toTest);
 }
 
-// this could definitely be done more intelligently if speed were important;
-// even at order 0, we could just generate the basis once and copy it rather
-// than making exactly the same thing twice.
 template<class T>
 inline splitBasis<T>::splitBasis(const int numP, const int degree, 
-        const Arguments& args): evenBasis(numP, degree, args), 
-                                oddBasis(evenBasis) {
-    //std::cout << evenBasis << "----->" << std::endl;
-    evenBasis.DeleteOdd();
-    //std::cout << evenBasis << std::endl;
-    oddBasis.DeleteEven();
-    //std::cout << oddBasis << std::endl;
+        const Arguments& args): evenBasis(numP, degree, args, Parity::Even), 
+                                oddBasis(numP, degree, args, Parity::Odd) {
 }
 
 /*
@@ -466,7 +460,10 @@ inline Basis<Mono> MinimalBasis(const std::vector<Poly>& polynomials) {
         allUsedMonos[i] = combinedPoly[i];
         allUsedMonos[i].Coeff() = 1;
     }
-    return Basis<Mono>(allUsedMonos);
+    // the polynomials are expressed on this, in PolysOnMinBasis
+    Basis<Mono> minBasis(allUsedMonos);
+    minBasis.BuildIndex();
+    return minBasis;
 }
 
 // get an element from a vector of multiple bases treated like a single basis
@@ -526,6 +523,7 @@ Poly VectorToPoly(const DVector& kernelVector, const Basis<T>& startBasis){
             << " monomials. These must be the same." << std::endl;
         return ret;
     }
+    ret.reserve(kernelVector.rows());
     for(auto row = 0; row < kernelVector.rows(); ++row){
         if(std::abs<builtin_class>(kernelVector.coeff(row)) < EPSILON) continue;
         ret += kernelVector.coeff(row)*startBasis[row];
@@ -3,11 +3,23 @@
 int Calculate(const Arguments& args) {
     // OStream& console = *args.console;
     gsl_set_error_handler(&GSLErrorHandler);
+    Pool::SetThreads(args.threads);
 
     if (args.options & OPT_TEST) {
         return Test::RunAllTests(args);
     }
 
+    // the N+2 terms pair up levels which are both at most maxN, so no Mono
+    // ever has more particles than that
+    const int maxN = (args.delta != 0.0 ? std::ceil(args.delta / 1.5)
+                                        : args.numP);
+    if (maxN > static_cast<int>(MAX_PARTICLES)) {
+        std::cerr << "Error: at most " << MAX_PARTICLES << " particles "
+            << "are supported, but this would need " << maxN << "."
+            << std::endl;
+        return EXIT_FAILURE;
+    }
+
     // initialize all multinomials which might come up
     //
     // this is obviously something of a blunt instrument and could easily be
@@ -27,7 +39,12 @@ int Calculate(const Arguments& args) {
         return EXIT_SUCCESS;
     }
 
+    Memo::SetByteLimit(args.cacheLimit);
     DMatrix hamiltonian = ComputeHamiltonian(args);
+    if (args.options & OPT_DEBUG) {
+        Memo::PrintStats(*args.console);
+        PrintHypergeoStats(*args.console);
+    }
     // if (args.outStream->rdbuf() != std::cout.rdbuf()) {
         // delete args.outStream;
     // }
@@ -42,21 +59,13 @@ std::vector<Poly> ComputeBasisStates(const Arguments& args) {
 
     *args.outStream << "(*Orthogonal basis states with N=" << numP << ", L="
         << degree << " (including Dirichlet derivatives).*)" << endl;
-    
-    std::vector<Basis<Mono>> allEvenBases;
-    std::vector<Basis<Mono>> allOddBases;
-    for (int deg = numP; deg <= degree; ++deg) {
-        splitBasis<Mono> degBasis(numP, deg, args);
-        allEvenBases.push_back(degBasis.EvenBasis());
-        allOddBases.push_back(degBasis.OddBasis());
-    }
 
     *args.outStream << "(*EVEN STATE ORTHOGONALIZATION*)" << endl;
-    std::vector<Poly> basisEven = ComputeBasisStates_SameParity(allEvenBases, 
+    std::vector<Poly> basisEven = ComputeBasisStates_SameParity(numP, degree,
                                                                 args, false);
 
     *args.outStream << "(*ODD STATE ORTHOGONALIZATION*)" << endl;
-    std::vector<Poly> basisOdd = ComputeBasisStates_SameParity(allOddBases, 
+    std::vector<Poly> basisOdd = ComputeBasisStates_SameParity(numP, degree,
                                                                args, true);
 
     *args.outStream << endl;
@@ -66,27 +75,15 @@ std::vector<Poly> ComputeBasisStates(const Arguments& args) {
 }
 
 // return basis polynomials. They are NOT normalized w.r.t. partitions
-std::vector<Poly> ComputeBasisStates_SameParity(
-        const std::vector<Basis<Mono>>& inputBases, const Arguments& args,
-        const bool odd) {
-    OStream& console = *args.console;
-    std::vector<Poly> orthogonalized = Orthogonalize(inputBases, console, odd);
-
-    // Basis<Mono> minimalBasis(MinimalBasis(orthogonalized));
-    // if (outStream.rdbuf() == std::cout.rdbuf()) {
-        // outStream << "Minimal basis: " << minimalBasis << endl;
-    // } else {
-        // outStream << "minimalBasis[" << suffix <<"] = " << MathematicaOutput(minimalBasis) 
-            // << endl;
-    // }
-
-    return orthogonalized;
+std::vector<Poly> ComputeBasisStates_SameParity(const int numP, 
+        const int degree, const Arguments& args, const bool odd) {
+    return Stages::GetStates(numP, degree, odd, args)->orthogonalized;
 }
 
 // output a matrix where each column is one of the basis vectors expressed in
 // terms of the monomials on the minimal basis
 DMatrix PolysOnMinBasis(const Basis<Mono>& minimalBasis,
-                        const std::vector<Poly> orthogonalized, OStream&) {
+                        const std::vector<Poly>& orthogonalized, OStream&) {
     DMatrix polysOnMinBasis(minimalBasis.size(), orthogonalized.size());
     for (std::size_t i = 0; i < orthogonalized.size(); ++i) {
         polysOnMinBasis.col(i) = minimalBasis.DenseExpressPoly(
@@ -113,13 +110,18 @@ DMatrix ComputeHamiltonian(const Arguments& args) {
         << ',' << args.cutoff << ")*)" << endl;
 
     Timer overallTimer;
+
+    // both parities are started before either is waited on, so that all of
+    // their steps can run at the same time
+    const HamiltonianSteps evenSteps = StartHamiltonian(args, false);
+    const HamiltonianSteps oddSteps  = StartHamiltonian(args, true);
     
     *args.outStream << "(*EVEN STATES*)" << endl;
-    Hamiltonian evenHam = FullHamiltonian(args, false);
+    Hamiltonian evenHam = FinishHamiltonian(evenSteps, args);
     // AnalyzeHamiltonian(evenHam, args);
 
     *args.outStream << "(*ODD STATES*)" << endl;
-    Hamiltonian oddHam  = FullHamiltonian(args, true);
+    Hamiltonian oddHam  = FinishHamiltonian(oddSteps, args);
     // AnalyzeHamiltonian(oddHam, args);
 
     *args.console << "\nEntire computation took " 
@@ -130,85 +132,161 @@ DMatrix ComputeHamiltonian(const Arguments& args) {
 
 // compute the hamiltonian for all states with delta up to args.delta; if 
 // args.delta == 0, only compute one n-level (the DiagonalBlock at n=args.numP)
-Hamiltonian FullHamiltonian(Arguments args, const bool odd) {
-    int minN, maxN;
+Hamiltonian FullHamiltonian(const Arguments& args, const bool odd) {
+    return FinishHamiltonian(StartHamiltonian(args, odd), args);
+}
+
+// the levels are started from the biggest down, so that the longest steps get
+// going first, and each block is queued once the levels it uses are done
+HamiltonianSteps StartHamiltonian(const Arguments& args, const bool odd) {
+    HamiltonianSteps steps;
     if (args.delta != 0.0) {
-        minN = 2;
-        maxN = std::ceil(args.delta / 1.5);
+        steps.minN = 2;
+        steps.maxN = std::ceil(args.delta / 1.5);
     } else {
-        minN = args.numP;
-        maxN = args.numP;
+        steps.minN = args.numP;
+        steps.maxN = args.numP;
     }
-    Hamiltonian output;
-    output.maxN = maxN;
-    const std::string parity = odd ? ", odd" : ", even";
-    const bool mathematica = (args.options & OPT_MATHEMATICA) != 0;
-    OStream& outStream = *args.outStream;
+    const int minN = steps.minN;
+    const int maxN = steps.maxN;
+    const std::size_t numLevels = std::max(maxN - minN + 1, 0);
+    const bool interacting = (args.options & OPT_INTERACTING) != 0;
+
+    // the biggest exponents in the integrals come from the largest n and
+    // degree, so make the integral tables big enough for those up front
+    const int maxDegree = (args.delta != 0.0 ? std::ceil(args.delta - 0.5*maxN)
+                                             : args.degree + maxN);
+    MatrixInternal::ReserveIntegralTables(maxN + 2, maxDegree);
 
-    std::vector<Basis<Mono>> minBases;
-    std::vector<SMatrix> discPolys;
+    steps.levels.resize(numLevels);
+    steps.diagonal.resize(numLevels);
+    steps.nPlus2.resize(numLevels);
     for (int n = minN; n <= maxN; ++n) {
-        // FIXME: remove adjustment so degree's consistently "L above dirichlet"
-        if (args.delta != 0.0) {
-            args.numP = n;
-            args.degree = std::ceil(args.delta - 0.5*n);
-        } else {
-            args.degree = args.degree + n;
-        }
+        const Arguments levelArgs = LevelArguments(args, n);
+        steps.levelOutputs.push_back(std::make_shared<StepOutput>(levelArgs));
+        steps.diagonalOutputs.push_back(std::make_shared<StepOutput>(levelArgs));
+        steps.nPlus2Outputs.push_back(std::make_shared<StepOutput>(levelArgs));
+    }
 
-        // FIXME: directly generate only the monomials with the correct parity
-        std::vector<Basis<Mono>> allEvenBases;
-        std::vector<Basis<Mono>> allOddBases;
-        for(int deg = n; deg <= args.degree; ++deg){
-            splitBasis<Mono> degBasis(n, deg, args);
-            allEvenBases.push_back(degBasis.EvenBasis());
-            allOddBases.push_back(degBasis.OddBasis());
-        }
-        const std::vector<Basis<Mono>>& inputBases = 
-                                            (odd ? allOddBases : allEvenBases);
-
-        const std::string suffix = std::to_string(n) + parity;
-        std::vector<Poly> orthogonalized = 
-                        ComputeBasisStates_SameParity(inputBases, args, odd);
-        minBases.push_back(MinimalBasis(orthogonalized));
-        DMatrix polysOnMinBasis = PolysOnMinBasis(minBases[n-minN],
-                                               orthogonalized, outStream);
-        discPolys.push_back(DiscretizePolys(polysOnMinBasis, args.partitions));
-        if (mathematica) {
-            outStream << "minimalBasis[" << suffix << "] = "
-                << MathematicaOutput(minBases[n-minN]) << endl;
-            outStream << "(*Polynomials on this basis (as rows, not columns!):*)\n"
-                << "polysOnMinBasis[" << suffix << "] = " 
-                << MathematicaOutput(polysOnMinBasis.transpose()) << endl;
-            outStream << "(*And discretized:*)\ndiscretePolys[" << suffix 
-                << "] = " << MathematicaOutput(discPolys[n-minN].transpose()) 
-                << endl;
-        } else {
-            outStream << "Minimal basis (" << n << "):" << minBases[n-minN] << endl;
-        }
+    std::vector<Pool::Task<Level>> levelTasks;
+    for (int n = minN; n <= maxN; ++n) {
+        const std::shared_ptr<StepOutput> output = steps.levelOutputs[n-minN];
+        levelTasks.emplace_back([output, odd]() {
+                return ComputeLevel(output->Args(), odd);
+            });
+        steps.levels[n-minN] = levelTasks.back().GetFuture();
+    }
+
+    // if a level turns out to be empty, its blocks are skipped
+    for (int n = maxN; n >= minN; --n) {
+        const std::shared_ptr<StepOutput> output = steps.diagonalOutputs[n-minN];
+        const Pool::Future<Level> level = steps.levels[n-minN];
+        const Pool::Task<KronMatrix> diagonal([output, level, odd]() {
+                const Level& states = level.Get();
+                if (states.minBasis.size() == 0) return KronMatrix();
+                return DiagonalBlock(states.minBasis, states.polys, 
+                                     output->Args(), odd, output->Log());
+            });
+        diagonal.After(levelTasks[n-minN]);
+        diagonal.Start();
+        steps.diagonal[n-minN] = diagonal.GetFuture();
+    }
 
-        if (minBases[n-minN].size() == 0) {
-            continue;
+    if (interacting) {
+        for (int n = maxN; n-2 >= minN; --n) {
+            const std::shared_ptr<StepOutput> output = 
+                steps.nPlus2Outputs[n-minN];
+            const Pool::Future<Level> levelA = steps.levels[n-2-minN];
+            const Pool::Future<Level> levelB = steps.levels[n-minN];
+            const Pool::Task<DMatrix> nPlus2([output, levelA, levelB, odd]() {
+                    const Level& statesA = levelA.Get();
+                    const Level& statesB = levelB.Get();
+                    if (statesB.minBasis.size() == 0) return DMatrix();
+                    return NPlus2Block(statesA.minBasis, statesA.discPolys,
+                                       statesB.minBasis, statesB.discPolys,
+                                       output->Args(), odd, output->Log());
+                });
+            nPlus2.After(levelTasks[n-2-minN]);
+            nPlus2.After(levelTasks[n-minN]);
+            nPlus2.Start();
+            steps.nPlus2[n-minN] = nPlus2.GetFuture();
         }
+    }
 
-        output.diagonal.push_back(DiagonalBlock(minBases[n-minN], 
-                                                discPolys[n-minN], 
-                                                args, odd));
-        if ((args.options & OPT_INTERACTING) != 0 && n-2 >= minN) {
-            output.nPlus2.push_back(NPlus2Block(minBases[n-2-minN], 
-                                                discPolys[n-2-minN],
-                                                minBases[n-minN],
-                                                discPolys[n-minN], 
-                                                args, odd));
+    for (int n = maxN; n >= minN; --n) levelTasks[n-minN].Start();
+    return steps;
+}
+
+// every step is waited for, even the skipped ones, so that none of them is 
+// still running once this returns
+Hamiltonian FinishHamiltonian(const HamiltonianSteps& steps, 
+                              const Arguments& args) {
+    Hamiltonian output;
+    output.maxN = steps.maxN;
+    for (std::size_t i = 0; i < steps.levels.size(); ++i) {
+        const Level& level = steps.levels[i].Get();
+        steps.levelOutputs[i]->WriteTo(args);
+        const KronMatrix& diagonal = steps.diagonal[i].Get();
+        if (steps.nPlus2[i].Valid()) steps.nPlus2[i].Get();
+        if (level.minBasis.size() == 0) continue;
+
+        output.diagonal.push_back(diagonal);
+        steps.diagonalOutputs[i]->WriteTo(args);
+        if (steps.nPlus2[i].Valid()) {
+            output.nPlus2.push_back(steps.nPlus2[i].Get());
+            steps.nPlus2Outputs[i]->WriteTo(args);
         }
     }
 
     return output;
 }
 
-DMatrix DiagonalBlock(const Basis<Mono>& minimalBasis, 
-                      const SMatrix& discPolys, 
-                      const Arguments& args, const bool odd) {
+// the arguments for the given n-level, with the degree adjusted to match
+Arguments LevelArguments(Arguments args, const int n) {
+    // FIXME: remove adjustment so degree's consistently "L above dirichlet"
+    if (args.delta != 0.0) {
+        args.numP = n;
+        args.degree = std::ceil(args.delta - 0.5*n);
+    } else {
+        args.degree = args.degree + n;
+    }
+    return args;
+}
+
+// the basis states at args.numP (see Stages::GetStates), expressed on their 
+// minimal basis and discretized
+Level ComputeLevel(const Arguments& args, const bool odd) {
+    const int n = args.numP;
+    OStream& outStream = *args.outStream;
+
+    const std::string suffix = std::to_string(n) + (odd ? ", odd" : ", even");
+    const auto states = Stages::GetStates(n, args.degree, odd, args);
+    const Basis<Mono>& minBasis = states->minBasis;
+    DMatrix polysOnMinBasis = PolysOnMinBasis(minBasis, states->orthogonalized,
+                                              outStream);
+    SMatrix discPolys = DiscretizePolys(polysOnMinBasis, args.partitions);
+    if ((args.options & OPT_MATHEMATICA) != 0) {
+        outStream << "minimalBasis[" << suffix << "] = "
+            << MathematicaOutput(minBasis) << endl;
+        outStream << "(*Polynomials on this basis (as rows, not columns!):*)\n"
+            << "polysOnMinBasis[" << suffix << "] = " 
+            << MathematicaOutput(polysOnMinBasis.transpose()) << endl;
+        outStream << "(*And discretized:*)\ndiscretePolys[" << suffix 
+            << "] = " << MathematicaOutput(discPolys.transpose()) << endl;
+    } else {
+        outStream << "Minimal basis (" << n << "):" << minBasis << endl;
+    }
+
+    return Level{minBasis, polysOnMinBasis, discPolys};
+}
+
+// the free part of the block is kept as a sum of Kronecker products of Fock
+// and mu parts; only the interaction has to be a dense (basis*partitions)^2
+// matrix
+KronMatrix DiagonalBlock(const Basis<Mono>& minimalBasis, 
+                         const DMatrix& polysOnMinBasis, 
+                         const Arguments& args, const bool odd, 
+                         std::ostream& log) {
     *args.console << "DiagonalBlock(" << args.numP << ", " << args.degree << ")" 
         << endl;
     Timer timer;
@@ -216,23 +294,28 @@ DMatrix DiagonalBlock(const Basis<Mono>& minimalBasis,
     std::string suffix = std::to_string(args.numP) + (odd ? ", odd" : ", even");
 
     timer.Start();
-    DMatrix monoMassMatrix(MassMatrix(minimalBasis, args.partitions));
-    DMatrix polyMassMatrix = discPolys.transpose()*monoMassMatrix*discPolys;
+    KronMatrix monoMassMatrix(MassMatrix(minimalBasis, args.partitions));
+    KronMatrix polyMassMatrix = monoMassMatrix.Project(polysOnMinBasis, 
+                                                       polysOnMinBasis);
     OutputMatrix(monoMassMatrix, polyMassMatrix, "mass matrix", suffix, timer,
                  args);
 
     timer.Start();
-    DMatrix monoKineticMatrix(KineticMatrix(minimalBasis, args.partitions));
-    DMatrix polyKineticMatrix = discPolys.transpose()*monoKineticMatrix*discPolys;
+    KronMatrix monoKineticMatrix(KineticMatrix(minimalBasis, args.partitions));
+    KronMatrix polyKineticMatrix = monoKineticMatrix.Project(polysOnMinBasis, 
+                                                             polysOnMinBasis);
     OutputMatrix(monoKineticMatrix, polyKineticMatrix, "kinetic matrix", suffix,
                  timer, args);
 
-    DMatrix hamiltonian = args.msq*polyMassMatrix 
-                        + (args.cutoff*args.cutoff)*polyKineticMatrix;
+    KronMatrix hamiltonian = args.msq*polyMassMatrix 
+                           + (args.cutoff*args.cutoff)*polyKineticMatrix;
     if (interacting) {
         timer.Start();
-        DMatrix monoNtoN(InteractionMatrix(minimalBasis, args.partitions));
-        DMatrix polyNtoN = discPolys.transpose()*monoNtoN*discPolys;
+        KronMatrix monoNtoN(InteractionMatrix(minimalBasis, args.partitions,
+                                              log), 
+                            args.partitions);
+        KronMatrix polyNtoN = monoNtoN.Project(polysOnMinBasis, 
+                                               polysOnMinBasis);
         OutputMatrix(monoNtoN, polyNtoN, "NtoN matrix", suffix, timer, 
                      args);
         hamiltonian += (args.lambda*args.cutoff)*polyNtoN;
@@ -255,7 +338,7 @@ DMatrix DiagonalBlock(const Basis<Mono>& minimalBasis,
 // basisA is the minBasis of degree n, while basisB is the one for degree n+2
 DMatrix NPlus2Block(const Basis<Mono>& basisA, const SMatrix& discPolysA,
                     const Basis<Mono>& basisB, const SMatrix& discPolysB,
-                    const Arguments& args, const bool odd) {
+                    const Arguments& args, const bool odd, std::ostream& log) {
     *args.console << "NPlus2Block(" << args.numP-2 << " -> " << args.numP << ")" 
         << endl;
     Timer timer;
@@ -263,7 +346,7 @@ DMatrix NPlus2Block(const Basis<Mono>& basisA, const SMatrix& discPolysA,
                        + (odd ? ", odd" : ", even");
 
     timer.Start();
-    DMatrix monoNPlus2(NPlus2Matrix(basisA, basisB, args.partitions));
+    DMatrix monoNPlus2(NPlus2Matrix(basisA, basisB, args.partitions, log));
     DMatrix polyNPlus2 = discPolysA.transpose()*monoNPlus2*discPolysB;
     OutputMatrix(monoNPlus2, polyNPlus2, "NPlus2 matrix", suffix, timer, args);
 
@@ -290,7 +373,8 @@ void AnalyzeHamiltonian_Dense(const Hamiltonian& hamiltonian,
     Eigen::Index trailingOffset = 0;
     for (std::size_t n = 2; n < hamiltonian.diagonal.size()+2; ++n) {
         const auto& block = hamiltonian.diagonal[n-2];
-        matrixForm.block(offset, offset, block.rows(), block.cols()) = block;
+        matrixForm.block(offset, offset, block.rows(), block.cols()) 
+            = block.Dense();
 
         if (n >= 4) {
             const auto& nPlus2Block = hamiltonian.nPlus2[n-4];
@@ -376,6 +460,19 @@ void OutputMatrix(const DMatrix& monoMatrix, const DMatrix& polyMatrix,
     }
 }
 
+// the dense forms are only made if they're actually going to be printed
+void OutputMatrix(const KronMatrix& monoMatrix, const KronMatrix& polyMatrix,
+                  std::string name, const std::string& suffix, Timer& timer, 
+                  const Arguments& args) {
+    const bool mathematica = (args.options & OPT_MATHEMATICA) != 0;
+    if (mathematica || (polyMatrix.rows() <= 10 && polyMatrix.cols() <= 10)) {
+        OutputMatrix(monoMatrix.Dense(), polyMatrix.Dense(), name, suffix, 
+                     timer, args);
+    } else {
+        OutputMatrix(DMatrix(), polyMatrix.Dense(), name, suffix, timer, args);
+    }
+}
+
 // capitalize each word, then delete all non-alphanumeric chars (inc. spaces)
 std::string MathematicaName(std::string name) {
     name[0] = std::toupper(name[0]);
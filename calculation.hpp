@@ -3,8 +3,10 @@
 
 #include <cctype>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
+#include <memory>
 
 #include <gsl/gsl_errno.h>  // handling for GSL errors
 
@@ -20,30 +22,64 @@
 #include "matrix.hpp"
 #include "multinomial.hpp" // the coefficients are initialized in Calculate()
 #include "discretization.hpp"
+#include "memo.hpp"
+#include "kronecker.hpp"
+#include "thread-pool.hpp"
+#include "stages.hpp"
 
 // actual computations --------------------------------------------------------
 
 struct Hamiltonian {
     int maxN;
-    std::vector<DMatrix> diagonal;
+    std::vector<KronMatrix> diagonal;
     std::vector<DMatrix> nPlus2;
 };
 
+// one n-level of one parity: its minimal basis and the basis states on it
+struct Level {
+    Basis<Mono> minBasis;
+    DMatrix polys;
+    SMatrix discPolys;
+};
+
+// The steps of FullHamiltonian for one parity, indexed by n - minN. They're all
+// started at once by StartHamiltonian: each diagonal block only waits for its
+// own level and each N+2 block for its two levels, so the levels and blocks of
+// both parities are all done side by side. FinishHamiltonian then collects them
+// in order, writing out each step's output as soon as it and the ones before it
+// are done.
+struct HamiltonianSteps {
+    int minN;
+    int maxN;
+    std::vector<Pool::Future<Level>> levels;
+    std::vector<Pool::Future<KronMatrix>> diagonal;
+    // not Valid() for the levels which don't have an N+2 block
+    std::vector<Pool::Future<DMatrix>> nPlus2;
+    std::vector<std::shared_ptr<StepOutput>> levelOutputs;
+    std::vector<std::shared_ptr<StepOutput>> diagonalOutputs;
+    std::vector<std::shared_ptr<StepOutput>> nPlus2Outputs;
+};
+
 int Calculate(const Arguments& args);
 std::vector<Poly> ComputeBasisStates(const Arguments& args);
-std::vector<Poly> ComputeBasisStates_SameParity(
-        const std::vector<Basis<Mono>>& inputBases, const Arguments& args,
-        const bool odd);
+std::vector<Poly> ComputeBasisStates_SameParity(const int numP, 
+        const int degree, const Arguments& args, const bool odd);
 DMatrix PolysOnMinBasis(const Basis<Mono>& minimalBasis,
-        const std::vector<Poly> orthogonalized, OStream& outStream);
+        const std::vector<Poly>& orthogonalized, OStream& outStream);
 DMatrix ComputeHamiltonian(const Arguments& args);
-Hamiltonian FullHamiltonian(Arguments args, const bool odd);
-DMatrix DiagonalBlock(const Basis<Mono>& minimalBasis, 
-                      const SMatrix& discPolys, 
-                      const Arguments& args, const bool odd);
+Hamiltonian FullHamiltonian(const Arguments& args, const bool odd);
+HamiltonianSteps StartHamiltonian(const Arguments& args, const bool odd);
+Hamiltonian FinishHamiltonian(const HamiltonianSteps& steps, 
+                              const Arguments& args);
+Arguments LevelArguments(Arguments args, const int n);
+Level ComputeLevel(const Arguments& args, const bool odd);
+KronMatrix DiagonalBlock(const Basis<Mono>& minimalBasis, 
+                         const DMatrix& polysOnMinBasis, 
+                         const Arguments& args, const bool odd, 
+                         std::ostream& log);
 DMatrix NPlus2Block(const Basis<Mono>& basisA, const SMatrix& discPolysA,
                     const Basis<Mono>& basisB, const SMatrix& discPolysB,
-                    const Arguments& args, const bool odd);
+                    const Arguments& args, const bool odd, std::ostream& log);
 
 void AnalyzeHamiltonian(const Hamiltonian& hamiltonian, const Arguments& args);
 void AnalyzeHamiltonian_Dense(const Hamiltonian& hamiltonian, 
@@ -56,6 +92,9 @@ void AnalyzeHamiltonian_Sparse(const Hamiltonian& hamiltonian,
 void OutputMatrix(const DMatrix& monoMatrix, const DMatrix& polyMatrix,
                   std::string name, const std::string& suffix, Timer& timer, 
                   const Arguments& args);
+void OutputMatrix(const KronMatrix& monoMatrix, const KronMatrix& polyMatrix,
+                  std::string name, const std::string& suffix, Timer& timer, 
+                  const Arguments& args);
 std::string MathematicaName(std::string name);
 
 // bookkeeping stuff ----------------------------------------------------------
@@ -103,12 +103,16 @@ typedef Eigen::SelfAdjointEigenSolver<
 // as zero for things such as Gram-Schmidt. Note this is much larger than the
 // epsilon defined as "the smallest possible difference between two values"
 constexpr coeff_class EPSILON = 1e-8;
-// maximum number of threads to use for functions I implement. Note that Qt has
-// its own thread system which does not use this variable
+// maximum number of threads to use by default for functions I implement (see
+// thread-pool.hpp); more can be asked for with -j. Note that Qt has its own 
+// thread system which does not use this variable
 constexpr unsigned int MAX_THREADS = 8u;
 // maximum side length of a matrix to represent it densely; above this, sparse
 // methods will usually be used. Note this is not the number of entries
 constexpr Eigen::Index MAX_DENSE_SIZE = 1e4;
+// maximum number of particles in a Mono, which keeps them in a fixed array;
+// this is also the largest number of particles a calculation can go up to
+constexpr std::size_t MAX_PARTICLES = 16;
 
 struct Arguments {
     int numP = -1;
@@ -118,6 +122,8 @@ struct Arguments {
     coeff_class msq = 1; // the coefficient of the mass term
     coeff_class lambda = 1; // the coefficient of the interaction term
     coeff_class cutoff = 1; // the energy cutoff (capital lambda)
+    std::size_t cacheLimit = 0; // bytes per memo cache; 0 means no limit
+    unsigned int threads = 0; // threads in the Pool; 0 means one per core
     int options = 0;
     OStream* outStream = nullptr;
     OStream* console = nullptr;
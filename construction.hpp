@@ -7,6 +7,7 @@
 #include <iostream>
 
 #include "io.hpp"
+#include "partitions.hpp"
 
 // T can be any type or class with an == operator; value indexes T by uint
 template<typename Accessor>
@@ -53,33 +54,22 @@ inline std::vector<std::vector<int>> Permute(const std::vector<std::vector<int>>
     return ret;
 }
 
+// the non-increasing sequences of numP entries whose sum is deg (if exact) or
+// between min and deg (if not), in the order of NextPartition()
 template<typename T>
 inline std::vector<std::vector<T>> GetStatesByDegree(const T numP, 
 		const T deg, const bool exact, const T min) {
     std::vector<std::vector<T>> ret;
-    if(numP == 0 || deg == 0){
-        ret.resize(1);
-        ret[0].resize(numP, 0);
-        return ret;
-    }
-    T lowerBound;
-    if(exact){
-        lowerBound = deg/numP;
-        if(deg % numP == 0) lowerBound--;
-    } else {
-        lowerBound = -1;
-    }
-    lowerBound = std::max<T>(lowerBound, min/numP + (min%numP!=0) - 1 - (min<0));
-    for (T i = deg; i > lowerBound; --i) {
-        std::vector<std::vector<T>> candidates = GetStatesByDegree<T>(numP-1,
-                        deg-i, exact, min-i);
-        for(auto& cand : candidates){
-            if(cand.size() == 0 || cand[0] <= i){
-                cand.insert(cand.begin(), i);
-                ret.push_back(cand);
-            }
+    std::vector<T> state(numP);
+    FirstPartition(state.begin(), numP, deg);
+    do {
+        if (!exact) {
+            T sum = 0;
+            for (auto entry : state) sum += entry;
+            if (sum < min) continue;
         }
-    }
+        ret.push_back(state);
+    } while (NextPartition(state.begin(), numP, deg, exact));
     return ret;
 }
 
@@ -191,9 +181,142 @@ inline std::vector<std::vector<int>> CfgsFromNodes(const int remainingEnergy,
     std::vector<std::vector<int>> nodeEnergies(GetStatesByDegree<int>(nodes.size(),
                             remainingEnergy, exact, 0));
     nodeEnergies = Permute(nodeEnergies);
-    std::vector<std::vector<int>> perpCfgs(CfgsFromNodePartition(nodes, 
-                            nodeEnergies));
     return CfgsFromNodePartition(nodes, nodeEnergies);
 }
 
+// streaming state generation -------------------------------------------------
+
+// which states to generate, by the parity of their total P_\perp
+enum class Parity { All, Even, Odd };
+
+// Generates the Dirichlet configurations of numP particles at the given degree
+// one at a time, in the same order as the old generate-and-combine method:
+// * the P_- configurations come from GetStatesUpToDegree (or GetStatesAtDegree
+// if allMinus), before the required Dirichlet P_- are added;
+// * for each of these, the remaining energy is split between the nodes of
+// equal P_- in every order, going through the partitions as in CfgsFromNodes;
+// * each node's energy is split between its particles as in GetStatesAtDegree,
+// with the last node changing fastest.
+// The total P_\perp is the remaining energy, so the parity of a state is known
+// as soon as its P_- are, and P_- configurations of the wrong parity are
+// skipped entirely. Use as
+//     for (DirichletCfgs cfgs(...); cfgs.Next(); ) Use(cfgs.Current());
+class DirichletCfgs {
+    public:
+        DirichletCfgs(const int numP, const int degree, const bool allMinus,
+                const Parity parity = Parity::All);
+
+        bool Next();
+        const std::vector<particle>& Current() const { return particles; }
+
+    private:
+        int numP;
+        int degree; // without the Dirichlet P_-
+        bool allMinus;
+        Parity parity;
+        bool started = false;
+        bool done = false;
+
+        std::vector<int> minus;
+        std::vector<int> nodes;
+        int remaining = 0;
+        std::vector<int> nodeEnergies;
+        std::vector<int> perp;
+        std::vector<particle> particles;
+
+        bool StartMinus();
+        void StartPerp();
+        bool NextPerp();
+        bool NextNodeEnergies();
+        void Fill();
+};
+
+inline DirichletCfgs::DirichletCfgs(const int numP, const int degree,
+        const bool allMinus, const Parity parity): numP(numP), 
+        degree(degree - numP), allMinus(allMinus), parity(parity),
+        minus(numP), perp(numP, 0), particles(numP) {
+    // there are no Dirichlet states with degree < numP
+    if (numP <= 0 || this->degree < 0) done = true;
+}
+
+inline bool DirichletCfgs::Next() {
+    if (done) return false;
+    if (!started) {
+        started = true;
+        FirstPartition(minus.begin(), numP, degree);
+        if (StartMinus()) {
+            Fill();
+            return true;
+        }
+    } else if (!allMinus && (NextPerp() || NextNodeEnergies())) {
+        Fill();
+        return true;
+    }
+    while (NextPartition(minus.begin(), numP, degree, allMinus)) {
+        if (StartMinus()) {
+            Fill();
+            return true;
+        }
+    }
+    done = true;
+    return false;
+}
+
+// sets up the first state with the current P_-, returning false if its states
+// have the wrong parity
+inline bool DirichletCfgs::StartMinus() {
+    if (allMinus) return parity != Parity::Odd;
+    remaining = degree;
+    for (auto pm : minus) remaining -= pm;
+    if ((parity == Parity::Even && remaining % 2 == 1)
+            || (parity == Parity::Odd && remaining % 2 == 0)) {
+        return false;
+    }
+    nodes = IdentifyNodes(minus);
+    nodeEnergies.resize(nodes.size());
+    FirstPartition(nodeEnergies.begin(), nodes.size(), remaining);
+    StartPerp();
+    return true;
+}
+
+inline void DirichletCfgs::StartPerp() {
+    auto start = perp.begin();
+    for (auto i = 0u; i < nodes.size(); ++i) {
+        FirstPartition(start, nodes[i], nodeEnergies[i]);
+        start += nodes[i];
+    }
+}
+
+// the odometer over the partitions of each node's energy
+inline bool DirichletCfgs::NextPerp() {
+    auto end = perp.end();
+    for (auto i = nodes.size(); i-- > 0; ) {
+        auto start = end - nodes[i];
+        if (NextPartition(start, nodes[i], nodeEnergies[i], true)) return true;
+        FirstPartition(start, nodes[i], nodeEnergies[i]);
+        end = start;
+    }
+    return false;
+}
+
+// every distinct ordering of one partition of the energy between the nodes
+// comes before the next partition
+inline bool DirichletCfgs::NextNodeEnergies() {
+    // prev_permutation leaves the partition sorted again when it returns false
+    if (!std::prev_permutation(nodeEnergies.begin(), nodeEnergies.end())
+            && !NextPartition(nodeEnergies.begin(), nodeEnergies.size(),
+                              remaining, true)) {
+        return false;
+    }
+    StartPerp();
+    return true;
+}
+
+inline void DirichletCfgs::Fill() {
+    for (int i = 0; i < numP; ++i) {
+        particles[i].pm = minus[i] + 1;
+        particles[i].pt = perp[i];
+    }
+}
+
 #endif
@@ -60,147 +60,294 @@ DMatrix MuPart_Kinetic(const std::size_t partitions) {
 // interaction (same n) matrix computations -----------------------------------
 
 namespace {
-    std::unordered_map<std::array<char,2>, DMatrix, 
-        boost::hash<std::array<char,2>> > nPlus2Cache;
+    // the window matrices depend on the number of partitions as well as the
+    // exponents, so that goes into the keys too
+    Memo::Cache<std::array<int,3>, DMatrix,
+        boost::hash<std::array<int,3>> > intCache("MuPart_NtoN");
+    Memo::Cache<std::array<int,3>, DMatrix, 
+        boost::hash<std::array<int,3>> > nPlus2Cache("MuPart_NPlus2");
+    Memo::Cache<std::size_t, DMatrix> zeroMatrix("MuPart_NPlus2 (zero)");
+
+    // The gamma functions in the N to N windows only depend on the exponents,
+    // so MuPart_NtoN works them out once for the whole block instead of once
+    // per window. The Greater windows are Less windows with the exponents
+    // from GreaterExponents()
+    struct NtoNGammas {
+        explicit NtoNGammas(const std::array<char,2>& exponents);
+
+        std::array<char,2> exponents;
+        builtin_class a; // exponent of alpha (not alpha^2)
+        builtin_class r; // exponent of r     (not r^2)
+        coeff_class overall;
+        builtin_class plus;  // tgamma((a+2)/2)
+        builtin_class minus; // tgamma((a-1)/2)
+    };
+
+    NtoNGammas::NtoNGammas(const std::array<char,2>& exponents):
+        exponents(exponents), a(exponents[0]/2.0), r(exponents[1]),
+        overall(std::sqrt(M_PI)*std::tgamma(0.5 + r/2.0) / 3.0),
+        plus(std::tgamma((a+2.0)/2.0)), minus(std::tgamma((a-1.0)/2.0)) {
+    }
+
+    std::array<char,2> GreaterExponents(const std::array<char,2>& exponents) {
+        return {{static_cast<char>(2*exponents[1]-exponents[0]), exponents[1]}};
+    }
+
+    // The off-diagonal windows are sums of an antiderivative F(mu1, mu2) over
+    // their four corners, with the signs alternating around the window. F has
+    // two terms, which are kept apart so that they're added up in the same
+    // order as they would be one window at a time
+    struct CornerTerms {
+        coeff_class plus;
+        coeff_class minus;
+    };
+    // indexed by [i][j] for the corner (mu1_ab[i], mu2_ab[j])
+    typedef std::array<std::array<CornerTerms,2>,2> WindowCorners;
+
+    coeff_class SumCorners(const WindowCorners& corners) {
+        coeff_class sum = 0;
+        for (std::size_t i = 0; i < 2; ++i) {
+            for (std::size_t j = 0; j < 2; ++j) {
+                int sign = (i+j)%2 == 0 ? 1 : -1;
+                sum += sign * corners[i][j].plus;
+                sum -= sign * corners[i][j].minus;
+            }
+        }
+        return sum;
+    }
+
+    // Neighbouring windows share their corners, so the blocks evaluate F once
+    // at each point (p, q) of the grid of window edges and take the corners of
+    // each window from there. The windows are all above the diagonal, so only
+    // the points with 1 <= q, p <= q and p < partitions are ever used, and
+    // those are the only ones filled in. The points are done a row at a time
+    // so that each row's hypergeometric functions can be done as one batch:
+    // row(p, first) gives the points (p, first), ..., (p, partitions)
+    template<typename Row>
+    std::vector<CornerTerms> CornerGrid(const std::size_t partitions,
+                                        const Row& row) {
+        std::vector<CornerTerms> grid((partitions + 1)*(partitions + 1));
+        if (partitions < 2) return grid;
+        Pool::ParallelFor(partitions, [&](const std::size_t p) {
+                const std::size_t first = std::max<std::size_t>(p, 1);
+                const std::vector<CornerTerms> terms = row(p, first);
+                std::copy(terms.begin(), terms.end(), 
+                          grid.begin() + p*(partitions + 1) + first);
+            });
+        return grid;
+    }
+
+    WindowCorners GridCorners(const std::vector<CornerTerms>& grid,
+                              const std::size_t partitions,
+                              const std::size_t winA, const std::size_t winB) {
+        WindowCorners corners;
+        for (std::size_t i = 0; i < 2; ++i) {
+            for (std::size_t j = 0; j < 2; ++j) {
+                corners[i][j] = grid[(winA + i)*(partitions + 1) + winB + j];
+            }
+        }
+        return corners;
+    }
+
+    // the corners (mu1, mu2) for each of the mu2s
+    std::vector<CornerTerms> LessCorners(const NtoNGammas& gammas, 
+            const builtin_class mu1, const std::vector<builtin_class>& mu2s) {
+        const builtin_class a = gammas.a;
+        const builtin_class r = gammas.r;
+
+        std::vector<builtin_class> xs(mu2s.size());
+        for (std::size_t j = 0; j < mu2s.size(); ++j) xs[j] = mu1 / mu2s[j];
+        const std::vector<coeff_class> plusHypergeos = Hypergeometric3F2_Reg(
+                {{0.5, 0.5 + r/2.0, (a+2.0)/2.0, r/2.0 + 1.0, 
+                  (a+2.0)/2.0 + 1.0}}, xs);
+        // FIXME?? below assumes that all infinite terms must exactly cancel
+        // each other
+        const bool useMinus = gammas.exponents[0] != 2;
+        std::vector<coeff_class> minusHypergeos;
+        if (useMinus) {
+            minusHypergeos = Hypergeometric3F2_Reg({{0.5, 0.5 + r/2.0, 
+                    (a-1.0)/2.0, r/2.0 + 1.0, (a-1.0)/2.0 + 1.0}}, xs);
+        }
+
+        std::vector<CornerTerms> terms(mu2s.size());
+        for (std::size_t j = 0; j < mu2s.size(); ++j) {
+            coeff_class common = mu1 * std::sqrt(mu2s[j]) 
+                               * std::pow(xs[j], a/2.0);
+            terms[j].plus = common * gammas.plus * plusHypergeos[j];
+            terms[j].minus = useMinus ? 
+                common * gammas.minus * minusHypergeos[j] : 0;
+        }
+        return terms;
+    }
+
+    coeff_class LessWindow(const NtoNGammas& gammas, 
+                           const WindowCorners& corners,
+                           const std::array<builtin_class,2>& mu1sq_ab,
+                           const std::array<builtin_class,2>& mu2sq_ab) {
+        coeff_class hypergeos = SumCorners(corners);
+
+        if (!std::isfinite(static_cast<builtin_class>(hypergeos))) {
+            std::cerr << "Error: NtoNWindow_Less(" << gammas.exponents << ", " 
+                << mu1sq_ab << ", " << mu2sq_ab << ") not finite." 
+                << std::endl;
+        }
+
+        return gammas.overall * hypergeos;
+    }
+
+    coeff_class EqualTerm(const std::array<builtin_class,2>& musq_ab,
+                          const builtin_class arg, const builtin_class gamma,
+                          const builtin_class r, const bool useMuB) {
+        // FIXME?? dubious; but we're assuming that if arg is a pole of the
+        // gamma function it will just produce an infinity which has to cancel
+        // against something
+        if (arg <= 0 && arg - std::round(arg) < EPSILON) {
+            return 0;
+        }
+
+        const builtin_class& msA = musq_ab[0];
+        const builtin_class& msB = musq_ab[1];
+        auto HGR = &NtoNWindow_Equal_Hypergeometric;
+        coeff_class output = useMuB ? std::pow(msB, 1.5) : std::pow(msA, 1.5);
+        if (msA == 0) {
+            // if msA == 0, the second HGR is just 1, so the second term is
+            // either 0 or infinity. If it's infinity it's going to have to
+            // cancel, so we drop it; if it's zero, it'll be zero either way.
+            output *= HGR(arg, r, 1);
+        } else {
+            output *= HGR(arg, r, 1) 
+                    - std::pow(msA/msB, arg)*HGR(arg, r, msA/msB);
+        }
+        return gamma * output;
+    }
 
-    std::unordered_map<std::size_t,DMatrix> zeroMatrix;
-    std::unordered_map<std::size_t,DMatrix> nEquals2Matrix;
+    // less has the original exponents and greater has GreaterExponents()
+    coeff_class EqualWindow(const NtoNGammas& less, const NtoNGammas& greater,
+                            const std::array<builtin_class,2>& musq_ab) {
+        const builtin_class a = less.a;
+        const builtin_class r = less.r;
+
+        coeff_class hypergeos = 0;
+        hypergeos += EqualTerm(musq_ab, (a+2.0)/2.0, less.plus, r, true );
+        hypergeos -= EqualTerm(musq_ab, (a-1.0)/2.0, less.minus, r, false);
+        hypergeos += EqualTerm(musq_ab, ((r-a)+2.0)/2.0, greater.plus, r, 
+                               true );
+        hypergeos -= EqualTerm(musq_ab, ((r-a)-1.0)/2.0, greater.minus, r,
+                               false);
+
+        if (!std::isfinite(static_cast<builtin_class>(hypergeos))) {
+            std::cerr << "Error: NtoNWindow_Equal(" << less.exponents << ", " 
+                << musq_ab << ") not finite." << std::endl;
+        }
 
-    // caches for expensive functions
-    std::unordered_map<std::array<builtin_class,3>,coeff_class,
-        boost::hash<std::array<builtin_class,3>> > betaCache;
+        return less.overall * hypergeos;
+    }
+
+    // the corner grids and the rows of windows are filled on the Pool
+    DMatrix NtoNWindows(const std::array<char,2>& exponents,
+                        const std::size_t partitions) {
+        const NtoNGammas less(exponents);
+        const NtoNGammas greater(GreaterExponents(exponents));
+        const builtin_class partWidth = builtin_class(1) / partitions;
+        std::vector<builtin_class> edges(partitions + 1);
+        for (std::size_t k = 0; k <= partitions; ++k) edges[k] = k*partWidth;
+        const std::vector<CornerTerms> lessGrid = CornerGrid(partitions,
+                [&](const std::size_t p, const std::size_t first) {
+                    return LessCorners(less, edges[p], 
+                            std::vector<builtin_class>(edges.begin() + first, 
+                                                       edges.end()));
+                });
+        const std::vector<CornerTerms> greaterGrid = CornerGrid(partitions,
+                [&](const std::size_t p, const std::size_t first) {
+                    return LessCorners(greater, edges[p], 
+                            std::vector<builtin_class>(edges.begin() + first, 
+                                                       edges.end()));
+                });
+
+        DMatrix block(partitions, partitions);
+        Pool::ParallelFor(partitions, [&](const std::size_t winA) {
+                const std::array<builtin_class,2> mu1sq_ab{{edges[winA], 
+                                                            edges[winA+1]}};
+                block(winA, winA) = EqualWindow(less, greater, mu1sq_ab);
+                for (std::size_t winB = winA+1; winB < partitions; ++winB) {
+                    const std::array<builtin_class,2> mu2sq_ab{{edges[winB], 
+                                                                edges[winB+1]}};
+                    block(winA, winB) = LessWindow(less, 
+                            GridCorners(lessGrid, partitions, winA, winB),
+                            mu1sq_ab, mu2sq_ab);
+                    block(winB, winA) = LessWindow(greater, 
+                            GridCorners(greaterGrid, partitions, winA, winB),
+                            mu1sq_ab, mu2sq_ab);
+                }
+            });
+        return block;
+    }
 } // anonymous namespace
 
 // before transformation, first exponent is that of alpha, and the second is 
 // that of r; afterward, the first is the exponent of sqrt(alpha), and the
 // second is the exponent of r
-const DMatrix& MuPart_NtoN(const unsigned int n,
-                           std::array<char,2> exponents, 
-                           const std::size_t partitions) {
-    static std::unordered_map<std::array<char,2>, DMatrix, 
-                              boost::hash<std::array<char,2>> > intCache;
-
+std::shared_ptr<const DMatrix> MuPart_NtoN(const unsigned int n,
+                                           std::array<char,2> exponents, 
+                                           const std::size_t partitions) {
     if (n > 2) {
         exponents[0] = 2*exponents[0] + n - 3;
         exponents[1] = exponents[1] + n - 3;
     }
 
-    builtin_class partWidth = builtin_class(1) / partitions;
-    if (intCache.count(exponents) == 0) {
-        DMatrix block(partitions, partitions);
-        for (std::size_t winA = 0; winA < partitions; ++winA) {
-            block(winA, winA) = NtoNWindow_Equal(exponents,
-                                                 {{winA*partWidth, 
-                                                   (winA+1)*partWidth}} );
-            for (std::size_t winB = winA+1; winB < partitions; ++winB) {
-                std::array<builtin_class,2> mu1sq_ab{{winA*partWidth, 
-                                                      (winA+1)*partWidth}};
-                std::array<builtin_class,2> mu2sq_ab{{winB*partWidth, 
-                                                      (winB+1)*partWidth}};
-                block(winA, winB) = NtoNWindow_Less(exponents, mu1sq_ab,
-                                                    mu2sq_ab);
-                block(winB, winA) = NtoNWindow_Greater(exponents, mu2sq_ab,
-                                                       mu1sq_ab);
-            }
+    const std::array<int,3> key{{exponents[0], exponents[1], 
+                                 static_cast<int>(partitions)}};
+    return intCache.Get(key, [&exponents, partitions]() {
+            return NtoNWindows(exponents, partitions);
+        });
+}
+
+namespace {
+    // the corners of one window, for the window functions on their own
+    WindowCorners LessWindowCorners(const NtoNGammas& gammas,
+            const std::array<builtin_class,2>& mu1sq_ab,
+            const std::array<builtin_class,2>& mu2sq_ab) {
+        const std::vector<builtin_class> mu2s(mu2sq_ab.begin(), 
+                                              mu2sq_ab.end());
+        WindowCorners corners;
+        for (std::size_t i = 0; i < 2; ++i) {
+            const std::vector<CornerTerms> terms = LessCorners(gammas, 
+                    mu1sq_ab[i], mu2s);
+            std::copy(terms.begin(), terms.end(), corners[i].begin());
         }
-        intCache.emplace(exponents, std::move(block));
+        return corners;
     }
-
-    return intCache[exponents];
-}
+} // anonymous namespace
 
 coeff_class NtoNWindow_Less(const std::array<char,2>& exponents,
                             const std::array<builtin_class,2>& mu1sq_ab,
                             const std::array<builtin_class,2>& mu2sq_ab) {
-    const builtin_class a = exponents[0]/2.0; // exponent of alpha (not alpha^2)
-    const builtin_class r = exponents[1];     // exponent of r     (not r^2)
-    const coeff_class overall = std::sqrt(M_PI)*std::tgamma(0.5 + r/2.0) / 3.0;
-
-    coeff_class hypergeos = 0;
-    for (std::size_t i = 0; i < 2; ++i) {
-        builtin_class mu1 = mu1sq_ab[i];
-        for (std::size_t j = 0; j < 2; ++j) {
-            builtin_class mu2 = mu2sq_ab[j];
-            int sign = (i+j)%2 == 0 ? 1 : -1;
-
-            builtin_class x = mu1 / mu2;
-
-            coeff_class common = sign * mu1 * std::sqrt(mu2) * std::pow(x, a/2.0);
-            hypergeos += common * std::tgamma((a+2.0)/2.0) *
-                Hypergeometric3F2_Reg(0.5, 0.5 + r/2.0, (a+2.0)/2.0,
-                                      r/2.0 + 1.0, (a+2.0)/2.0 + 1.0, x);
-            // FIXME?? below assumes that all infinite terms must exactly cancel
-            // each other
-            if (exponents[0] != 2) {
-                hypergeos -= common * std::tgamma((a-1.0)/2.0) *
-                    Hypergeometric3F2_Reg(0.5, 0.5 + r/2.0, (a-1.0)/2.0, 
-                                          r/2.0 + 1.0, (a-1.0)/2.0 + 1.0, x);
-            }
-        }
-    }
-
-    if (!std::isfinite(static_cast<builtin_class>(hypergeos))) {
-        std::cerr << "Error: NtoNWindow_Less(" << exponents << ", " 
-            << mu1sq_ab << ", " << mu2sq_ab << ") not finite." << std::endl;
-    }
-
-    return overall * hypergeos;
+    const NtoNGammas gammas(exponents);
+    return LessWindow(gammas, 
+                      LessWindowCorners(gammas, mu1sq_ab, mu2sq_ab),
+                      mu1sq_ab, mu2sq_ab);
 }
 
 coeff_class NtoNWindow_Greater(const std::array<char,2>& exponents,
                        const std::array<builtin_class,2>& mu1sq_ab,
                        const std::array<builtin_class,2>& mu2sq_ab) {
-    return NtoNWindow_Less({{static_cast<char>(2*exponents[1]-exponents[0]), 
-                             exponents[1]}}, 
-                             mu2sq_ab, mu1sq_ab);
+    const NtoNGammas gammas(GreaterExponents(exponents));
+    return LessWindow(gammas, 
+                      LessWindowCorners(gammas, mu2sq_ab, mu1sq_ab),
+                      mu2sq_ab, mu1sq_ab);
 }
 
 coeff_class NtoNWindow_Equal(const std::array<char,2>& exponents,
                              const std::array<builtin_class,2>& musq_ab) {
-    const builtin_class a = exponents[0]/2.0; // exponent of alpha (was sqrt(a))
-    const builtin_class r = exponents[1];     // exponent of r
-    const coeff_class overall = std::sqrt(M_PI)*std::tgamma(0.5 + r/2.0) / 3.0;
-
-    coeff_class hypergeos = 0;
-    hypergeos += NtoNWindow_Equal_Term(musq_ab, (a+2.0)/2.0,     r, true );
-    hypergeos -= NtoNWindow_Equal_Term(musq_ab, (a-1.0)/2.0,     r, false);
-    hypergeos += NtoNWindow_Equal_Term(musq_ab, ((r-a)+2.0)/2.0, r, true );
-    hypergeos -= NtoNWindow_Equal_Term(musq_ab, ((r-a)-1.0)/2.0, r, false);
-
-    if (!std::isfinite(static_cast<builtin_class>(hypergeos))) {
-        std::cerr << "Error: NtoNWindow_Equal(" << exponents << ", " 
-            << musq_ab << ") not finite." << std::endl;
-    }
-
-    return overall * hypergeos;
+    return EqualWindow(NtoNGammas(exponents), 
+                       NtoNGammas(GreaterExponents(exponents)), musq_ab);
 }
 
 coeff_class NtoNWindow_Equal_Term(const std::array<builtin_class,2>& musq_ab,
                                   const builtin_class arg, 
                                   const builtin_class r,
                                   const bool useMuB) {
-    // FIXME?? dubious; but we're assuming that if arg is a pole of the gamma
-    // function it will just produce an infinity which has to cancel against
-    // something
-    if (arg <= 0 && arg - std::round(arg) < EPSILON) {
-        return 0;
-    }
-
-    const builtin_class& msA = musq_ab[0];
-    const builtin_class& msB = musq_ab[1];
-    auto HGR = &NtoNWindow_Equal_Hypergeometric;
-    // output *= HGR(arg, r, 1);
-    // output -= std::pow(msA/msB, arg) * std::pow(msA, 1.5) * HGR(arg, r, msA/msB);
-    coeff_class output = useMuB ? std::pow(msB, 1.5) : std::pow(msA, 1.5);
-    if (msA == 0) {
-        // if msA == 0, the second HGR is just 1, so the second term is either
-        // 0 or infinity. If it's infinity it's going to have to cancel, so we
-        // drop it; if it's zero, it'll be zero either way.
-        output *= HGR(arg, r, 1);
-    } else {
-        output *= HGR(arg, r, 1) - std::pow(msA/msB, arg)*HGR(arg, r, msA/msB);
-    }
-    return std::tgamma(arg) * output;
+    return EqualTerm(musq_ab, arg, std::tgamma(arg), r, useMuB);
 }
 
 builtin_class NtoNWindow_Equal_Hypergeometric(const builtin_class arg, 
@@ -210,103 +357,246 @@ builtin_class NtoNWindow_Equal_Hypergeometric(const builtin_class arg,
                                  (r+2.0)/2.0, arg + 1, x);
 }
 
-const DMatrix& MuPart_NPlus2(const std::array<char,2>& nr, 
-                             const std::size_t partitions) {
-    if (nr[1]%2 == 1) {
-        if (zeroMatrix.count(partitions) == 0) {
-            zeroMatrix.emplace(partitions, DMatrix::Zero(partitions, partitions));
+// n+2 interactions ------------------------------------------------------------
+
+namespace {
+    // the gamma functions in the diagonal n+2 windows only depend on n and r,
+    // so MuPart_NPlus2 works them out once for the whole block
+    struct NPlus2Gammas {
+        NPlus2Gammas(const char n, const char r);
+
+        char n;
+        builtin_class a;
+        // tgamma of (n+1)/4, (n+5)/4 + a, (n-5)/4 and (n-1)/4 + a, then
+        // 2 tgamma(a+1) / 3
+        std::array<builtin_class,5> gammas;
+    };
+
+    NPlus2Gammas::NPlus2Gammas(const char n, const char r): n(n), a(0.5 * r),
+            gammas{{std::tgamma((n+1.0)/4.0), std::tgamma((n+5.0)/4.0 + a),
+                    std::tgamma((n-5.0)/4.0), std::tgamma((n-1.0)/4.0 + a),
+                    2.0 * std::tgamma(a+1.0) / 3.0}} {
+    }
+
+    // the corners (mu1, mu2) for each of the mu2s, where mu1Plus is
+    // mu1^((n+1)/4) and the mu2Minus are the mu2^((n-5)/4)
+    std::vector<CornerTerms> NPlus2Corners(const char n, const builtin_class a,
+            const coeff_class mu1, const builtin_class mu1Plus,
+            const std::vector<builtin_class>& mu2s,
+            const std::vector<builtin_class>& mu2Minus) {
+        std::vector<builtin_class> xs(mu2s.size());
+        for (std::size_t j = 0; j < mu2s.size(); ++j) {
+            coeff_class mu2 = mu2s[j];
+            xs[j] = static_cast<builtin_class>(mu1 / mu2);
         }
-        return zeroMatrix[partitions];
+        const std::vector<coeff_class> plusHypergeos = Hypergeometric2F1(-a,
+                (n+1.0)/4.0, (n+5.0)/4.0, xs);
+        const std::vector<coeff_class> minusHypergeos = Hypergeometric2F1(-a,
+                (n-5.0)/4.0, (n-1.0)/4.0, xs);
+
+        std::vector<CornerTerms> terms(mu2s.size());
+        for (std::size_t j = 0; j < mu2s.size(); ++j) {
+            coeff_class term = mu1Plus / mu2Minus[j];
+            terms[j].plus = term * plusHypergeos[j] / (n + 1.0);
+            terms[j].minus = term * minusHypergeos[j] / (n - 5.0);
+        }
+        return terms;
     }
 
-    coeff_class partWidth = coeff_class(1) / partitions;
-    if (nPlus2Cache.count(nr) == 0) {
-        DMatrix block(partitions, partitions);
-        for (std::size_t winA = 0; winA < partitions; ++winA) {
-            // entry is 0 when alpha > 1, so winB >= winA; when winB == winA, we
-            // need to use a special answer as well
-            block(winA, winA) = NPlus2Window_Equal(nr[0], nr[1], 
-                                                   winA*partWidth, 
-                                                   (winA+1)*partWidth);
-            for (std::size_t winB = winA+1; winB < partitions; ++winB) {
-                block(winA, winB) = NPlus2Window(nr[0], nr[1], 
-                        {{static_cast<builtin_class>(winA*partWidth),
-                        static_cast<builtin_class>((winA+1)*partWidth)}},
-                        {{static_cast<builtin_class>(winB*partWidth), 
-                        static_cast<builtin_class>((winB+1)*partWidth)}} );
-            }
+    coeff_class OffDiagonalWindow(const char n, const builtin_class a,
+                                  const WindowCorners& corners,
+                                  const std::array<builtin_class,2>& mu1_ab,
+                                  const std::array<builtin_class,2>& mu2_ab) {
+        coeff_class overall = 8.0 / 3.0;
+
+        coeff_class hypergeos = SumCorners(corners);
+
+        if (!std::isfinite(static_cast<builtin_class>(hypergeos))) {
+            std::cerr << "Error: NPlus2Window(" << (int)n << ", " << a 
+                << ", " << mu1_ab << ", " << mu2_ab << ") not finite." 
+                << std::endl;
         }
-        nPlus2Cache.emplace(nr, std::move(block));
+        return overall * hypergeos;
+    }
+
+    coeff_class DiagonalWindow(const NPlus2Gammas& gammas, 
+                               const builtin_class mu_a, 
+                               const builtin_class mu_b) {
+        const char n = gammas.n;
+        const builtin_class a = gammas.a;
+        const std::array<builtin_class,5>& g = gammas.gammas;
+
+        coeff_class gammaPart = std::pow(mu_b, 1.5) * g[0] / g[1];
+        gammaPart -= std::pow(mu_a, 1.5) * g[2] / g[3];
+        gammaPart *= g[4];
+
+        coeff_class hyperPart = Hypergeometric2F1(-a, (n-5.0)/4.0, (n-1.0)/4.0,
+                                                  mu_a/mu_b) / (n - 5.0);
+        hyperPart -= Hypergeometric2F1(-a, (n+1.0)/4.0, (n+5.0)/4.0, 
+                                       mu_a/mu_b) / (n + 1.0);
+        hyperPart *= (8.0 * std::pow(mu_a, (n+1.0)/4.0))
+                   / (3.0 * std::pow(mu_b, (n-5.0)/4.0));
+
+        return gammaPart + hyperPart;
+    }
+
+    // the windows are filled on the Pool, with their corners taken from one
+    // CornerGrid for the whole block
+    DMatrix NPlus2Windows(const char n, const char r,
+                          const std::size_t partitions) {
+        const NPlus2Gammas gammas(n, r);
+        coeff_class partWidth = coeff_class(1) / partitions;
+        std::vector<builtin_class> edges(partitions + 1);
+        std::vector<builtin_class> powPlus(partitions + 1);
+        std::vector<builtin_class> powMinus(partitions + 1);
+        for (std::size_t k = 0; k <= partitions; ++k) {
+            edges[k] = static_cast<builtin_class>(k*partWidth);
+            coeff_class mu = edges[k];
+            powPlus[k] = std::pow(mu, (n+1.0)/4.0);
+            powMinus[k] = std::pow(mu, (n-5.0)/4.0);
+        }
+
+        const std::vector<CornerTerms> grid = CornerGrid(partitions,
+                [&](const std::size_t p, const std::size_t first) {
+                    return NPlus2Corners(n, gammas.a, edges[p], powPlus[p],
+                            std::vector<builtin_class>(edges.begin() + first, 
+                                                       edges.end()),
+                            std::vector<builtin_class>(powMinus.begin() + first,
+                                                       powMinus.end()));
+                });
+
+        // entries below the diagonal are never filled in, so they have to
+        // start at 0 (they're used in MuContraction like any others)
+        DMatrix block = DMatrix::Zero(partitions, partitions);
+        Pool::ParallelFor(partitions, [&](const std::size_t winA) {
+                // entry is 0 when alpha > 1, so winB >= winA; when
+                // winB == winA, we need to use a special answer as well
+                block(winA, winA) = DiagonalWindow(gammas, edges[winA], 
+                                                   edges[winA+1]);
+                for (std::size_t winB = winA+1; winB < partitions; ++winB) {
+                    block(winA, winB) = OffDiagonalWindow(n, gammas.a,
+                            GridCorners(grid, partitions, winA, winB),
+                            {{edges[winA], edges[winA+1]}},
+                            {{edges[winB], edges[winB+1]}});
+                }
+            });
+        return block;
+    }
+} // anonymous namespace
+
+std::shared_ptr<const DMatrix> MuPart_NPlus2(const std::array<char,2>& nr, 
+                                             const std::size_t partitions) {
+    if (nr[1]%2 == 1) {
+        return zeroMatrix.Get(partitions, [partitions]() -> DMatrix {
+                return DMatrix::Zero(partitions, partitions);
+            });
     }
 
-    return nPlus2Cache[nr];
+    const std::array<int,3> key{{nr[0], nr[1], static_cast<int>(partitions)}};
+    return nPlus2Cache.Get(key, [&nr, partitions]() {
+            return NPlus2Windows(nr[0], nr[1], partitions);
+        });
 }
 
 coeff_class NPlus2Window(const char n, const char r, 
         const std::array<builtin_class,2>& mu1_ab,
         const std::array<builtin_class,2>& mu2_ab) {
-    builtin_class a = 0.5 * r;
-    coeff_class overall = 8.0 / 3.0;
-
-    coeff_class hypergeos = 0;
+    const builtin_class a = 0.5 * r;
+    const std::vector<builtin_class> mu2s(mu2_ab.begin(), mu2_ab.end());
+    std::vector<builtin_class> mu2Minus(2);
+    for (std::size_t j = 0; j < 2; ++j) {
+        coeff_class mu2 = mu2_ab[j];
+        mu2Minus[j] = std::pow(mu2, (n-5.0)/4.0);
+    }
+    WindowCorners corners;
     for (std::size_t i = 0; i < 2; ++i) {
         coeff_class mu1 = mu1_ab[i];
-        for (std::size_t j = 0; j < 2; ++j) {
-            coeff_class mu2 = mu2_ab[j];
-            int sign = (i+j)%2 == 0 ? 1 : -1;
-
-            builtin_class x = mu1 / mu2;
-
-            coeff_class term = sign * std::pow(mu1, (n+1.0)/4.0) 
-                             / std::pow(mu2, (n-5.0)/4.0);
-            hypergeos += term * 
-                Hypergeometric2F1(-a, (n+1.0)/4.0, (n+5.0)/4.0, x) / (n + 1.0);
-            hypergeos -= term * 
-                Hypergeometric2F1(-a, (n-5.0)/4.0, (n-1.0)/4.0, x) / (n - 5.0);
-        }
+        const std::vector<CornerTerms> terms = NPlus2Corners(n, a, mu1, 
+                std::pow(mu1, (n+1.0)/4.0), mu2s, mu2Minus);
+        std::copy(terms.begin(), terms.end(), corners[i].begin());
     }
-
-    if (!std::isfinite(static_cast<builtin_class>(hypergeos))) {
-        std::cerr << "Error: NPlus2Window(" << (int)n << ", " << a 
-            << ", " << mu1_ab << ", " << mu2_ab << ") not finite." 
-            << std::endl;
-    }
-    return overall * hypergeos;
+    return OffDiagonalWindow(n, a, corners, mu1_ab, mu2_ab);
 }
 
 // This is different from the generic case because it needs to stop when alpha
 // is 1, i.e. when mu2 >= mu1; luckily it's still pretty simple
 coeff_class NPlus2Window_Equal(const char n, const char r, 
         const builtin_class mu_a, const builtin_class mu_b) {
-    builtin_class a = 0.5 * r;
-    
-    coeff_class gammaPart = std::pow(mu_b, 1.5) * std::tgamma((n+1.0)/4.0) 
-                          / std::tgamma((n+5.0)/4.0 + a);
-    gammaPart -= std::pow(mu_a, 1.5) * std::tgamma((n-5.0)/4.0) 
-               / std::tgamma((n-1.0)/4.0 + a);
-    gammaPart *= 2.0 * std::tgamma(a+1.0) / 3.0;
-
-    coeff_class hyperPart = 
-        Hypergeometric2F1(-a, (n-5.0)/4.0, (n-1.0)/4.0, mu_a/mu_b) / (n - 5.0);
-    hyperPart -= 
-        Hypergeometric2F1(-a, (n+1.0)/4.0, (n+5.0)/4.0, mu_a/mu_b) / (n + 1.0);
-    hyperPart *= (8.0 * std::pow(mu_a, (n+1.0)/4.0))
-               / (3.0 * std::pow(mu_b, (n-5.0)/4.0));
-
-    return gammaPart + hyperPart;
+    return DiagonalWindow(NPlus2Gammas(n, r), mu_a, mu_b);
 }
 
+// hypergeometric functions ---------------------------------------------------
+
+namespace {
+    Memo::Cache<std::array<builtin_class,4>, coeff_class,
+                boost::hash<std::array<builtin_class,4>> > 
+        hg2f1Cache("Hypergeometric2F1");
+    Memo::Cache<std::array<builtin_class,6>, coeff_class,
+                boost::hash<std::array<builtin_class,6>> > 
+        hgfrCache("Hypergeometric3F2_Reg");
+
+    // reports a function which couldn't be evaluated, and gives the value to
+    // keep for it
+    template<std::size_t N>
+    coeff_class Checked(const char* name, 
+                        const std::array<builtin_class,N>& params,
+                        const HypergeoResult& result) {
+        if (result.status == HypergeoStatus::Failed) {
+            std::cerr << "Error: " << name << "(" << params << ") did not "
+                << "converge after " << result.iterations << " terms.\n";
+            return 0.0/0.0;
+        }
+        return result.value;
+    }
+
+    // 3F2s which aren't finite are reported as well
+    coeff_class Checked3F2(const std::array<builtin_class,6>& params,
+                           const HypergeoResult& result) {
+        const coeff_class value = Checked("3F2", params, result);
+        if (result.status != HypergeoStatus::Failed
+                && !std::isfinite(static_cast<builtin_class>(value))) {
+            std::cerr << "Error: 3F2(" << params << ") = " << value << '\n';
+        }
+        return value;
+    }
+} // anonymous namespace
+
 coeff_class Hypergeometric2F1(const builtin_class a, const builtin_class b,
         const builtin_class c, const builtin_class x) {
-    static std::unordered_map< std::array<builtin_class,4>,coeff_class,
-                          boost::hash<std::array<builtin_class,4>> > hg2f1Cache;
-
     const std::array<builtin_class,4> params = {{a, b, c, x}};
-    if (hg2f1Cache.count(params) == 0) {
-        hg2f1Cache.emplace(params, HypergeometricPFQ<2,1>({{a,b}}, {{c}}, x));
-    }
+    return *hg2f1Cache.Get(params, [&params, a, b, c, x]() {
+            return Checked("2F1", params, HypergeometricPFQ_Reg_Status<2,1>(
+                        {{a,b}}, {{c}}, x)) * std::tgamma(c);
+        });
+}
 
-    return hg2f1Cache[params];
+// the ones which aren't in the cache yet are done together
+std::vector<coeff_class> Hypergeometric2F1(const builtin_class a, 
+        const builtin_class b, const builtin_class c, 
+        const std::vector<builtin_class>& xs) {
+    std::vector<coeff_class> values(xs.size());
+    std::vector<std::size_t> missing;
+    std::vector<builtin_class> missingXs;
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        if (auto value = hg2f1Cache.Find({{a, b, c, xs[i]}})) {
+            values[i] = *value;
+        } else {
+            missing.push_back(i);
+            missingXs.push_back(xs[i]);
+        }
+    }
+    if (missing.empty()) return values;
+
+    std::vector<HypergeoResult> computed(missing.size());
+    HypergeometricPFQ_Reg_Batch<2,1>({{a, b}}, {{c}}, missingXs.data(),
+                                     missing.size(), computed.data());
+    for (std::size_t j = 0; j < missing.size(); ++j) {
+        const std::array<builtin_class,4> params = {{a, b, c, missingXs[j]}};
+        values[missing[j]] = *hg2f1Cache.Get(params, [&]() {
+                return Checked("2F1", params, computed[j]) * std::tgamma(c);
+            });
+    }
+    return values;
 }
 
 coeff_class Hypergeometric3F2_Reg(const builtin_class a1, 
@@ -324,30 +614,47 @@ coeff_class Hypergeometric3F2_Reg(const std::array<builtin_class,3>& a,
 }
 
 coeff_class Hypergeometric3F2_Reg(const std::array<builtin_class,6>& params) {
-    static std::unordered_map<std::array<builtin_class,6>,coeff_class,
-                          boost::hash<std::array<builtin_class,6>> > hgfrCache;
-
-    if (hgfrCache.count(params) == 0) {
-        // coeff_class reg = std::tgamma(b[0]) * std::tgamma(b[1]);
-        // hgfrCache.emplace(params, Hypergeometric3F2(a, b, x) / reg);
-        coeff_class value;
-        try {
-            value = HypergeometricPFQ_Reg<3,2>({{params[0], params[1], 
-                                                 params[2]}},
-                                               {{params[3], params[4]}}, 
-                                               params[5]);
-            if (!std::isfinite(static_cast<builtin_class>(value))) {
-                std::cerr << "Error: 3F2(" << params << ") = " << value << '\n';
-            }
-        }
-        catch (const std::runtime_error& err) {
-            std::cerr << "Error: 3F2(" << params << ") did not converge.\n";
-            value = 0.0/0.0;
+    return *hgfrCache.Get(params, [&params]() {
+            // coeff_class reg = std::tgamma(b[0]) * std::tgamma(b[1]);
+            // return Hypergeometric3F2(a, b, x) / reg;
+            return Checked3F2(params, HypergeometricPFQ_Reg_Status<3,2>(
+                        {{params[0], params[1], params[2]}},
+                        {{params[3], params[4]}}, params[5]));
+        });
+}
+
+// the ones which aren't in the cache yet are done together
+std::vector<coeff_class> Hypergeometric3F2_Reg(
+        const std::array<builtin_class,5>& ab, 
+        const std::vector<builtin_class>& xs) {
+    const std::array<builtin_class,3> a{{ab[0], ab[1], ab[2]}};
+    const std::array<builtin_class,2> b{{ab[3], ab[4]}};
+    auto Params = [&ab](const builtin_class x) {
+        return std::array<builtin_class,6>{{ab[0], ab[1], ab[2], ab[3], ab[4],
+                                            x}};
+    };
+
+    std::vector<coeff_class> values(xs.size());
+    std::vector<std::size_t> missing;
+    std::vector<builtin_class> missingXs;
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        if (auto value = hgfrCache.Find(Params(xs[i]))) {
+            values[i] = *value;
+        } else {
+            missing.push_back(i);
+            missingXs.push_back(xs[i]);
         }
-        // std::cout << "Hypergeometric3F2_Reg(" << params << ") = " <<  value 
-            // << '\n';
-        hgfrCache.emplace(params, value);
     }
-
-    return hgfrCache[params];
+    if (missing.empty()) return values;
+
+    std::vector<HypergeoResult> computed(missing.size());
+    HypergeometricPFQ_Reg_Batch<3,2>(a, b, missingXs.data(), missing.size(),
+                                     computed.data());
+    for (std::size_t j = 0; j < missing.size(); ++j) {
+        const std::array<builtin_class,6> params = Params(missingXs[j]);
+        values[missing[j]] = *hgfrCache.Get(params, [&]() {
+                return Checked3F2(params, computed[j]);
+            });
+    }
+    return values;
 }
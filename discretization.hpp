@@ -12,6 +12,8 @@
 
 #include "constants.hpp"
 #include "hypergeo.hpp"
+#include "memo.hpp"
+#include "thread-pool.hpp"
 
 SMatrix DiscretizePolys(const DMatrix& polysOnMinBasis, 
                         std::size_t partitions);
@@ -23,9 +25,9 @@ DMatrix MuPart_Kinetic(const std::size_t partitions);
 
 // same-n interactions --------------------------------------------------------
 
-const DMatrix& MuPart_NtoN(const unsigned int n, 
-                           std::array<char,2> exponents, 
-                           const std::size_t partitions);
+std::shared_ptr<const DMatrix> MuPart_NtoN(const unsigned int n, 
+                                           std::array<char,2> exponents, 
+                                           const std::size_t partitions);
 
 coeff_class NtoNWindow_Less(const std::array<char,2>& exponents,
                        const std::array<builtin_class,2>& mu1sq_ab,
@@ -55,11 +57,15 @@ coeff_class Hypergeometric3F2_Reg(const builtin_class a1,
 coeff_class Hypergeometric3F2_Reg(const std::array<builtin_class,3>& a, 
         const std::array<builtin_class,2>& b, const builtin_class x);
 coeff_class Hypergeometric3F2_Reg(const std::array<builtin_class,6>& params);
+// the same with the parameters {a1, a2, a3, b1, b2} at each of the xs
+std::vector<coeff_class> Hypergeometric3F2_Reg(
+        const std::array<builtin_class,5>& ab, 
+        const std::vector<builtin_class>& xs);
 
 // n+2 interactions -----------------------------------------------------------
 
-const DMatrix& MuPart_NPlus2(const std::array<char,2>& nr, 
-                             const std::size_t partitions);
+std::shared_ptr<const DMatrix> MuPart_NPlus2(const std::array<char,2>& nr, 
+                                             const std::size_t partitions);
 
 coeff_class NPlus2Window(const char n, const char r,
         const std::array<builtin_class,2>& mu1_ab,
@@ -69,5 +75,8 @@ coeff_class NPlus2Window_Equal(const char n, const char r,
 
 coeff_class Hypergeometric2F1(const builtin_class a, const builtin_class b,
         const builtin_class c, const builtin_class x);
+std::vector<coeff_class> Hypergeometric2F1(const builtin_class a, 
+        const builtin_class b, const builtin_class c, 
+        const std::vector<builtin_class>& xs);
 
 #endif
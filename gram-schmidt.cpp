@@ -18,8 +18,15 @@ std::vector<Poly> Orthogonalize(const std::vector<Basis<Mono>>& inputBases,
         // std::cout << gram << std::endl;
     // }
 
+    return Orthogonalize(unifiedBasis, gram, console);
+}
+
+// the second half of the above, for when the Gram matrix of the normalized
+// basis has already been computed
+std::vector<Poly> Orthogonalize(const Basis<Mono>& unifiedBasis, 
+                const DMatrix& gram, OStream& console) {
     // orthogonalize using custom gram-schmidt
-    timer.Start();
+    Timer timer;
     std::vector<Poly> orthogonalized = GramSchmidt_WithMatrix(unifiedBasis, gram);
     // std::vector<Poly> orthogonalized = GramSchmidt_MatrixOnly(gram, unifiedBasis);
 
@@ -162,13 +169,7 @@ std::vector<Poly> GramSchmidt_MatrixOnly(const DMatrix& input,
 
     std::vector<Poly> output;
     for(const DVector& knownVector : knownVectors){
-        Poly polyForm;
-        //std::cout << "knownVector is an object with " << knownVector.rows()
-            //<< " rows and " << knownVector.cols() << " columns." << std::endl;
-        for(Eigen::Index i = 0; i < knownVector.rows(); ++i){
-            polyForm += knownVector(i)*inputBasis[i];
-        }
-        output.push_back(polyForm);
+        output.emplace_back(knownVector, inputBasis.begin());
     }
     return output;
 }
@@ -180,10 +181,7 @@ std::vector<Poly> PolysFromQMatrix(const DMatrix& QMatrix,
 		const Eigen::Index rank) {
     std::vector<Poly> output;
     for (Eigen::Index i = 0; i < rank; ++i) {
-        Poly nextPoly;
-        for (Eigen::Index j = 0; j < QMatrix.rows(); ++j) {
-            nextPoly += QMatrix(j,i)*basis[j];
-        }
+        Poly nextPoly(DVector(QMatrix.col(i)), basis.begin());
         coeff_class norm = QMatrix.col(i).transpose()*gramMatrix*QMatrix.col(i);
         norm = std::abs(std::sqrt<builtin_class>(norm));
         output.push_back(nextPoly / norm);
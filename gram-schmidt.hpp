@@ -14,10 +14,12 @@
 #include "basis.hpp"
 #include "matrix.hpp"
 
-// this should be the only function called from outside of this file ----------
+// these should be the only functions called from outside of this file -------
 
 std::vector<Poly> Orthogonalize(const std::vector<Basis<Mono>>& inputBases, 
                 OStream& console, const bool odd);
+std::vector<Poly> Orthogonalize(const Basis<Mono>& unifiedBasis, 
+                const DMatrix& gram, OStream& console);
 
 // custom gram-schmidt --------------------------------------------------------
 
@@ -5,7 +5,8 @@ namespace GUI {
 CalcWidget::CalcWidget(const Arguments& args): console(args.console), 
         outStream(args.outStream), warningStatus(WARNING_ON), 
         nBox(new QSpinBox), lBox(new QSpinBox), dBox(new QDoubleSpinBox),
-        kMaxBox(new QSpinBox), msqBox(new QDoubleSpinBox), 
+        kMaxBox(new QSpinBox), threadsBox(new QSpinBox), 
+        msqBox(new QDoubleSpinBox), 
         lambdaBox(new QDoubleSpinBox), cutoffBox(new QDoubleSpinBox),
         freeButton(new QRadioButton("&Free")),
         interactingButton(new QRadioButton("&Interacting")),
@@ -138,6 +139,17 @@ void CalcWidget::SetupParameterBoxes(QLayout* layout, const Arguments& args) {
     paramBoxGrid->addWidget(kMaxLabel);
     paramBoxGrid->addWidget(kMaxBox);
 
+    QLabel* threadsLabel = new QLabel(tr("threads"));
+    threadsLabel->setAlignment(Qt::AlignVCenter | Qt::AlignRight);
+    threadsLabel->setBuddy(threadsBox);
+    threadsBox->setRange(0, 256);
+    threadsBox->setSpecialValueText(tr("auto"));
+    threadsBox->setValue(args.threads);
+    threadsBox->setStatusTip(tr("Number of threads for the matrix computations"));
+
+    paramBoxGrid->addWidget(threadsLabel);
+    paramBoxGrid->addWidget(threadsBox);
+
     paramBoxes->setLayout(paramBoxGrid);
     layout->addWidget(paramBoxes);
 }
@@ -186,6 +198,7 @@ void CalcWidget::Calculate() {
     args.degree = lBox->value();
     args.delta = dBox->isEnabled() ? dBox->value() : 0.0;
     args.partitions = kMaxBox->value();
+    args.threads = threadsBox->value();
     args.msq = msqBox->value();
     args.lambda = lambdaBox->value();
     args.cutoff = cutoffBox->value();
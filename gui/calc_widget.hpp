@@ -55,6 +55,7 @@ class CalcWidget : public QWidget {
         QSpinBox* lBox;
         QDoubleSpinBox* dBox;
         QSpinBox* kMaxBox;
+        QSpinBox* threadsBox;
         QDoubleSpinBox* msqBox;
         QDoubleSpinBox* lambdaBox;
         QDoubleSpinBox* cutoffBox;
@@ -1,8 +1,20 @@
 #ifndef HYPERGEO_HPP
 #define HYPERGEO_HPP
 
+// The generalized hypergeometric functions pFq, regularized (i.e. divided by
+// the gammas of the b's) unless otherwise stated. Every evaluation gives a
+// HypergeoResult saying how it was done, instead of throwing when it can't be:
+// * the ones with closed forms or a cancelling a and b are Special;
+// * 2F1 near x=1 or below x=-1 is Transformed to a series in 1-x or x/(x-1);
+// * at x=1, 3F2 is summed directly and then tried with Thomae's relations;
+// * anything else is the power series, which goes through a Levin u
+//   transformation if it hasn't converged after ACCELERATION_START terms.
+// Counts of each of these and of the terms summed are kept for -d.
+
 #include <cmath>
 #include <array>
+#include <atomic>
+#include <algorithm> // find, min_element, max_element
 #include <iostream>
 
 #include <gsl/gsl_sf_hyperg.h>
@@ -15,126 +27,372 @@
 constexpr int ITERATION_LIMIT = 3e6;
 constexpr coeff_class PRECISION_LIMIT = 1e-10;
 
+// A series which hasn't converged after ACCELERATION_START terms is
+// accelerated with the Levin u transformation of order LEVIN_ORDER, applied to
+// its partial sums at every LEVIN_STRIDE terms, and taken as soon as three
+// estimates in a row agree to PRECISION_LIMIT. The weights of the 
+// transformation cancel like n^LEVIN_ORDER at the nth sum, so using every
+// term would lose all of the digits near x=1, where it's needed most. For the
+// same reason, a series at x=1 which hasn't been accelerated after
+// LEVIN_BLOCK_LIMIT blocks Failed, since the estimates after that are noise.
+// Just below x=1, the terms go like k^(-1-excess) until k ~ 1/(1-x) and only
+// then like x^k, and the estimates are only trusted once k(1-x) is at least
+// LEVIN_DECAY; before that they settle on the wrong value
+constexpr int ACCELERATION_START = 1000;
+constexpr int LEVIN_ORDER = 8;
+constexpr int LEVIN_STRIDE = 64;
+constexpr int LEVIN_BLOCK_LIMIT = 64;
+constexpr builtin_class LEVIN_DECAY = 16;
+
+// 2F1 with x above this goes to the series in 1-x, and below -1 goes to the
+// series in x/(x-1); the first needs c-a-b at least TRANSFORM_MARGIN away from
+// an integer, or the gammas in it nearly cancel
+constexpr builtin_class TRANSFORM_X = 0.9;
+constexpr builtin_class TRANSFORM_MARGIN = 1e-2;
+
+enum class HypergeoStatus { Series, Accelerated, Transformed, Special, Failed };
+constexpr std::size_t HYPERGEO_STATUSES = 5;
+
+struct HypergeoResult {
+    coeff_class value;
+    HypergeoStatus status;
+    // the number of terms summed, over every series used
+    int iterations;
+};
+
+inline HypergeoResult HypergeoFailure(const int iterations) {
+    return {std::nan(""), HypergeoStatus::Failed, iterations};
+}
+
+// counts of the evaluations requested from outside this file, by status
+struct HypergeoStats {
+    std::array<std::atomic<std::size_t>,HYPERGEO_STATUSES> evaluations;
+    std::atomic<std::size_t> iterations;
+    std::atomic<int> mostIterations;
+};
+
+inline HypergeoStats& GetHypergeoStats() {
+    static HypergeoStats stats{};
+    return stats;
+}
+
+inline void RecordHypergeo(const HypergeoResult& result) {
+    HypergeoStats& stats = GetHypergeoStats();
+    ++stats.evaluations[static_cast<std::size_t>(result.status)];
+    stats.iterations += result.iterations;
+    int most = stats.mostIterations;
+    while (result.iterations > most
+            && !stats.mostIterations.compare_exchange_weak(most, 
+                                                           result.iterations)) {
+    }
+}
+
+inline void PrintHypergeoStats(OStream& os) {
+    const HypergeoStats& stats = GetHypergeoStats();
+    os << "Hypergeometric functions (series / accelerated / transformed / "
+        << "special / failed):" << endl << "    ";
+    for (std::size_t i = 0; i < HYPERGEO_STATUSES; ++i) {
+        os << (i == 0 ? "" : " / ") << stats.evaluations[i].load();
+    }
+    os << endl << "    terms summed: " << stats.iterations.load() 
+        << " (at most " << stats.mostIterations.load() << " in one)" << endl;
+}
+
 inline bool IsNegInt(const builtin_class x) {
     return std::round(x) < 0 && std::abs(std::round(x) - x) < EPSILON;
 }
 
-// this is an adaptation of the series representation of GSL's Hypergeometric2F1
-template<std::size_t P, std::size_t Q>
-coeff_class HypergeometricPFQ_Body(const std::array<builtin_class,P>& a, 
-        const std::array<builtin_class,Q>& b, const builtin_class x) {
-
-    coeff_class del = 1.0;
-    coeff_class del_prev;
-    builtin_class k = 0.0; // k is the index of the most recent COMPLETED term
-    int i = 0;
+// whether the series stops by itself, i.e. whether one of the a's is 0 or a
+// negative integer
+template<std::size_t P>
+bool Terminates(const std::array<builtin_class,P>& a) {
+    for (auto a_i : a) {
+        if (std::abs(a_i) < EPSILON || IsNegInt(a_i)) return true;
+    }
+    return false;
+}
 
-    std::set<coeff_class> zeros;
-    for (std::size_t i = 0; i < P; ++i) {
-        if (IsNegInt(a[i])) {
-            zeros.insert(std::round(-a[i]));
-        }
+// the number of arguments whose series are summed together by
+// HypergeometricPFQ_Lanes
+constexpr std::size_t HYPERGEO_LANES = 8;
+
+// the values -x for the x in params which are negative integers, i.e. the
+// points where the terms of the series go to 0 (for the a's) or blow up (for
+// the b's); returns how many there are
+template<std::size_t N>
+std::size_t NegIntPoints(const std::array<builtin_class,N>& params,
+                         std::array<builtin_class,N>& points) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+        if (IsNegInt(params[i])) points[count++] = std::round(-params[i]);
     }
-    std::set<coeff_class> divergences;
-    for (std::size_t i = 0; i < Q; ++i) {
-        if (IsNegInt(b[i])) {
-            divergences.insert(std::round(-b[i]));
-        }
+    return count;
+}
+
+template<std::size_t N>
+bool ContainsPoint(const std::array<builtin_class,N>& points,
+                   const std::size_t count, const builtin_class x) {
+    return std::find(points.begin(), points.begin() + count, x) 
+        != points.begin() + count;
+}
+
+// The Levin u transformation of the order+1 partial sums whose terms are in
+// terms, the last of which is the sum up to term number n (counting from 0).
+// The terms can be blocks of the terms of the original series, with n
+// counting the blocks. Returns nan if one of the terms is 0
+inline coeff_class LevinU(const coeff_class* sums, const coeff_class* terms,
+                          const int order, const builtin_class n) {
+    coeff_class numerator = 0;
+    coeff_class denominator = 0;
+    coeff_class binomial = 1;
+    for (int j = 0; j <= order; ++j) {
+        const builtin_class m = n - order + j;
+        if (terms[j] == 0) return std::nan("");
+        const coeff_class ratio = coeff_class(m + 1) / (n + 1);
+        coeff_class weight = binomial / ((m + 1) * terms[j]);
+        for (int p = 1; p < order; ++p) weight *= ratio;
+        if (j % 2 == 1) weight = -weight;
+        numerator += weight * sums[j];
+        denominator += weight;
+        binomial = binomial * (order - j) / (j + 1);
     }
+    return numerator / denominator;
+}
 
-    if (divergences.size() > 0) {
+// Whether the rest of a series whose last term was del, term number n, is 
+// negligible next to sum. The test above only looks at the last two terms, 
+// and near x=1 a series with P == Q+1 has a tail of about 
+// del*n/(n(1-x) + excess), which can be far bigger than that, so once the
+// series has been slow this has to be small as well (or else LevinU has to 
+// agree with itself). Alternating series are fine as they are
+template<std::size_t P, std::size_t Q>
+bool HypergeoTailSmall(const coeff_class del, const coeff_class sum,
+                       const builtin_class x, const builtin_class n,
+                       const builtin_class excess) {
+    if (P != Q + 1 || x <= 0) return true;
+    const builtin_class decay = n*(1 - x) + excess;
+    if (decay <= 0) return false;
+    return !(std::abs<builtin_class>(del*n / (decay*sum)) >= PRECISION_LIMIT);
+}
+
+// whether a LevinU estimate after n terms of a series at x can be taken (see
+// LEVIN_DECAY)
+template<std::size_t P, std::size_t Q>
+bool LevinSettled(const builtin_class x, const int n) {
+    if (P != Q + 1 || x <= 0 || x >= 1) return true;
+    return n*(1 - x) >= LEVIN_DECAY;
+}
+
+// This is an adaptation of the series representation of GSL's
+// Hypergeometric2F1, summed at up to HYPERGEO_LANES arguments x[l] at once. The
+// ratio of the Pochhammer symbols between neighbouring terms is the same for
+// every argument, so it's worked out once per term for all of them, and each
+// argument stops as soon as its own series has converged, either directly or
+// through LevinU. Nothing here allocates. Any argument which hasn't converged
+// after ITERATION_LIMIT terms Failed
+template<std::size_t P, std::size_t Q>
+void HypergeometricPFQ_Lanes(const std::array<builtin_class,P>& a, 
+        const std::array<builtin_class,Q>& b, const builtin_class* x,
+        const std::size_t lanes, HypergeoResult* out) {
+    std::array<builtin_class,P> zeros;
+    const std::size_t numZeros = NegIntPoints(a, zeros);
+    std::array<builtin_class,Q> divergences;
+    const std::size_t numDivergences = NegIntPoints(b, divergences);
+    // when P == Q+1, the terms fall off like x^k k^(-1-excess)
+    builtin_class excess = 0;
+    for (builtin_class b_i : b) excess += b_i;
+    for (builtin_class a_i : a) excess -= a_i;
+
+    std::array<coeff_class,HYPERGEO_LANES> del;
+    builtin_class k = 0.0; // k is the index of the most recent COMPLETED term
+    if (numDivergences > 0) {
+        const builtin_class lastDivergence = *std::max_element(
+                divergences.begin(), divergences.begin() + numDivergences);
         // if there is a zero before the final divergence, all terms will be 0
-        if (zeros.size() > 0 && *zeros.begin() <= *divergences.rbegin()) {
-            return 0;
-        } else {
-            // first nonzero term of regularized series
-            k = *divergences.rbegin() + 1;
-            del = std::pow(x, k) / std::tgamma(k+1);
+        if (numZeros > 0 && *std::min_element(zeros.begin(), 
+                    zeros.begin() + numZeros) <= lastDivergence) {
+            std::fill(out, out + lanes, 
+                      HypergeoResult{0, HypergeoStatus::Series, 0});
+            return;
+        }
+        // first nonzero term of regularized series
+        k = lastDivergence + 1;
+        for (std::size_t l = 0; l < lanes; ++l) {
+            del[l] = std::pow(x[l], k) / std::tgamma(k+1);
             for (builtin_class a_i : a) {
-                if (zeros.count(a_i) == 0) {
-                    del *= std::tgamma(a_i + k) / std::tgamma(a_i);
-                } else {
-                    coeff_class prod = 1;
-                    for (builtin_class n = 1; n <= std::round(a_i + k); ++n) {
-                        prod *= a_i;
-                    }
+                if (!ContainsPoint(zeros, numZeros, a_i)) {
+                    del[l] *= std::tgamma(a_i + k) / std::tgamma(a_i);
                 }
             }
             for (builtin_class b_i : b) {
-                if (divergences.count(b_i) == 0) del /= std::tgamma(b_i + k);
+                if (!ContainsPoint(divergences, numDivergences, b_i)) {
+                    del[l] /= std::tgamma(b_i + k);
+                }
             }
         }
     } else {
-        for (builtin_class b_i : b) del /= std::tgamma(b_i);
+        coeff_class first = 1.0;
+        for (builtin_class b_i : b) first /= std::tgamma(b_i);
+        std::fill(del.begin(), del.begin() + lanes, first);
     }
 
-    coeff_class sum_pos = 0.0;
-    coeff_class sum_neg = 0.0;
-    coeff_class del_pos = 0.0;
-    coeff_class del_neg = 0.0;
-
-    if (del >= 0.0) {
-        sum_pos = del;
-        del_pos = del;
-    } else {
-        sum_neg = del;
-        del_neg = del;
+    std::array<coeff_class,HYPERGEO_LANES> del_prev;
+    std::array<coeff_class,HYPERGEO_LANES> sum_pos;
+    std::array<coeff_class,HYPERGEO_LANES> sum_neg;
+    std::array<coeff_class,HYPERGEO_LANES> del_pos;
+    std::array<coeff_class,HYPERGEO_LANES> del_neg;
+    std::array<bool,HYPERGEO_LANES> active;
+    // the last LEVIN_ORDER+1 partial sums at multiples of LEVIN_STRIDE terms
+    // and their differences, in a ring, for each lane, the most recent
+    // estimate made from them and how many estimates in a row have agreed
+    std::array<std::array<coeff_class,LEVIN_ORDER+1>,HYPERGEO_LANES> blockSums;
+    std::array<std::array<coeff_class,LEVIN_ORDER+1>,HYPERGEO_LANES> 
+        blockTerms;
+    std::array<coeff_class,HYPERGEO_LANES> estimate;
+    std::array<int,HYPERGEO_LANES> agreements;
+    for (std::size_t l = 0; l < lanes; ++l) {
+        sum_pos[l] = sum_neg[l] = del_pos[l] = del_neg[l] = 0.0;
+        if (del[l] >= 0.0) {
+            sum_pos[l] = del[l];
+            del_pos[l] = del[l];
+        } else {
+            // sum_neg holds the magnitude of the negative terms, and the first
+            // term of a regularized series is negative whenever gamma(b_i) is
+            sum_neg[l] = -del[l];
+            del_neg[l] = -del[l];
+        }
+        blockSums[l][0] = blockTerms[l][0] = del[l];
+        active[l] = true;
+        estimate[l] = std::nan("");
+        agreements[l] = 0;
+        out[l] = HypergeoFailure(ITERATION_LIMIT);
     }
 
-    do {
-        if(++i > ITERATION_LIMIT) {
-            // return sum_pos - sum_neg;
-            throw (std::runtime_error("HypergeometricPFQ_Reg did not converge."));
-        }
-        del_prev = del;
-        for (coeff_class a_i : a) del *= (a_i + k);
-        for (coeff_class b_i : b) del /= (b_i + k);
-        del *= x / (k + 1.0);
-
-        if(del > 0.0) {
-            del_pos  =  del;
-            sum_pos +=  del;
-        }
-        else if(del == 0.0) {
-            /* Exact termination (some a[i] was a negative integer).
-            */
-            del_pos = 0.0;
-            del_neg = 0.0;
-            break;
-        }
-        else {
-            del_neg  = -del;
-            sum_neg -=  del;
-        }
+    std::size_t remaining = lanes;
+    int i = 0;
+    while (remaining > 0) {
+        if(++i > ITERATION_LIMIT) break;
+        coeff_class ratio = 1.0;
+        for (coeff_class a_i : a) ratio *= (a_i + k);
+        for (coeff_class b_i : b) ratio /= (b_i + k);
+        // the partial sums at multiples of LEVIN_STRIDE are numbered by block,
+        // and only worked with once the series is nearly due for acceleration
+        const int block = i / LEVIN_STRIDE;
+        const std::size_t slot = block % (LEVIN_ORDER + 1);
+        const bool blockEnd = i % LEVIN_STRIDE == 0;
+        const bool accelerate = blockEnd && block >= LEVIN_ORDER 
+            && i >= ACCELERATION_START - 2*LEVIN_STRIDE;
+
+        for (std::size_t l = 0; l < lanes; ++l) {
+            if (!active[l]) continue;
+            del_prev[l] = del[l];
+            del[l] *= ratio;
+            del[l] *= x[l] / (k + 1.0);
+
+            if(del[l] > 0.0) {
+                del_pos[l]  =  del[l];
+                sum_pos[l] +=  del[l];
+            }
+            else if(del[l] == 0.0) {
+                /* Exact termination (some a[i] was a negative integer).
+                */
+                del_pos[l] = 0.0;
+                del_neg[l] = 0.0;
+                active[l] = false;
+            }
+            else {
+                del_neg[l]  = -del[l];
+                sum_neg[l] -=  del[l];
+            }
+
+            /*
+             * This stopping criteria is taken from the thesis
+             * "Computation of Hypergeometic Functions" by J. Pearson, pg. 31
+             * (http://people.maths.ox.ac.uk/porterm/research/pearson_final.pdf)
+             * and fixes bug #45926
+             */
+            const coeff_class sum = sum_pos[l] - sum_neg[l];
+            if (active[l] && ((std::abs<builtin_class>(del_prev[l] / sum) 
+                            < PRECISION_LIMIT 
+                        && std::abs<builtin_class>(del[l] / sum) 
+                            < PRECISION_LIMIT)
+                    || !(std::abs<builtin_class>((del_pos[l] + del_neg[l])/sum)
+                        > PRECISION_LIMIT))
+                    && HypergeoTailSmall<P,Q>(del[l], sum, x[l], k + 1.0, 
+                                              excess)) {
+                active[l] = false;
+            }
+            if (!active[l]) {
+                out[l] = {sum, HypergeoStatus::Series, i};
+                --remaining;
+                continue;
+            }
 
-        /*
-         * This stopping criteria is taken from the thesis
-         * "Computation of Hypergeometic Functions" by J. Pearson, pg. 31
-         * (http://people.maths.ox.ac.uk/porterm/research/pearson_final.pdf)
-         * and fixes bug #45926
-         */
-        if (std::abs<builtin_class>(del_prev / (sum_pos - sum_neg)) 
-                    < PRECISION_LIMIT 
-                && std::abs<builtin_class>(del / (sum_pos - sum_neg)) 
+            if (!blockEnd) continue;
+            const std::size_t previousSlot = (slot + LEVIN_ORDER) 
+                                             % (LEVIN_ORDER + 1);
+            blockTerms[l][slot] = sum - blockSums[l][previousSlot];
+            blockSums[l][slot] = sum;
+            if (!accelerate) continue;
+            std::array<coeff_class,LEVIN_ORDER+1> lastSums;
+            std::array<coeff_class,LEVIN_ORDER+1> lastTerms;
+            for (int j = 0; j <= LEVIN_ORDER; ++j) {
+                const std::size_t from = (slot + 1 + j) % (LEVIN_ORDER + 1);
+                lastSums[j] = blockSums[l][from];
+                lastTerms[j] = blockTerms[l][from];
+            }
+            const coeff_class previous = estimate[l];
+            estimate[l] = LevinU(lastSums.data(), lastTerms.data(), 
+                                 LEVIN_ORDER, block);
+            if (std::abs<builtin_class>((estimate[l] - previous) / estimate[l])
                     < PRECISION_LIMIT) {
-            break;
+                ++agreements[l];
+            } else {
+                agreements[l] = 0;
+            }
+            if (i >= ACCELERATION_START && agreements[l] >= 2
+                    && LevinSettled<P,Q>(x[l], i)) {
+                out[l] = {estimate[l], HypergeoStatus::Accelerated, i};
+                active[l] = false;
+                --remaining;
+            } else if (x[l] >= 1 && block >= LEVIN_BLOCK_LIMIT) {
+                out[l] = HypergeoFailure(i);
+                active[l] = false;
+                --remaining;
+            }
         }
 
         k += 1.0;
-    } while(std::abs<builtin_class>((del_pos + del_neg)/(sum_pos-sum_neg)) 
-            > PRECISION_LIMIT);
+    }
+}
+
+template<std::size_t P, std::size_t Q>
+HypergeoResult HypergeometricPFQ_Series(const std::array<builtin_class,P>& a, 
+        const std::array<builtin_class,Q>& b, const builtin_class x) {
+    HypergeoResult output;
+    HypergeometricPFQ_Lanes<P,Q>(a, b, &x, 1, &output);
+    return output;
+}
 
-    return sum_pos - sum_neg;
+// 1/gamma(x), which is 0 at the poles of gamma
+inline coeff_class ReciprocalGamma(const builtin_class x) {
+    if (std::abs(x) < EPSILON || IsNegInt(x)) return 0;
+    return 1 / std::tgamma(x);
 }
 
 template<std::size_t P, std::size_t Q>
-coeff_class HypergeoUnitArgument_Reg(const std::array<builtin_class,P>&, 
+HypergeoResult HypergeometricPFQ_Evaluate(const std::array<builtin_class,P>& a,
+        const std::array<builtin_class,Q>& b, const builtin_class x);
+
+template<std::size_t P, std::size_t Q>
+HypergeoResult HypergeoUnitArgument_Reg(const std::array<builtin_class,P>&, 
         const std::array<builtin_class,Q>&) {
-    throw std::logic_error("HypergeoUnitArgument_Reg: unspecialized (P,Q).");
+    return HypergeoFailure(0);
 }
 
 template<>
-inline coeff_class HypergeoUnitArgument_Reg(const std::array<builtin_class,2>& a, 
+inline HypergeoResult HypergeoUnitArgument_Reg(
+        const std::array<builtin_class,2>& a, 
         const std::array<builtin_class,1>& b) {
     // builtin_class num = std::tgamma(b[0] - a[0] - a[1]);
     // builtin_class den = std::tgamma(b[0] - a[0]) * std::tgamma(b[0] - a[1]);
@@ -142,59 +400,121 @@ inline coeff_class HypergeoUnitArgument_Reg(const std::array<builtin_class,2>& a
 
     builtin_class num = std::lgamma(b[0] - a[0] - a[1]);
     builtin_class den = std::lgamma(b[0] - a[0]) + std::lgamma(b[0] - a[1]);
-    return std::exp(num - den);
+    return {std::exp(num - den), HypergeoStatus::Special, 0};
+}
+
+// Thomae's relation (DLMF 16.4.11) in regularized form, with s = d+e-a-b-c,
+//     3F2(a,b,c; d,e; 1) = gamma(s)/gamma(a) 3F2(d-a,e-a,s; s+b,s+c; 1),
+// where the series on the right converges like k^(-1-a) instead of k^(-1-s).
+// Each of the three a's can go first; the ones which make the series on the
+// right terminate are tried before the others, which go from the largest down
+inline HypergeoResult HypergeoThomae_Reg(const std::array<builtin_class,3>& a, 
+        const std::array<builtin_class,2>& b) {
+    const builtin_class s = b[0] + b[1] - a[0] - a[1] - a[2];
+    auto Terminating = [&a, &b](const std::size_t i) {
+        return Terminates(std::array<builtin_class,2>{{b[0]-a[i], b[1]-a[i]}});
+    };
+    std::array<std::size_t,3> order{{0, 1, 2}};
+    std::stable_sort(order.begin(), order.end(), 
+            [&a, &Terminating](const std::size_t i, const std::size_t j) {
+                if (Terminating(i) != Terminating(j)) return Terminating(i);
+                return a[i] > a[j];
+            });
+
+    int iterations = 0;
+    for (std::size_t i : order) {
+        if (!Terminating(i) && a[i] < EPSILON) continue;
+        const std::size_t j = (i + 1) % 3;
+        const std::size_t k = (i + 2) % 3;
+        const HypergeoResult series = HypergeometricPFQ_Series<3,2>(
+                {{b[0] - a[i], b[1] - a[i], s}}, {{s + a[j], s + a[k]}}, 1);
+        iterations += series.iterations;
+        if (series.status != HypergeoStatus::Failed) {
+            return {std::tgamma(s) * ReciprocalGamma(a[i]) * series.value,
+                    HypergeoStatus::Transformed, iterations};
+        }
+    }
+    return HypergeoFailure(iterations);
 }
 
+// the series at x=1 only converges when s = d+e-a-b-c > 0 (or it terminates);
+// if summing it fails anyway, Thomae's relation is tried
 template<>
-inline coeff_class HypergeoUnitArgument_Reg(
-        const std::array<builtin_class,3>& aRef, 
-        const std::array<builtin_class,2>& bRef) {
-
-    // try the series, see if it converges; if not, try a transformation
-    coeff_class output = std::nan("");
-    try {
-        output = HypergeometricPFQ_Body<3,2>(aRef, bRef, 1);
+inline HypergeoResult HypergeoUnitArgument_Reg(
+        const std::array<builtin_class,3>& a, 
+        const std::array<builtin_class,2>& b) {
+    if (!Terminates(a) && b[0] + b[1] - a[0] - a[1] - a[2] < EPSILON) {
+        return HypergeoFailure(0);
     }
-    catch (const std::runtime_error& err) {
-        // try Thomae's transformation
-        for (std::size_t i = 0; i < 3; ++i) {
-            for (std::size_t j = 0; j < 2; ++j) {
-                if (IsNegInt(bRef[j] - aRef[i])) {
-                    // std::cout << "THOMAE SUCCESSFUL" << std::endl;
-                    auto a = aRef;
-                    auto b = bRef;
-                    if (i != 0) std::swap(a[i], a[0]);
-                    if (j != 0) std::swap(b[j], b[0]);
-                    std::array<builtin_class,3> a2;
-                    a2[0] = b[0] - a[0];
-                    a2[1] = b[0] - a[1];
-                    a2[2] = b[0] + b[1] - a[0] - a[1] - a[2];
-                    std::array<builtin_class,2> b2;
-                    b2[0] = b[0] + b[1] - a[0] - a[2];
-                    b2[0] = b[0] + b[1] - a[0] - a[1];
-                    try {
-                        output = std::tgamma(a2[2])
-                                 * HypergeometricPFQ_Body<3,2>(a2, b2, 1);
-                    }
-                    catch (const std::runtime_error& err) {
-                        output = std::nan("");
-                    }
-                }
-            }
+    const HypergeoResult series = HypergeometricPFQ_Series<3,2>(a, b, 1);
+    if (series.status != HypergeoStatus::Failed) return series;
+
+    HypergeoResult thomae = HypergeoThomae_Reg(a, b);
+    thomae.iterations += series.iterations;
+    return thomae;
+}
+
+// the transformations of x to somewhere the series converges faster (or at
+// all); returns false if there isn't one for this x
+template<std::size_t P, std::size_t Q>
+bool HypergeoTransformed_Reg(const std::array<builtin_class,P>&, 
+        const std::array<builtin_class,Q>&, const builtin_class, 
+        HypergeoResult&) {
+    return false;
+}
+
+// for x < -1 this is Pfaff's transformation (DLMF 15.8.1),
+//     2F1(a,b; c; x) = (1-x)^(-a) 2F1(a,c-b; c; x/(x-1)),
+// and for TRANSFORM_X < x < 1 it's the connection to 1-x (DLMF 15.8.4),
+//     2F1(a,b; c; x) = pi/sin(pi s) [2F1(a,b; 1-s; 1-x)/(G(c-a) G(c-b))
+//                        - (1-x)^s 2F1(c-a,c-b; 1+s; 1-x)/(G(a) G(b))],
+// with s = c-a-b and every 2F1 regularized. Polynomials are always summed
+template<>
+inline bool HypergeoTransformed_Reg(const std::array<builtin_class,2>& a,
+        const std::array<builtin_class,1>& b, const builtin_class x, 
+        HypergeoResult& result) {
+    if (Terminates(a)) return false;
+
+    if (x < -1) {
+        const HypergeoResult pfaff = HypergeometricPFQ_Evaluate<2,1>(
+                {{a[0], b[0] - a[1]}}, b, x/(x - 1));
+        if (pfaff.status == HypergeoStatus::Failed) {
+            result = pfaff;
+        } else {
+            result = {std::pow(1 - x, -a[0]) * pfaff.value, 
+                      HypergeoStatus::Transformed, pfaff.iterations};
         }
+        return true;
     }
 
-    if (std::isfinite(static_cast<builtin_class>(output))) {
-        return output;
-    } else {
-        throw std::runtime_error("HypergeoUnitArgument_Reg<3,2> did not "
-                                 "converge.");
+    const builtin_class s = b[0] - a[0] - a[1];
+    if (x <= TRANSFORM_X || x >= 1 
+            || std::abs(s - std::round(s)) < TRANSFORM_MARGIN) {
+        return false;
+    }
+    const HypergeoResult first = HypergeometricPFQ_Series<2,1>(a, {{1 - s}}, 
+                                                               1 - x);
+    const HypergeoResult second = HypergeometricPFQ_Series<2,1>(
+            {{b[0] - a[0], b[0] - a[1]}}, {{1 + s}}, 1 - x);
+    const int iterations = first.iterations + second.iterations;
+    if (first.status == HypergeoStatus::Failed 
+            || second.status == HypergeoStatus::Failed) {
+        result = HypergeoFailure(iterations);
+        return true;
     }
+    const coeff_class value = M_PI / std::sin(M_PI * s) * (first.value 
+            * ReciprocalGamma(b[0] - a[0]) * ReciprocalGamma(b[0] - a[1])
+            - std::pow(1 - x, s) * second.value
+            * ReciprocalGamma(a[0]) * ReciprocalGamma(a[1]));
+    result = {value, HypergeoStatus::Transformed, iterations};
+    return true;
 }
 
+// returns false (leaving result alone) if this case isn't special
 template<std::size_t P, std::size_t Q>
-coeff_class HypergeoSpecialCase_Reg(const std::array<builtin_class,P>& a,
-        const std::array<builtin_class,Q>& b, const builtin_class x) {
+bool HypergeoSpecialCase_Reg(const std::array<builtin_class,P>& a,
+        const std::array<builtin_class,Q>& b, const builtin_class x,
+        HypergeoResult& result) {
     for (std::size_t i = 0; i < P; ++i) {
         if (a[i] == 0) {
             // std::cout << P << 'F' << Q << '(' << a << "; " << b << "; " << x
@@ -208,17 +528,13 @@ coeff_class HypergeoSpecialCase_Reg(const std::array<builtin_class,P>& a,
                     gammaProd *= std::tgamma(b_i);
                 }
             }
-            if (gammaProd == 0) {
-                return 0;
-            } else {
-                return 1/gammaProd;
-            }
+            result = {gammaProd == 0 ? 0 : 1/gammaProd, 
+                      HypergeoStatus::Special, 0};
+            return true;
         }
 
         // if any of the a are negative integers, don't bother with special case
-        if (IsNegInt(a[i])) {
-            return std::nan("");
-        }
+        if (IsNegInt(a[i])) return false;
 
         // check the b to see if any match this a (and cancel them if so)
         for (std::size_t j = 0; j < Q; ++j) {
@@ -246,48 +562,97 @@ coeff_class HypergeoSpecialCase_Reg(const std::array<builtin_class,P>& a,
                     }
                 }
 
-                coeff_class value = HypergeoSpecialCase_Reg<lowerP, 
-                                                            lowerQ>(a2, b2, x);
-                if (std::isnan(static_cast<builtin_class>(value))) {
-                    // the reduced one isn't a special case, so do series
-                    value = HypergeometricPFQ_Body<lowerP, lowerQ>(a2, b2, x);
+                result = HypergeometricPFQ_Evaluate<lowerP, lowerQ>(a2, b2, x);
+                if (result.status != HypergeoStatus::Failed) {
+                    result.value /= std::tgamma(b[j]);
+                    result.status = HypergeoStatus::Special;
                 }
-
-                return value / std::tgamma(b[j]);
+                return true;
             }
         }
     }
 
-    if (std::abs(x - 1) < EPSILON) return HypergeoUnitArgument_Reg<P,Q>(a, b);
+    if (std::abs(x - 1) < EPSILON) {
+        result = HypergeoUnitArgument_Reg<P,Q>(a, b);
+        return true;
+    }
 
-    // returning this nan causes the body to run (i.e. this case isn't special)
-    return std::nan("");
+    return false;
 }
 
+// everything which doesn't sum the series in x itself; returns false if that's
+// what should be done
 template<std::size_t P, std::size_t Q>
-coeff_class HypergeometricPFQ_Reg(const std::array<builtin_class,P>& a, 
+bool HypergeoDirect_Reg(const std::array<builtin_class,P>& a,
+        const std::array<builtin_class,Q>& b, const builtin_class x,
+        HypergeoResult& result) {
+    if (HypergeoSpecialCase_Reg<P,Q>(a, b, x, result)) return true;
+    if (HypergeoTransformed_Reg<P,Q>(a, b, x, result)) return true;
+    // outside of the radius of convergence, with nothing to continue it
+    if (!Terminates(a) && ((P > Q + 1 && x != 0) 
+                           || (P == Q + 1 && std::abs(x) > 1))) {
+        result = HypergeoFailure(0);
+        return true;
+    }
+    return false;
+}
+
+// this is what the functions below use, without being counted in the stats
+template<std::size_t P, std::size_t Q>
+HypergeoResult HypergeometricPFQ_Evaluate(const std::array<builtin_class,P>& a,
         const std::array<builtin_class,Q>& b, const builtin_class x) {
-    coeff_class specialCase = HypergeoSpecialCase_Reg<P,Q>(a, b, x);
-    if (!std::isnan(static_cast<builtin_class>(specialCase))) return specialCase;
+    HypergeoResult result;
+    if (HypergeoDirect_Reg<P,Q>(a, b, x, result)) return result;
+    return HypergeometricPFQ_Series<P,Q>(a, b, x);
+}
 
-    return HypergeometricPFQ_Body<P,Q>(a, b, x);
+// disabling GSL for 2F1 because it actually manages to get the wrong answer
+// for (1, 2, -3, 0.4)! Specifically anything with a negative c will do this.
+template<std::size_t P, std::size_t Q>
+HypergeoResult HypergeometricPFQ_Reg_Status(
+        const std::array<builtin_class,P>& a, 
+        const std::array<builtin_class,Q>& b, const builtin_class x) {
+    const HypergeoResult result = HypergeometricPFQ_Evaluate<P,Q>(a, b, x);
+    RecordHypergeo(result);
+    return result;
 }
 
-template<>
-inline coeff_class HypergeometricPFQ_Reg<2,1>(const std::array<builtin_class,2>& a,
-        const std::array<builtin_class,1>& b, const builtin_class x) {
-    // disabling GSL because it actually manages to get the wrong answer for
-    // (1, 2, -3, 0.4)! Specifically anything with a negative c will do this.
-
-    // builtin_class gslResult = gsl_sf_hyperg_2F1_renorm(a[0], a[1], b[0], x);
-    // if (std::isfinite(gslResult)) {
-        // return gslResult;
-    // } else {
-        coeff_class specialCase = HypergeoSpecialCase_Reg<2,1>(a, b, x);
-        if (!std::isnan(static_cast<builtin_class>(specialCase))) return specialCase;
-
-        return HypergeometricPFQ_Body<2,1>(a, b, x);
-    // }
+// nan if it Failed
+template<std::size_t P, std::size_t Q>
+coeff_class HypergeometricPFQ_Reg(const std::array<builtin_class,P>& a, 
+        const std::array<builtin_class,Q>& b, const builtin_class x) {
+    return HypergeometricPFQ_Reg_Status<P,Q>(a, b, x).value;
+}
+
+// HypergeometricPFQ_Reg_Status at each of the count arguments x[l]. The
+// arguments whose series in x are summed go HYPERGEO_LANES at a time
+template<std::size_t P, std::size_t Q>
+void HypergeometricPFQ_Reg_Batch(const std::array<builtin_class,P>& a, 
+        const std::array<builtin_class,Q>& b, const builtin_class* x,
+        const std::size_t count, HypergeoResult* out) {
+    std::array<builtin_class,HYPERGEO_LANES> laneX;
+    std::array<std::size_t,HYPERGEO_LANES> laneIndex;
+    std::array<HypergeoResult,HYPERGEO_LANES> laneOut;
+    std::size_t lanes = 0;
+    auto SumLanes = [&]() {
+        HypergeometricPFQ_Lanes<P,Q>(a, b, laneX.data(), lanes, laneOut.data());
+        for (std::size_t l = 0; l < lanes; ++l) {
+            out[laneIndex[l]] = laneOut[l];
+            RecordHypergeo(laneOut[l]);
+        }
+        lanes = 0;
+    };
+
+    for (std::size_t i = 0; i < count; ++i) {
+        if (HypergeoDirect_Reg<P,Q>(a, b, x[i], out[i])) {
+            RecordHypergeo(out[i]);
+            continue;
+        }
+        laneX[lanes] = x[i];
+        laneIndex[lanes] = i;
+        if (++lanes == HYPERGEO_LANES) SumLanes();
+    }
+    if (lanes > 0) SumLanes();
 }
 
 template<std::size_t P, std::size_t Q>
@@ -0,0 +1,459 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+// These are the inner loops of the matrix elements: multiplying out the F's of
+// two monomials and doing the integrals over every term of the product. They
+// are templates on K, the number of u+ variables (K = n-1, or n_A - 1 for the
+// n+2 terms), so that for the usual small n every loop over the particles has
+// a fixed length and can be unrolled or vectorized, and all of the scratch
+// space is on the stack. Kernels<0> is the generic version, which works for
+// any n; DispatchK calls the right one for a given K at runtime.
+//
+// The F's come in as TermLists (see term-list.hpp) whose exponents are laid out
+// as u+[k], u-[k], yTilde[k] for the interactions, or in the direct layout
+// below for the direct matrices. The combined terms are stored packed in
+// SparsePolys, with the exponents of each term laid out as follows:
+//
+//     direct:      u+[k], u-[k], sin(theta)[k-1], cos(theta)[k-1]
+//     interaction: u[2k+2], theta[2k-4] (none if k == 1), r[3], alpha
+//     n+2:         u[2k+4], theta[2k], r
+//
+// where the interaction u's and thetas are interleaved as described in the
+// comments on InteractionTerm_Step2 (see matrix.hpp), and the n+2 ones are
+//     u1+, u1-, ..., u(n-1)+, u(n-1)-, u'(n-1)+, u'(n-1)-, u'n+, u'n-
+//     sin(theta_1), cos(theta_1), ..., sin(theta_(n-2)), cos(theta_(n-2)),
+//         sin(theta'), cos(theta')
+//
+// This file is only meant to be included in matrix.cpp.
+
+#include <array>
+#include <vector>
+#include <string>
+
+#include "constants.hpp"
+#include "sparse-poly.hpp"
+#include "term-list.hpp"
+#include "matrix.hpp"
+
+namespace MatrixInternal {
+
+// scratch space for the kernels: a std::array if its size is known at compile
+// time, otherwise a vector (allocated once per kernel call, not per term)
+template<typename T, std::size_t N>
+class KernelArray {
+    public:
+        explicit KernelArray(const std::size_t) {}
+        T* data() { return values.data(); }
+        T& operator[](const std::size_t i) { return values[i]; }
+
+    private:
+        std::array<T,N> values;
+};
+
+template<typename T>
+class KernelArray<T,0> {
+    public:
+        explicit KernelArray(const std::size_t size): values(size) {}
+        T* data() { return values.data(); }
+        T& operator[](const std::size_t i) { return values[i]; }
+
+    private:
+        std::vector<T> values;
+};
+
+template<std::size_t K>
+struct Kernels {
+    // the k to use in the loops: a compile-time constant unless K == 0
+    static std::size_t NumU(const std::size_t k) { return K > 0 ? K : k; }
+
+    static constexpr std::size_t DirectWidth(const std::size_t k) {
+        return 4*k - 2;
+    }
+    static constexpr std::size_t InteractionWidth(const std::size_t k) {
+        return 2*k + 2 + (k >= 2 ? 2*k - 4 : 0) + 4;
+    }
+    static constexpr std::size_t NPlus2Width(const std::size_t k) {
+        return 4*k + 5;
+    }
+
+    // sizes of the scratch arrays, which are 0 (i.e. dynamic) if K == 0
+    static constexpr std::size_t DIRECT_SCRATCH = K > 0 ? DirectWidth(K) : 0;
+    static constexpr std::size_t INTER_SCRATCH = K > 0 ? InteractionWidth(K):0;
+    static constexpr std::size_t NPLUS2_SCRATCH = K > 0 ? NPlus2Width(K) : 0;
+
+    static coeff_class DirectResult(const TermList& F1, const TermList& F2,
+            const MATRIX_TYPE type);
+    static coeff_class DirectIntegrals(const char* exponents,
+            const coeff_class coeff, const std::size_t k,
+            const MATRIX_TYPE type);
+    static void FockBlock(const std::string& dictionaryA,
+            const std::size_t start, const std::string& dictionaryB,
+            const std::size_t k, const MATRIX_TYPE type, DMatrix& kernel);
+
+    static SparsePoly CombineInteractionFs(const TermList& F1,
+                                           const TermList& F2);
+    static NtoN_Final InteractionOutput(const SparsePoly& combined,
+                                        const coeff_class prefactor);
+
+    static SparsePoly CombineNPlus2Fs(const TermList& F1, const TermList& F2);
+    static std::vector<NPlus2Term_Output> NPlus2Output(
+            const SparsePoly& combined, const coeff_class prefactor);
+};
+
+// call call(Kernels<k>()), or call(Kernels<0>()) if k is bigger than the
+// largest K with its own instantiation (i.e. for n > 8)
+template<typename Call>
+auto DispatchK(const std::size_t k, Call&& call)
+        -> decltype(call(Kernels<0>())) {
+    switch (k) {
+        case 1: return call(Kernels<1>());
+        case 2: return call(Kernels<2>());
+        case 3: return call(Kernels<3>());
+        case 4: return call(Kernels<4>());
+        case 5: return call(Kernels<5>());
+        case 6: return call(Kernels<6>());
+        case 7: return call(Kernels<7>());
+        default: return call(Kernels<0>());
+    }
+}
+
+// direct ---------------------------------------------------------------------
+
+// the sum of the integrals of every term of F1*F2, which must both be nonempty
+// and in the direct layout. Many pairs of terms give the same exponents, so
+// these are collected first
+template<std::size_t K>
+coeff_class Kernels<K>::DirectResult(const TermList& F1, const TermList& F2,
+        const MATRIX_TYPE type) {
+    const std::size_t k = NumU((F1.Width() + 2)/4);
+    const std::size_t width = DirectWidth(k);
+
+    SparsePoly combined(width);
+    // typically around half of the products are distinct
+    combined.Reserve(F1.size()*F2.size()/2);
+    KernelArray<char,DIRECT_SCRATCH> exponents(width);
+    for (std::size_t a = 0; a < F1.size(); ++a) {
+        if (F1.Coeff(a) == 0) continue;
+        const char* exponents1 = F1.Exponents(a);
+        for (std::size_t b = 0; b < F2.size(); ++b) {
+            if (F2.Coeff(b) == 0) continue;
+            const char* exponents2 = F2.Exponents(b);
+            for (std::size_t i = 0; i < width; ++i) {
+                exponents[i] = exponents1[i] + exponents2[i];
+            }
+            combined.Add(exponents.data(), F1.Coeff(a)*F2.Coeff(b));
+        }
+    }
+
+    coeff_class total = 0;
+    for (std::size_t t = 0; t < combined.size(); ++t) {
+        if (combined.Coeff(t) == 0) continue;
+        total += DirectIntegrals(combined.Exponents(t), combined.Coeff(t), k,
+                                 type);
+    }
+    return total;
+}
+
+// coeff times the integrals of a single direct term; for the mass matrix, this
+// is the sum over the terms from every possible 1/x
+template<std::size_t K>
+coeff_class Kernels<K>::DirectIntegrals(const char* exponents,
+        const coeff_class coeff, const std::size_t kIn, const MATRIX_TYPE type) {
+    const std::size_t k = NumU(kIn);
+    const char* uPlus = exponents;
+    const char* uMinus = exponents + k;
+    const char* sinTheta = exponents + 2*k;
+    const char* cosTheta = exponents + 3*k - 1;
+
+    // the theta integrals don't care about the 1/x, so do them first; all but
+    // the last one are short, while the last one is long. These have constant
+    // terms which differ from Nikhil's because his i starts at 1 instead of 0
+    coeff_class thetaPart = 1;
+    if (k >= 2) {
+        for (std::size_t i = 0; i+2 < k; ++i) {
+            thetaPart *= ThetaIntegral_Short(k - i - 2 + sinTheta[i],
+                                             cosTheta[i]);
+        }
+        thetaPart *= ThetaIntegral_Long(sinTheta[k-2], cosTheta[k-2]);
+    } else {
+        thetaPart = 2;
+    }
+    if (thetaPart == 0) return 0;
+
+    if (type == MAT_INNER) {
+        coeff_class output = coeff;
+        for (std::size_t i = 0; i < k; ++i) {
+            output *= UPlusIntegral(uPlus[i] + 3, uMinus[i] + 5*(k - i) - 2);
+        }
+        return output*thetaPart;
+    } else if (type == MAT_MASS) {
+        // the 1/x for particle j lowers u+_j and every u-_i with i < j by 2
+        // (there's no u+ for the last particle), so each integral only comes
+        // in 3 varieties, which are computed once
+        KernelArray<builtin_class,K> plain(k), lowPlus(k), lowMinus(k);
+        for (std::size_t i = 0; i < k; ++i) {
+            const int b = uMinus[i] + 5*(k - i) - 2;
+            plain[i] = UPlusIntegral(uPlus[i] + 3, b);
+            lowPlus[i] = UPlusIntegral(uPlus[i] + 1, b);
+            lowMinus[i] = UPlusIntegral(uPlus[i] + 3, b - 2);
+        }
+        coeff_class sum = 0;
+        for (std::size_t j = 0; j <= k; ++j) {
+            coeff_class product = 1;
+            for (std::size_t i = 0; i < j; ++i) product *= lowMinus[i];
+            if (j < k) product *= lowPlus[j];
+            for (std::size_t i = j+1; i < k; ++i) product *= plain[i];
+            sum += product;
+        }
+        return coeff*sum*thetaPart;
+    }
+    return 0;
+}
+
+// kernel(a, b) = I(e_{start + a} + e_b) for the dictionaries of FockContraction,
+// whose entries are packed like the direct terms above; kernel must already
+// have the right size
+template<std::size_t K>
+void Kernels<K>::FockBlock(const std::string& dictionaryA,
+        const std::size_t start, const std::string& dictionaryB,
+        const std::size_t kIn, const MATRIX_TYPE type, DMatrix& kernel) {
+    const std::size_t k = NumU(kIn);
+    const std::size_t width = DirectWidth(k);
+    KernelArray<char,DIRECT_SCRATCH> exponents(width);
+    for (Eigen::Index a = 0; a < kernel.rows(); ++a) {
+        const char* exponentsA = dictionaryA.data() + (start + a)*width;
+        for (Eigen::Index b = 0; b < kernel.cols(); ++b) {
+            const char* exponentsB = dictionaryB.data() + b*width;
+            for (std::size_t i = 0; i < width; ++i) {
+                exponents[i] = exponentsA[i] + exponentsB[i];
+            }
+            kernel(a, b) = DirectIntegrals(exponents.data(), 1, k, type);
+        }
+    }
+}
+
+// interaction ----------------------------------------------------------------
+
+// InteractionOutput doesn't use the coefficients of the terms, just their
+// integrals, so what's collected for each set of exponents is how many pairs of
+// uncollected terms have them (see YTildeFromY)
+template<std::size_t K>
+SparsePoly Kernels<K>::CombineInteractionFs(const TermList& F1, 
+                                            const TermList& F2) {
+    const std::size_t k = NumU(F1.Width()/3);
+    const std::size_t uSize = 2*k + 2;
+    const std::size_t thetaSize = k >= 2 ? 2*k - 4 : 0;
+    const std::size_t width = InteractionWidth(k);
+
+    // terms with odd powers of r will eventually integrate to 0 so ditch them.
+    // The powers of sqrt(1-r^2) and sqrt(1-alpha^2 r^2) are the last yTilde of
+    // f1 and f2 respectively, so those terms are skipped before multiplying
+    //
+    // TODO: verify that this variant targeting all odd powers is legitimate,
+    //        and make sure it's not safe to delete odd r[0] as well
+    auto oddR = [k](const char* f) {
+        return k >= 2 && f[3*k - 1]%2 == 1;
+    };
+
+    SparsePoly combined(width);
+    KernelArray<char,INTER_SCRATCH> exponents(width);
+    char* u = exponents.data();
+    char* theta = u + uSize;
+    char* r = theta + thetaSize;
+    char& alpha = r[3];
+    for (std::size_t a = 0; a < F1.size(); ++a) {
+        const char* f1 = F1.Exponents(a);
+        if (oddR(f1)) continue;
+        const char* f1Minus = f1 + k;
+        const char* f1Tilde = f1 + 2*k;
+        for (std::size_t b = 0; b < F2.size(); ++b) {
+            const char* f2 = F2.Exponents(b);
+            if (oddR(f2)) continue;
+            const char* f2Minus = f2 + k;
+            const char* f2Tilde = f2 + 2*k;
+            for (std::size_t i = 0; i+1 < k; ++i) {
+                u[2*i] = f1[i] + f2[i];
+                u[2*i + 1] = f1Minus[i] + f2Minus[i];
+            }
+            u[uSize - 4] = f1[k-1];
+            u[uSize - 3] = f1Minus[k-1];
+            u[uSize - 2] = f2[k-1];
+            u[uSize - 1] = f2Minus[k-1];
+
+            // for n == 2, theta is empty and r doesn't matter
+            r[0] = r[1] = r[2] = alpha = 0;
+            if (k >= 2) {
+                // sine[i] appears in all yTilde[j] with j > i (strictly
+                // greater), up to the second-to-last one
+                char sines = 0;
+                for (std::size_t i = k-2; i-- > 0; ) {
+                    sines += f1Tilde[i+1] + f2Tilde[i+1];
+                    theta[2*i] = sines;
+                    theta[2*i + 1] = f1Tilde[i] + f2Tilde[i];
+                }
+
+                for (std::size_t i = 0; i+1 < k; ++i) {
+                    alpha += f2Tilde[i];
+                    r[0] += f1Tilde[i] + f2Tilde[i];
+                }
+                r[1] = f1Tilde[k-1];
+                r[2] = f2Tilde[k-1];
+            }
+            combined.Add(exponents.data(), F1.Count(a) * F2.Count(b));
+        }
+    }
+    return combined;
+}
+
+// do all of the integrals which are possible before mu discretization, and
+// return an object mapping {alpha and r exponents} -> value
+template<std::size_t K>
+NtoN_Final Kernels<K>::InteractionOutput(const SparsePoly& combined,
+                                         const coeff_class prefactor) {
+    NtoN_Final output;
+    if (combined.empty()) return output;
+    // NumVars() is 4k + 2, or 8 if k == 1
+    const std::size_t k = NumU((combined.NumVars() - 2)/4);
+    const std::size_t n = k + 1;
+    const std::size_t uSize = 2*n;
+    const std::size_t thetaSize = k >= 2 ? 2*k - 4 : 0;
+    for (std::size_t t = 0; t < combined.size(); ++t) {
+        const char* u = combined.Exponents(t);
+        const char* theta = u + uSize;
+
+        // the first n-2 u's have the measure factors, while the last 4 have 1
+        coeff_class product = 1;
+        for (std::size_t i = 0; i+2 < n; ++i) {
+            product *= UPlusIntegral(u[2*i] + 3, u[2*i + 1] + 5*(n-i) - 8);
+        }
+        for (std::size_t i = n-2; i < n; ++i) {
+            product *= UPlusIntegral(u[2*i] + 1, u[2*i + 1] + 1);
+        }
+        for (std::size_t i = 0; i+3 < n; ++i) {
+            const int sinPower = theta[2*i] + (i+4 < n ? n-i-3 : 0);
+            product *= ThetaIntegral_Short(sinPower, theta[2*i + 1]);
+        }
+        const coeff_class integralPart = prefactor*combined.Coeff(t)*product;
+
+        const char* rAndAlpha = theta + thetaSize;
+        const std::array<char,3> r{{rAndAlpha[0], rAndAlpha[1], rAndAlpha[2]}};
+        auto expansion = Expand(r, rAndAlpha[3]);
+        for (const auto& pair : *expansion) {
+            if (output.count(pair.first) == 0) {
+                output.emplace(pair.first, pair.second*integralPart);
+            } else {
+                output[pair.first] += pair.second*integralPart;
+            }
+        }
+    }
+    return output;
+}
+
+// n+2 ------------------------------------------------------------------------
+
+// here F1 is from the n-particle monomial and F2 from the (n+2)-particle one
+template<std::size_t K>
+SparsePoly Kernels<K>::CombineNPlus2Fs(const TermList& F1, const TermList& F2) {
+    const std::size_t k = NumU(F1.Width()/3);
+    const std::size_t uSize = 2*k + 4;
+    const std::size_t thetaSize = 2*k;
+    const std::size_t width = NPlus2Width(k);
+
+    // terms with odd powers of r will eventually integrate to 0 so ditch them;
+    // r only depends on f2, so they're skipped before multiplying
+    auto oddR = [k](const char* f2Tilde) {
+        return (f2Tilde[k] + f2Tilde[k+1])%2 == 1;
+    };
+
+    SparsePoly combined(width);
+    KernelArray<char,NPLUS2_SCRATCH> exponents(width);
+    char* u = exponents.data();
+    char* theta = u + uSize;
+    for (std::size_t i = 0; i < width; ++i) exponents[i] = 0;
+    for (std::size_t b = 0; b < F2.size(); ++b) {
+        // F2 has k+2 each of u+, u- and yTilde
+        const char* f2 = F2.Exponents(b);
+        const char* f2Minus = f2 + (k+2);
+        const char* f2Tilde = f2 + 2*(k+2);
+        if (oddR(f2Tilde)) continue;
+        for (std::size_t a = 0; a < F1.size(); ++a) {
+            const char* f1 = F1.Exponents(a);
+            const char* f1Minus = f1 + k;
+            const char* f1Tilde = f1 + 2*k;
+            for (std::size_t i = 0; i < k; ++i) {
+                u[2*i] = f1[i] + f2[i];
+                u[2*i + 1] = f1Minus[i] + f2Minus[i];
+            }
+            u[uSize - 4] = f2     [k];
+            u[uSize - 3] = f2Minus[k];
+            u[uSize - 2] = f2     [k+1];
+            u[uSize - 1] = f2Minus[k+1];
+
+            // sine[i] appears in all yTilde[j] with j > i (strictly greater),
+            // up to the second-to-last one; theta[2k-4] and theta[2k-3] are
+            // never filled in, so they stay 0
+            char sines = 0;
+            for (std::size_t i = k >= 2 ? k-2 : 0; i-- > 0; ) {
+                sines += f1Tilde[i+1] + f2Tilde[i+1];
+                theta[2*i] = sines;
+                theta[2*i + 1] = f1Tilde[i] + f2Tilde[i];
+            }
+            theta[thetaSize-2] = f2Tilde[k+1];
+            theta[thetaSize-1] = f2Tilde[k];
+
+            exponents[width-1] = f2Tilde[k] + f2Tilde[k+1];
+            combined.Add(exponents.data(), F1.Coeff(a) * F2.Coeff(b));
+        }
+    }
+    return combined;
+}
+
+// do all of the integrals which are possible before mu discretization, and
+// return a list of {value, {r exponents}} objects
+template<std::size_t K>
+std::vector<NPlus2Term_Output> Kernels<K>::NPlus2Output(
+        const SparsePoly& combined, const coeff_class prefactor) {
+    std::vector<NPlus2Term_Output> output;
+    if (combined.empty()) return output;
+    const std::size_t k = NumU((combined.NumVars() - 5)/4);
+    const std::size_t n = k + 1;
+    const std::size_t uSize = 2*k + 4;
+    output.reserve(combined.size());
+    for (std::size_t t = 0; t < combined.size(); ++t) {
+        if (combined.Coeff(t) == 0) continue;
+        const char* u = combined.Exponents(t);
+        const char* theta = u + uSize;
+        coeff_class integrals = combined.Coeff(t);
+
+        // do the non-primed u integrals first
+        for (std::size_t i = 0; i+1 < n; ++i) {
+            integrals *= UPlusIntegral(u[2*i] + 3, 5*(n - i) - 3 + u[2*i + 1]);
+        }
+
+        // next the two primed u integrals (TODO: check additions!!)
+        integrals *= UPlusIntegral(u[2*(n-1)] + 1, u[2*(n-1) + 1] + 1);
+        integrals *= UPlusIntegral(u[2*n] + 1, u[2*n + 1] + 4);
+
+        // now the theta integrals; there are n-2 "normal" theta integrals,
+        // followed by one primed one. The primed and the last normal are long
+        // (I think?), and the constant terms differ from Zuhair's because his
+        // i starts at 1 instead of 0
+        if (n >= 3) {
+            for (std::size_t i = 0; i+3 < n; ++i) {
+                integrals *= ThetaIntegral_Short(n - (i+1) - 2 + theta[2*i],
+                                                 theta[2*i + 1]);
+            }
+            integrals *= ThetaIntegral_Long(theta[2*(n-3)],
+                                            theta[2*(n-3) + 1]);
+        }
+        // I think this one (the primed one) is guaranteed to be there
+        integrals *= ThetaIntegral_Long(theta[2*(n-2)], theta[2*(n-2) + 1]);
+
+        output.emplace_back(prefactor*integrals, u[combined.NumVars() - 1]);
+    }
+    return output;
+}
+
+} // namespace MatrixInternal
+
+#endif
@@ -0,0 +1,111 @@
+#include "kronecker.hpp"
+
+KronMatrix::KronMatrix(const DMatrix& fockPart, const DMatrix& muPart):
+    terms{{fockPart, muPart}}, partitions(muPart.rows()),
+    numRows(fockPart.rows()*muPart.rows()),
+    numCols(fockPart.cols()*muPart.cols()) {
+    if (muPart.rows() != muPart.cols()) {
+        throw std::logic_error("KronMatrix: mu part must be square");
+    }
+}
+
+KronMatrix::KronMatrix(const DMatrix& dense, const std::size_t partitions):
+    densePart(dense), partitions(partitions), numRows(dense.rows()),
+    numCols(dense.cols()) {
+    if (partitions == 0 || dense.rows() % partitions != 0
+            || dense.cols() % partitions != 0) {
+        throw std::logic_error("KronMatrix: dense part is not made of blocks");
+    }
+}
+
+const DMatrix& KronMatrix::FockPart(const std::size_t term) const {
+    return terms.at(term).fockPart;
+}
+
+const DMatrix& KronMatrix::MuPart(const std::size_t term) const {
+    return terms.at(term).muPart;
+}
+
+coeff_class KronMatrix::operator()(const Eigen::Index row,
+                                   const Eigen::Index col) const {
+    const Eigen::Index k = partitions;
+    coeff_class output = HasDensePart() ? densePart(row, col) : 0;
+    for (const Term& term : terms) {
+        output += term.fockPart(row/k, col/k) * term.muPart(row%k, col%k);
+    }
+    return output;
+}
+
+DMatrix KronMatrix::Dense() const {
+    const Eigen::Index k = partitions;
+    DMatrix output = HasDensePart() ? densePart
+                                    : DMatrix::Zero(numRows, numCols);
+    for (const Term& term : terms) {
+        for (Eigen::Index a = 0; a < term.fockPart.rows(); ++a) {
+            for (Eigen::Index b = 0; b < term.fockPart.cols(); ++b) {
+                output.block(a*k, b*k, k, k) += term.fockPart(a, b)*term.muPart;
+            }
+        }
+    }
+    return output;
+}
+
+// the factorized terms only need their Fock parts projected, since
+// (L x 1)^T (F x M) (R x 1) = (L^T F R) x M; the dense part has to be done the
+// slow way
+KronMatrix KronMatrix::Project(const DMatrix& left, const DMatrix& right) const{
+    if (left.rows()*static_cast<Eigen::Index>(partitions) != numRows
+            || right.rows()*static_cast<Eigen::Index>(partitions) != numCols) {
+        throw std::logic_error("KronMatrix::Project: dimensions don't match");
+    }
+
+    KronMatrix output;
+    output.partitions = partitions;
+    output.numRows = left.cols()*partitions;
+    output.numCols = right.cols()*partitions;
+    for (const Term& term : terms) {
+        output.terms.push_back({left.transpose()*term.fockPart*right,
+                                term.muPart});
+    }
+    if (HasDensePart()) {
+        SMatrix discLeft = DiscretizePolys(left, partitions);
+        SMatrix discRight = DiscretizePolys(right, partitions);
+        output.densePart = discLeft.transpose()*densePart*discRight;
+    }
+    return output;
+}
+
+KronMatrix& KronMatrix::operator+=(const KronMatrix& other) {
+    CheckShape(other);
+    terms.insert(terms.end(), other.terms.begin(), other.terms.end());
+    if (other.HasDensePart()) {
+        if (HasDensePart()) {
+            densePart += other.densePart;
+        } else {
+            densePart = other.densePart;
+        }
+    }
+    return *this;
+}
+
+KronMatrix& KronMatrix::operator*=(const coeff_class scalar) {
+    for (Term& term : terms) term.fockPart *= scalar;
+    if (HasDensePart()) densePart *= scalar;
+    return *this;
+}
+
+void KronMatrix::CheckShape(const KronMatrix& other) const {
+    if (numRows != other.numRows || numCols != other.numCols
+            || partitions != other.partitions) {
+        throw std::logic_error("KronMatrix: adding matrices of different "
+                               "shapes");
+    }
+}
+
+KronMatrix operator+(KronMatrix A, const KronMatrix& B) {
+    return A += B;
+}
+
+KronMatrix operator*(const coeff_class scalar, KronMatrix A) {
+    return A *= scalar;
+}
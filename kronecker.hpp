@@ -0,0 +1,68 @@
+#ifndef KRONECKER_HPP
+#define KRONECKER_HPP
+
+// The direct matrices (inner product, mass, kinetic) between discretized
+// monomials are all Kronecker products: the block between monomials A and B is
+// (Fock part of A,B)*(mu part), with the same mu part for every pair. Storing
+// them as dense matrices of side (basis size)*partitions makes memory and time
+// grow like partitions^2, so instead a KronMatrix keeps the two factors.
+//
+// A KronMatrix is a sum of such products, plus an optional dense part for the
+// pieces that don't factorize (i.e. the interactions). Rows and columns are
+// ordered the same way as the dense matrices, so entry (a*k + p, b*k + q) is
+// the (p,q) entry of the (a,b) block, and the dense form is only built when
+// something asks for it with Dense().
+
+#include <vector>
+#include <stdexcept>
+
+#include "constants.hpp"
+#include "discretization.hpp" // DiscretizePolys, for the dense part
+
+class KronMatrix {
+    public:
+        KronMatrix(): partitions(1), numRows(0), numCols(0) {}
+        // the Kronecker product of fockPart with muPart
+        KronMatrix(const DMatrix& fockPart, const DMatrix& muPart);
+        // a matrix with no factorized terms, whose blocks are partitions wide
+        KronMatrix(const DMatrix& dense, const std::size_t partitions);
+
+        Eigen::Index rows() const { return numRows; }
+        Eigen::Index cols() const { return numCols; }
+        std::size_t Partitions() const { return partitions; }
+        std::size_t NumTerms() const { return terms.size(); }
+        const DMatrix& FockPart(const std::size_t term) const;
+        const DMatrix& MuPart(const std::size_t term) const;
+        bool HasDensePart() const { return densePart.size() != 0; }
+
+        coeff_class operator()(const Eigen::Index row,
+                               const Eigen::Index col) const;
+        DMatrix Dense() const;
+
+        // given matrices whose columns are polynomials on the minimal bases of
+        // the rows and columns respectively, return the matrix between the
+        // discretized polynomials, i.e. (left x 1)^T * this * (right x 1)
+        KronMatrix Project(const DMatrix& left, const DMatrix& right) const;
+
+        KronMatrix& operator+=(const KronMatrix& other);
+        KronMatrix& operator*=(const coeff_class scalar);
+
+    private:
+        struct Term {
+            DMatrix fockPart;
+            DMatrix muPart;
+        };
+
+        std::vector<Term> terms;
+        DMatrix densePart; // empty unless something non-factorizable was added
+        std::size_t partitions;
+        Eigen::Index numRows;
+        Eigen::Index numCols;
+
+        void CheckShape(const KronMatrix& other) const;
+};
+
+KronMatrix operator+(KronMatrix A, const KronMatrix& B);
+KronMatrix operator*(const coeff_class scalar, KronMatrix A);
+
+#endif
@@ -77,6 +77,15 @@ Arguments ParseArguments(int argc, char* argv[]) {
 #endif
                     ret.options |= OPT_MATHEMATICA;
                     ++i; // next argument is the filename so don't process it
+                } else if (arg.size() > 1 && arg[1] == 'c' && i+1 < argc) {
+                    // next argument is the memo cache limit in megabytes
+                    ret.cacheLimit = std::max(0.0,
+                            ReadArg<double>(argv[i+1]))*1024*1024;
+                    ++i;
+                } else if (arg.size() > 1 && arg[1] == 'j' && i+1 < argc) {
+                    // next argument is the number of threads to use
+                    ret.threads = std::max(0, ReadArg<int>(argv[i+1]));
+                    ++i;
                 } else {
                     options.push_back(arg);
                 }
@@ -5,6 +5,7 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <algorithm> // max
 
 constexpr char VERSION[] = "0.9.7";
 constexpr char RELEASE_DATE[] = __DATE__;
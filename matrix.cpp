@@ -1,4 +1,5 @@
 #include "matrix.hpp"
+#include "kernels.hpp"
 
 // Fock space part (ONLY) of the inner product between two monomials
 coeff_class InnerFock(const Mono& A, const Mono& B) {
@@ -24,34 +25,47 @@ DMatrix GramFock(const Basis<Mono>& basis) {
 // creates a gram matrix for the given basis using the Fock space inner product
 // 
 // this returns the rank 4 tensor relating states with different partitions
-DMatrix GramMatrix(const Basis<Mono>& basis, const std::size_t partitions) {
-    return MatrixInternal::Matrix(basis, partitions, MAT_INNER);
+KronMatrix GramMatrix(const Basis<Mono>& basis, const std::size_t partitions) {
+    return MatrixInternal::DirectMatrix(basis, partitions, MAT_INNER);
 }
 
 // creates a mass matrix M for the given monomials. To get the mass matrix of a 
 // basis of primary operators, one must express the primaries as a matrix of 
 // vectors, A, and multiply A^T M A.
-DMatrix MassMatrix(const Basis<Mono>& basis, const std::size_t partitions) {
-    return MatrixInternal::Matrix(basis, partitions, MAT_MASS);
+KronMatrix MassMatrix(const Basis<Mono>& basis, const std::size_t partitions) {
+    return MatrixInternal::DirectMatrix(basis, partitions, MAT_MASS);
 }
 
-DMatrix KineticMatrix(const Basis<Mono>& basis, const std::size_t partitions) {
-    return MatrixInternal::Matrix(basis, partitions, MAT_KINETIC);
+KronMatrix KineticMatrix(const Basis<Mono>& basis, const std::size_t partitions) {
+    return MatrixInternal::DirectMatrix(basis, partitions, MAT_KINETIC);
 }
 
 // creates a matrix of n->n interactions between the given basis's monomials
-DMatrix InteractionMatrix(const Basis<Mono>& basis, const std::size_t partitions) {
-    return MatrixInternal::Matrix(basis, partitions, MAT_INTER_SAME_N);
+DMatrix InteractionMatrix(const Basis<Mono>& basis, const std::size_t partitions,
+                          std::ostream& log) {
+    return MatrixInternal::Matrix(basis, partitions, MAT_INTER_SAME_N, log);
 }
 
+// the blocks are planned pair by pair and then evaluated all at once; see
+// MatrixInternal::MuContraction
 DMatrix NPlus2Matrix(const Basis<Mono>& basisA, const Basis<Mono>& basisB,
-                     const std::size_t partitions) {
+                     const std::size_t partitions, std::ostream& log) {
+    std::vector<std::pair<std::size_t,std::size_t>> pairs;
+    for (std::size_t i = 0; i < basisA.size(); ++i) {
+        for (std::size_t j = 0; j < basisB.size(); ++j) pairs.emplace_back(i, j);
+    }
+    MatrixInternal::MuContraction plan(MAT_INTER_N_PLUS_2, partitions);
+    MatrixInternal::PlanBlocks(basisA, basisB, pairs, MAT_INTER_N_PLUS_2, plan,
+                               log);
+    const DMatrix blocks = plan.Evaluate(pairs.size());
+
     DMatrix output(basisA.size()*partitions, basisB.size()*partitions);
     for (std::size_t i = 0; i < basisA.size(); ++i) {
         for (std::size_t j = 0; j < basisB.size(); ++j) {
             output.block(i*partitions, j*partitions, partitions, partitions)
-                = MatrixInternal::MatrixBlock(basisA[i], basisB[j], 
-                                              MAT_INTER_N_PLUS_2, partitions);
+                = Eigen::Map<const DMatrix>(
+                    blocks.col(i*basisB.size() + j).data(), 
+                    partitions, partitions);
         }
     }
     return output;
@@ -59,38 +73,46 @@ DMatrix NPlus2Matrix(const Basis<Mono>& basisA, const Basis<Mono>& basisB,
 
 namespace MatrixInternal {
 
-// static hash tables for memoizing slow steps
+// memo tables for the slow steps; these are shared by all of the assembly
+// threads, so they're Memo::Caches rather than plain unordered_maps
 namespace {
     // all matrices: map from {x,y}->{u,yTilde}
-    std::unordered_map<std::string, std::vector<MatrixTerm_Intermediate>>
-        intermediateCache;
+    Memo::Cache<std::string, TermList>
+        intermediateCache("MatrixInternal::InteractionTermsFromXY");
     // direct matrices: map from {x,y}->{u,theta}
-    std::unordered_map<std::string, std::vector<MatrixTerm_Final>> directCache;
-    // interaction matrices: map from {x,y}->{u,r,theta}
-    std::unordered_map<std::string, std::vector<InteractionTerm_Step2>>
-        interactionCache;
-    // interaction n+2 matrices: map from {x,y}->{u,theta}
-    std::unordered_map<std::string, std::vector<MatrixTerm_Final>> nPlus2Cache;
-
-    // integrals: map from (a,b)->#
-    std::unordered_map<std::array<builtin_class,2>, builtin_class,
-            boost::hash<std::array<builtin_class,2>> > uCache; // FIXME: dep'd
-    std::unordered_map<std::array<builtin_class,2>, builtin_class,
-            boost::hash<std::array<builtin_class,2>> > uPlusCache;
-    std::unordered_map<std::array<builtin_class,2>, builtin_class,
-            boost::hash<std::array<builtin_class,2>> > thetaCache;
+    Memo::Cache<std::string, TermList> 
+        directCache("MatrixInternal::DirectTermsFromXY");
+    // map from PermutationVector()->distinct orderings of the particles
+    Memo::Cache<std::vector<size_t>, std::vector<std::vector<char>>,
+            boost::hash<std::vector<size_t>> >
+        ordersCache("MatrixInternal::ParticleOrders");
+
+    // B(p/2, q/2) for positive integers p and q; every u and theta integral is
+    // one of these. A table is never modified once it's been built, only
+    // replaced by a bigger one, so lookups don't have to lock anything. The
+    // old tables are kept until exit in case some thread is still reading one
+    class HalfBetaTable {
+        public:
+            builtin_class operator()(const int p, const int q);
+            void Reserve(const int side);
+
+        private:
+            struct Table {
+                int side;
+                std::vector<builtin_class> values;
+            };
+
+            std::atomic<const Table*> current{nullptr};
+            std::mutex growMutex;
+            std::vector<std::unique_ptr<const Table>> tables;
+
+            const Table* Grow(const int side);
+    } halfBeta;
 } // anonymous namespace
 
-YTerm::YTerm(const coeff_class coeff, const std::string& y, 
-		const std::string& nAndm): coeff(coeff), y(y.begin(), y.end()-1) {
-	for (std::size_t i = 0; i < size(); ++i) {
-		this->y[i] += nAndm[i+1];
-	}
-}
+} // namespace MatrixInternal
 
-OStream& operator<<(OStream& os, const YTerm& out) {
-	return os << out.coeff << " * " << out.y;
-}
+namespace MatrixInternal {
 
 MatrixTerm_Intermediate::MatrixTerm_Intermediate(const size_t n): coeff(1),
 	uPlus(n), uMinus(n), yTilde(n) {
@@ -102,42 +124,11 @@ void MatrixTerm_Intermediate::Resize(const size_t n) {
     yTilde.resize(n);
 }
 
-MatrixTerm_Intermediate operator*(
-		const MatrixTerm_Intermediate& A, MatrixTerm_Intermediate B) {
-	B.coeff *= A.coeff;
-	B.uPlus  = AddVectors(A.uPlus , B.uPlus );
-	B.uMinus = AddVectors(A.uMinus, B.uMinus);
-	B.yTilde = AddVectors(A.yTilde, B.yTilde);
-	return B;
-}
-
 OStream& operator<<(OStream& os, const MatrixTerm_Intermediate& out) {
 	return os << out.coeff << " * {" << out.uPlus << ", "
 		<< out.uMinus << ", " << out.yTilde << "}";
 }
 
-// this n would be called (n-1) in Zuhair's equations
-MatrixTerm_Final::MatrixTerm_Final(const size_t n): coeff(1), uPlus(n), 
-	uMinus(n), sinTheta(n-1), cosTheta(n-1) {
-}
-
-// maybe should be rvalue references instead? hopefully it's the same
-MatrixTerm_Final::MatrixTerm_Final(const coeff_class coeff, 
-		const std::vector<char>& uPlus, const std::vector<char>& uMinus, 
-		const std::vector<char>& sinTheta, const std::vector<char>& cosTheta): 
-	coeff(coeff), uPlus(uPlus), uMinus(uMinus), sinTheta(sinTheta), 
-	cosTheta(cosTheta) {
-}
-
-// notice that there are fewer Thetas than Us, so the vectors aren't all the
-// same size; also, the n here would be called (n-1) in Zuhair's equations
-void MatrixTerm_Final::Resize(const size_t n) {
-    uPlus.resize(n);
-    uMinus.resize(n);
-    sinTheta.resize(n-1);
-    cosTheta.resize(n-1);
-}
-
 OStream& operator<<(OStream& os, const InteractionTerm_Step2& out) {
     return os << out.coeff << " * {" << out.u << ", "
         << out.theta << ", " << out.r << "}";
@@ -145,36 +136,245 @@ OStream& operator<<(OStream& os, const InteractionTerm_Step2& out) {
 
 // generically return direct or interaction matrix of the specified type
 DMatrix Matrix(const Basis<Mono>& basis, const std::size_t kMax, 
-        const MATRIX_TYPE type) {
+        const MATRIX_TYPE type, std::ostream& log) {
+    const bool direct = (type == MAT_INNER || type == MAT_MASS 
+                         || type == MAT_KINETIC);
+
     // kMax == 0 means that the Fock part has been requested by itself
     if (kMax == 0) {
-        DMatrix fockPart(basis.size(), basis.size());
+        return FockMatrix(basis, type);
+    } else if (direct) {
+        return DirectMatrix(basis, kMax, type).Dense();
+    } else {
+        // plan every block of the upper triangle, then evaluate them together
+        std::vector<std::pair<std::size_t,std::size_t>> pairs;
         for (std::size_t i = 0; i < basis.size(); ++i) {
-            fockPart(i, i) = MatrixTerm(basis[i], basis[i], type);
-            for (std::size_t j = i+1; j < basis.size(); ++j) {
-                fockPart(i, j) = MatrixTerm(basis[i], basis[j], type);
-                fockPart(j, i) = fockPart(i, j);
-            }
+            for (std::size_t j = i; j < basis.size(); ++j) pairs.emplace_back(i, j);
         }
+        MuContraction plan(type, kMax);
+        PlanBlocks(basis, basis, pairs, type, plan, log);
+        const DMatrix blocks = plan.Evaluate(pairs.size());
 
-        return fockPart;
-    } else {
         DMatrix output(basis.size()*kMax, basis.size()*kMax);
-        for (std::size_t i = 0; i < basis.size(); ++i) {
-            output.block(i*kMax, i*kMax, kMax, kMax)
-                = MatrixBlock(basis[i], basis[i], type, kMax);
-            for (std::size_t j = i+1; j < basis.size(); ++j) {
-                output.block(i*kMax, j*kMax, kMax, kMax)
-                    = MatrixBlock(basis[i], basis[j], type, kMax);
-                output.block(j*kMax, i*kMax, kMax, kMax)
-                    = output.block(i*kMax, j*kMax, kMax, kMax).transpose();
-                // FIXME: make sure above assignment is correct
+        for (std::size_t p = 0; p < pairs.size(); ++p) {
+            const std::size_t i = pairs[p].first;
+            const std::size_t j = pairs[p].second;
+            Eigen::Map<const DMatrix> block(blocks.col(p).data(), kMax, kMax);
+            output.block(i*kMax, j*kMax, kMax, kMax) = block;
+            if (i != j) {
+                // FIXME: make sure this assignment is correct
+                output.block(j*kMax, i*kMax, kMax, kMax) = block.transpose();
             }
         }
         return output;
     }
 }
 
+// direct blocks are all (Fock part)*(the same mu part), so direct matrices are
+// Kronecker products and we only have to do the expensive Fock part once
+KronMatrix DirectMatrix(const Basis<Mono>& basis, const std::size_t partitions,
+        const MATRIX_TYPE type) {
+    return KronMatrix(FockMatrix(basis, type), MuPart(partitions, type));
+}
+
+// the Fock part of a direct matrix, i.e. MatrixTerm(A, B, type) for every pair
+// of monomials in the basis. This is done either pair by pair or as a single
+// contraction over all of the exponents which appear; see FockContraction
+DMatrix FockMatrix(const Basis<Mono>& basis, const MATRIX_TYPE type) {
+    FockContraction contraction(basis, type);
+    if (contraction.Valid() 
+            && contraction.ContractionWork() < contraction.PairwiseWork()) {
+        return contraction.Evaluate();
+    } else {
+        return FockMatrix_Pairwise(basis, type);
+    }
+}
+
+// The upper triangle is split among the Pool::Threads() threads. Pairs are handed
+// out one at a time in order of decreasing PairCost, so each thread takes the
+// next most expensive pair as soon as it's free; every entry is computed by
+// exactly the same code as the serial version, so the result doesn't depend on
+// the number of threads.
+DMatrix FockMatrix_Pairwise(const Basis<Mono>& basis, const MATRIX_TYPE type) {
+    DMatrix fockPart(basis.size(), basis.size());
+    if (basis.size() == 0) return fockPart;
+
+    std::vector<std::pair<std::size_t,std::size_t>> pairs;
+    std::vector<builtin_class> costs;
+    pairs.reserve(basis.size()*(basis.size()+1)/2);
+    for (std::size_t i = 0; i < basis.size(); ++i) {
+        for (std::size_t j = i; j < basis.size(); ++j) {
+            pairs.emplace_back(i, j);
+            costs.push_back(PairCost(basis[i], basis[j], type));
+        }
+    }
+    const std::vector<std::size_t> order = LargestFirst(costs);
+
+    Pool::ParallelFor(order.size(), [&](const std::size_t k) {
+            const auto& pair = pairs[order[k]];
+            fockPart(pair.first, pair.second) = MatrixTerm(
+                    basis[pair.first], basis[pair.second], type);
+            fockPart(pair.second, pair.first) 
+                = fockPart(pair.first, pair.second);
+        });
+
+    return fockPart;
+}
+
+FockContraction::FockContraction(const Basis<Mono>& basis, 
+                                 const MATRIX_TYPE type): 
+    basis(basis), type(type == MAT_KINETIC ? MAT_INNER : type), valid(false),
+    n(0), width(0), pairwiseWork(0) {
+    if (basis.size() == 0 || (this->type != MAT_INNER 
+                              && this->type != MAT_MASS)) {
+        return;
+    }
+    n = basis[0].NParticles();
+    if (n < 2) return;
+    width = 4*(n-1) - 2;
+
+    std::unordered_map<std::string,std::size_t> indicesA, indicesB;
+    std::vector<Triplet> tripletsA, tripletsB;
+    std::vector<builtin_class> sizesA(basis.size()), sizesB(basis.size());
+    for (std::size_t i = 0; i < basis.size(); ++i) {
+        if (basis[i].NParticles() != n) return;
+
+        // A is never permuted, while B goes through the same permutations as
+        // in MatrixTerm_Direct
+        std::string xAndy = ExtractXY(basis[i]);
+        auto fFromA = DirectTermsFromXY(xAndy);
+        if (!AddTerms(*fFromA, i, indicesA, dictionaryA, tripletsA)) return;
+        sizesA[i] = fFromA->size();
+        do {
+            auto fFromB = DirectTermsFromXY(xAndy);
+            if (!AddTerms(*fFromB, i, indicesB, dictionaryB, tripletsB)) {
+                return;
+            }
+            sizesB[i] += fFromB->size();
+        } while (PermuteXY(xAndy));
+    }
+
+    coeffsA.resize(DictionarySize(dictionaryA), basis.size());
+    coeffsA.setFromTriplets(tripletsA.begin(), tripletsA.end());
+    coeffsB.resize(DictionarySize(dictionaryB), basis.size());
+    coeffsB.setFromTriplets(tripletsB.begin(), tripletsB.end());
+
+    for (std::size_t i = 0; i < basis.size(); ++i) {
+        for (std::size_t j = i; j < basis.size(); ++j) {
+            pairwiseWork += sizesA[i]*sizesB[j];
+        }
+    }
+    valid = true;
+}
+
+// add each term's coefficient to the entry for its exponents in the given
+// column, adding the exponents to the dictionary if they're new. Returns false
+// if the terms aren't usable, in which case the pairwise method should be used
+bool FockContraction::AddTerms(const TermList& terms,
+        const std::size_t column, 
+        std::unordered_map<std::string,std::size_t>& indices, 
+        std::string& dictionary, std::vector<Triplet>& triplets) {
+    // MatrixTerm_Direct treats an empty F specially, so don't try to 
+    // reproduce that
+    if (terms.empty() || terms.Width() != width) return false;
+
+    std::string key;
+    for (std::size_t t = 0; t < terms.size(); ++t) {
+        key.assign(terms.Exponents(t), width);
+
+        auto index = indices.emplace(key, dictionary.size()/width);
+        if (index.second) dictionary.append(key);
+        triplets.emplace_back(index.first->second, column, terms.Coeff(t));
+    }
+    return true;
+}
+
+// one unit of work is one F_A term times one F_B term (i.e. one set of 
+// integrals); the products with the sparse coefficient matrices are much 
+// cheaper per multiplication, so they're weighted down
+builtin_class FockContraction::ContractionWork() const {
+    constexpr builtin_class productWeight = 0.05;
+    builtin_class kernelSize = DictionarySize(dictionaryA);
+    kernelSize *= DictionarySize(dictionaryB);
+    builtin_class products = DictionarySize(dictionaryA);
+    products *= coeffsB.nonZeros();
+    products += builtin_class(coeffsA.nonZeros())*basis.size();
+    return kernelSize + productWeight*products;
+}
+
+// K is built a block of rows at a time (in parallel) and immediately multiplied
+// by C_B, so it never has to be stored in full. Each row of K*C_B is computed
+// the same way no matter which thread does it, so the result doesn't depend on
+// the number of threads
+DMatrix FockContraction::Evaluate() const {
+    constexpr std::size_t blockSize = 32;
+    const std::size_t rows = DictionarySize(dictionaryA);
+    DMatrix kTimesB(rows, basis.size());
+    DispatchK(n-1, [&](auto kernels) {
+        Pool::ParallelFor((rows + blockSize - 1)/blockSize, 
+            [&](const std::size_t block) {
+                const std::size_t start = block*blockSize;
+                const std::size_t count = std::min(blockSize, rows - start);
+                DMatrix kernel(count, DictionarySize(dictionaryB));
+                decltype(kernels)::FockBlock(dictionaryA, start, dictionaryB,
+                                             n-1, type, kernel);
+                kTimesB.middleRows(start, count) = kernel*coeffsB;
+            });
+        });
+    DMatrix contracted = coeffsA.transpose()*kTimesB;
+
+    // the prefactors and degeneracies from MatrixTerm_Direct
+    const coeff_class prefactor = Prefactor(basis[0], basis[0], type);
+    std::vector<coeff_class> scaleA(basis.size()), scaleB(basis.size());
+    for (std::size_t i = 0; i < basis.size(); ++i) {
+        scaleA[i] = basis[i].Coeff();
+        scaleB[i] = Factorial(n)*basis[i].Coeff()*prefactor;
+        for (auto& count : basis[i].CountIdentical()) {
+            scaleB[i] *= Factorial(count);
+        }
+    }
+
+    DMatrix fockPart(basis.size(), basis.size());
+    for (std::size_t i = 0; i < basis.size(); ++i) {
+        for (std::size_t j = i; j < basis.size(); ++j) {
+            fockPart(i, j) = scaleA[i]*scaleB[j]*contracted(i, j);
+            fockPart(j, i) = fockPart(i, j);
+        }
+    }
+    return fockPart;
+}
+
+// a rough guess at the relative cost of MatrixTerm(A, B, type): each distinct
+// permutation of B gets combined with A, and the number of terms in each F 
+// grows quickly with the transverse momentum (from the y -> yTilde transform)
+// and more slowly with the minus momentum
+builtin_class PairCost(const Mono& A, const Mono& B, const MATRIX_TYPE type) {
+    auto permutations = [](const Mono& m) {
+        builtin_class distinct = Factorial(m.NParticles());
+        for (auto& count : m.CountIdentical()) distinct /= Factorial(count);
+        return distinct;
+    };
+    auto termGuess = [](const Mono& m) {
+        return (1.0 + m.TotalPt()*m.TotalPt()) * (1.0 + m.TotalPm());
+    };
+    builtin_class cost = permutations(B) * termGuess(A) * termGuess(B);
+    // the interactions aren't symmetric, so A is permuted as well
+    if (type == MAT_INTER_SAME_N || type == MAT_INTER_N_PLUS_2) {
+        cost *= permutations(A);
+    }
+    return cost;
+}
+
+// the indices of costs, from the most expensive to the cheapest (ties stay in
+// their original order)
+std::vector<std::size_t> LargestFirst(const std::vector<builtin_class>& costs) {
+    std::vector<std::size_t> order(costs.size());
+    for (std::size_t k = 0; k < order.size(); ++k) order[k] = k;
+    std::stable_sort(order.begin(), order.end(),
+            [&costs](std::size_t a, std::size_t b){ return costs[a] > costs[b]; });
+    return order;
+}
+
 coeff_class MatrixTerm(const Mono& A, const Mono& B, const MATRIX_TYPE type) {
     if (type == MAT_INNER || type == MAT_MASS) {
         return MatrixTerm_Direct(A, B, type);
@@ -191,23 +391,72 @@ coeff_class MatrixTerm(const Mono& A, const Mono& B, const MATRIX_TYPE type) {
 
 DMatrix MatrixBlock(const Mono& A, const Mono& B, const MATRIX_TYPE type,
         const std::size_t partitions) {
+    if (type == MAT_INTER_SAME_N || type == MAT_INTER_N_PLUS_2) {
+        MuContraction plan(type, partitions);
+        for (const auto& term : InteractionTerms(A, B, type, std::cout)) {
+            plan.Add(0, term.first, term.second);
+        }
+        const DMatrix blocks = plan.Evaluate(1);
+        return Eigen::Map<const DMatrix>(blocks.data(), partitions, partitions);
+    } else {
+        return MatrixTerm(A, B, type)*MuPart(partitions, type);
+    }
+}
+
+// Each pair's Fock space part is done by its own task, in order of decreasing
+// PairCost as in FockMatrix_Pairwise. The terms are kept until every pair is
+// done, then printed and added to the plan in the order of pairs, so the output
+// is exactly the same as doing the pairs one at a time.
+void PlanBlocks(const Basis<Mono>& basisA, const Basis<Mono>& basisB,
+        const std::vector<std::pair<std::size_t,std::size_t>>& pairs,
+        const MATRIX_TYPE type, MuContraction& plan, std::ostream& log) {
+    std::vector<builtin_class> costs;
+    costs.reserve(pairs.size());
+    for (const auto& pair : pairs) {
+        costs.push_back(PairCost(basisA[pair.first], basisB[pair.second], type));
+    }
+    const std::vector<std::size_t> order = LargestFirst(costs);
+
+    std::vector<std::vector<std::pair<MuContraction::Key, coeff_class>>> 
+        terms(pairs.size());
+    std::vector<std::string> logs(pairs.size());
+    Pool::ParallelFor(order.size(), [&](const std::size_t k) {
+            const std::size_t p = order[k];
+            std::ostringstream pairLog;
+            pairLog.copyfmt(log);
+            terms[p] = InteractionTerms(basisA[pairs[p].first], 
+                                        basisB[pairs[p].second], type, pairLog);
+            logs[p] = pairLog.str();
+        });
+
+    for (std::size_t p = 0; p < pairs.size(); ++p) {
+        log << logs[p] << std::flush;
+        for (const auto& term : terms[p]) plan.Add(p, term.first, term.second);
+    }
+}
+
+// do the Fock space part of the interaction block for A and B, returning the
+// keys of the mu parts it needs (see MuContraction) with their coefficients; 
+// the terms are also written to log
+std::vector<std::pair<MuContraction::Key, coeff_class>> InteractionTerms(
+        const Mono& A, const Mono& B, const MATRIX_TYPE type, 
+        std::ostream& log) {
+    const char n = A.NParticles();
+    std::vector<std::pair<MuContraction::Key, coeff_class>> output;
     if (type == MAT_INTER_SAME_N) {
         NtoN_Final terms = MatrixTerm_NtoN(A, B);
-        DMatrix output = DMatrix::Zero(partitions, partitions);
-        std::cout << "NtoN terms for " << A << " x " << B << ":\n";
+        log << "NtoN terms for " << A << " x " << B << ":\n";
         for (auto& term : terms) {
             // if (!std::isfinite(static_cast<builtin_class>(newTerm.second))) {
                 // std::cerr << "Error: term (" << newTerm.first << ", " 
                     // << newTerm.second << ") is not finite." << std::endl;
             // }
-            std::cout << "(" << term.first << ", " << term.second << ")" 
-                << std::endl;
-            output += term.second*MuPart_NtoN(A.NParticles(), term.first, 
-                                              partitions);
+            log << "(" << term.first << ", " << term.second << ")" << "\n";
+            output.emplace_back(MuContraction::Key{{n, term.first[0], 
+                                                   term.first[1]}},
+                                term.second);
         }
-        return output;
     } else if (type == MAT_INTER_N_PLUS_2) {
-        const char n = A.NParticles();
         auto terms = MatrixTerm_NPlus2(A, B);
         // algebraically add terms by r exponent before doing the discretization
         std::unordered_map<char, coeff_class> addedTerms;
@@ -219,19 +468,53 @@ DMatrix MatrixBlock(const Mono& A, const Mono& B, const MATRIX_TYPE type,
             }
         }
 
-        DMatrix output = DMatrix::Zero(partitions, partitions);
-        std::cout << "N+2 terms for " << A << " x " << B << ":\n";
+        log << "N+2 terms for " << A << " x " << B << ":\n";
         for (const auto& term : addedTerms) {
-            std::cout << term.second << " * (" << (int)n << ", " << 
-                (int)term.first << ")" << std::endl;
-            output += term.second
-                    * MuPart_NPlus2(std::array<char,2>{{n, term.first}}, 
-                                    partitions);
+            log << term.second << " * (" << (int)n << ", " << 
+                (int)term.first << ")" << "\n";
+            output.emplace_back(MuContraction::Key{{n, term.first, 0}},
+                                term.second);
         }
-        return output;
     } else {
-        return MatrixTerm(A, B, type)*MuPart(partitions, type);
+        throw std::logic_error("InteractionTerms: not an interaction matrix "
+                               "type");
     }
+    return output;
+}
+
+MuContraction::MuContraction(const MATRIX_TYPE type, 
+                             const std::size_t partitions):
+    type(type), partitions(partitions) {
+}
+
+void MuContraction::Add(const std::size_t block, const Key& key, 
+                        const coeff_class coeff) {
+    auto index = keyIndices.emplace(key, keys.size());
+    if (index.second) keys.push_back(key);
+    triplets.emplace_back(index.first->second, block, coeff);
+}
+
+// each M is computed by its own task, so the slow hypergeometric functions in
+// the mu parts are spread over all of the threads; the sums over keys are then
+// a single sparse product, and don't depend on the number of threads
+DMatrix MuContraction::Evaluate(const std::size_t numBlocks) const {
+    const std::size_t blockSize = partitions*partitions;
+    DMatrix muParts(blockSize, keys.size());
+    Pool::ParallelFor(keys.size(), [&](const std::size_t k) {
+            const Key& key = keys[k];
+            std::shared_ptr<const DMatrix> muPart;
+            if (type == MAT_INTER_SAME_N) {
+                muPart = MuPart_NtoN(key[0], {{key[1], key[2]}}, partitions);
+            } else {
+                muPart = MuPart_NPlus2({{key[0], key[1]}}, partitions);
+            }
+            muParts.col(k) = Eigen::Map<const DVector>(muPart->data(), 
+                                                       blockSize);
+        });
+
+    SMatrix coeffs(keys.size(), numBlocks);
+    coeffs.setFromTriplets(triplets.begin(), triplets.end());
+    return muParts*coeffs;
 }
 
 coeff_class MatrixTerm_Direct(const Mono& A, const Mono& B, const MATRIX_TYPE type) {
@@ -247,19 +530,15 @@ coeff_class MatrixTerm_Direct(const Mono& A, const Mono& B, const MATRIX_TYPE ty
 
     coeff_class prefactor = degeneracy*A.Coeff()*B.Coeff()*Prefactor(A, B, type);
 
+    // orders of B in the same orbit give the same integrals; see DirectOrbits
     std::string xAndy_A = ExtractXY(A);
-    std::string xAndy_B = ExtractXY(B);
-    std::vector<MatrixTerm_Final> fFromA, fFromB, combinedFs;
+    auto fFromA = DirectTermsFromXY(xAndy_A);
 
     coeff_class total = 0;
-    // do {
-    fFromA = DirectTermsFromXY(xAndy_A);
-    do {
-        fFromB = DirectTermsFromXY(xAndy_B);
-        combinedFs = CombineTwoFs(fFromA, fFromB);
-        total += FinalResult(combinedFs, type);
-    } while (PermuteXY(xAndy_B));
-    // } while (PermuteXY(xAndy_A));
+    for (const XYOrbit& orbit : DirectOrbits(xAndy_A, B)) {
+        auto fFromB = DirectTermsFromXY(orbit.xAndy);
+        total += orbit.multiplicity*DirectResult(*fFromA, *fFromB, type);
+    }
 
     return prefactor*total;
 }
@@ -279,33 +558,34 @@ NtoN_Final MatrixTerm_NtoN(const Mono& A, const Mono& B) {
     coeff_class prefactor = degeneracy*A.Coeff()*B.Coeff()
                           * Prefactor(A, B, MAT_INTER_SAME_N);
 
+    // unlike the direct integrals, these aren't symmetric under permutations
+    // of the particles, so every pair of orders has to be done; the terms for
+    // B's orders are looked up once rather than once per order of A
     std::string xAndy_A = ExtractXY(A);
     std::string xAndy_B = ExtractXY(B);
-    std::vector<MatrixTerm_Intermediate> fFromA, fFromB;
-    std::vector<InteractionTerm_Step2> combinedFs;
+    std::vector<std::shared_ptr<const TermList>> fFromBs;
+    for (const auto& order : *ParticleOrders(B)) {
+        fFromBs.push_back(InteractionTermsFromXY(ArrangeXY(xAndy_B, order)));
+    }
     NtoN_Final output;
-    do {
-        fFromA = InteractionTermsFromXY(xAndy_A);
-        do {
-            fFromB = InteractionTermsFromXY(xAndy_B);
-            combinedFs = CombineInteractionFs(fFromA, fFromB);
-
-            auto newTerms = InteractionOutput(combinedFs, prefactor);
+    for (const auto& orderA : *ParticleOrders(A)) {
+        auto fFromA = InteractionTermsFromXY(ArrangeXY(xAndy_A, orderA));
+        for (const auto& fFromB : fFromBs) {
+            auto newTerms = InteractionResult(*fFromA, *fFromB, prefactor);
             for (const auto& newTerm : newTerms) {
                 // if (!std::isfinite(static_cast<builtin_class>(newTerm.second))) {
                     // std::cerr << "Error: term (" << newTerm.first << ", " 
                         // << newTerm.second << ") is not finite." << std::endl;
                 // }
-                if (output.count(newTerm.first) == 0) {
+                auto existing = output.find(newTerm.first);
+                if (existing == output.end()) {
                     output.insert(newTerm);
-                    // output.emplace(newTerm.first, newTerm.second);
                 } else {
-                    output[newTerm.first] += newTerm.second;
+                    existing->second += newTerm.second;
                 }
             }
-            // output.insert(output.end(), newTerms.begin(), newTerms.end());
-        } while (PermuteXY(xAndy_B));
-    } while (PermuteXY(xAndy_A));
+        }
+    }
     
     return output;
 }
@@ -327,20 +607,21 @@ std::vector<NPlus2Term_Output> MatrixTerm_NPlus2(const Mono& A, const Mono& B) {
     coeff_class prefactor = degeneracy*A.Coeff()*B.Coeff()
         * Prefactor(A, B, MAT_INTER_N_PLUS_2);
 
+    // as in MatrixTerm_NtoN, every pair of orders has to be done
     std::string xAndy_A = ExtractXY(A);
     std::string xAndy_B = ExtractXY(B);
-    std::vector<MatrixTerm_Intermediate> fFromA, fFromB;
-    std::vector<NPlus2Term_Step2> combinedFs;
+    std::vector<std::shared_ptr<const TermList>> fFromBs;
+    for (const auto& order : *ParticleOrders(B)) {
+        fFromBs.push_back(InteractionTermsFromXY(ArrangeXY(xAndy_B, order)));
+    }
     std::vector<NPlus2Term_Output> output;
-    do {
-        fFromA = InteractionTermsFromXY(xAndy_A);
-        do {
-            fFromB = InteractionTermsFromXY(xAndy_B);
-            combinedFs = CombineNPlus2Fs(fFromA, fFromB);
-            auto newTerms = NPlus2Output(combinedFs, prefactor);
+    for (const auto& orderA : *ParticleOrders(A)) {
+        auto fFromA = InteractionTermsFromXY(ArrangeXY(xAndy_A, orderA));
+        for (const auto& fFromB : fFromBs) {
+            auto newTerms = NPlus2Result(*fFromA, *fFromB, prefactor);
             output.insert(output.end(), newTerms.begin(), newTerms.end());
-        } while (PermuteXY(xAndy_B));
-    } while (PermuteXY(xAndy_A));
+        }
+    }
     
     return output;
 }
@@ -377,41 +658,95 @@ bool PermuteXY(std::string& xAndy) {
     return false;
 }
 
-const std::vector<MatrixTerm_Final>& DirectTermsFromXY(const std::string& xAndy)
-{
-    if (directCache.count(xAndy) == 0) {
-        // copy so we can break it in the next function
-        std::vector<MatrixTerm_Intermediate> intermediate 
-            = InteractionTermsFromXY(xAndy);
-        directCache.emplace(xAndy, ThetaFromYTilde(intermediate));
-    }
+// the distinct orderings of mono's particles, each given as the list of which
+// particle goes in each position. These only depend on which particles are
+// identical, so they're shared by every monomial with the same 
+// PermutationVector(); since identical particles are adjacent in an ordered
+// Mono, that vector is sorted and next_permutation gives every order once
+std::shared_ptr<const std::vector<std::vector<char>>> ParticleOrders(
+        const Mono& mono) {
+    std::vector<size_t> pattern = mono.PermutationVector();
+    return ordersCache.Get(pattern, [&pattern]() {
+            std::vector<char> order(pattern.begin(), pattern.end());
+            std::vector<std::vector<char>> orders;
+            do {
+                orders.push_back(order);
+            } while (std::next_permutation(order.begin(), order.end()));
+            return orders;
+        });
+}
 
-    return directCache[xAndy];
+// xAndy with its particles put in the given order
+std::string ArrangeXY(const std::string& xAndy, const std::vector<char>& order) {
+    const std::size_t n = order.size();
+    std::string output(2*n, 0);
+    for (std::size_t i = 0; i < n; ++i) {
+        output[i] = xAndy[order[i]];
+        output[n + i] = xAndy[n + order[i]];
+    }
+    return output;
 }
 
-const std::vector<MatrixTerm_Intermediate>& InteractionTermsFromXY(
-        const std::string& xAndy) {
-    if (intermediateCache.count(xAndy) == 0) {
-        std::string x(xAndy.begin(), xAndy.begin() + xAndy.size()/2);
-        std::string y(xAndy.begin() + xAndy.size()/2, xAndy.end());
-        std::vector<char> uFromX(UFromX(x));
-        std::vector<MatrixTerm_Intermediate> terms(YTildeFromY(y));
-        for (auto& term : terms) {
-            if (term.uPlus.size() < uFromX.size()/2) {
-                term.uPlus.resize(uFromX.size()/2, 0);
-                term.uMinus.resize(uFromX.size()/2, 0);
-                term.yTilde.resize(uFromX.size()/2, 0);
-            }
-            for (std::size_t i = 0; i < term.uPlus.size(); ++i) {
-                term.uPlus[i] += uFromX[i];
-                term.uMinus[i] += uFromX[term.uPlus.size() + i];
-                // term.coeff *= std::pow(std::sqrt(2), term.uPlus[i] + term.uMinus[i]);
-            }
+// the direct integrals depend on the orders of A and B only through the sums
+// of their (x,y) exponents particle by particle, and don't change if the
+// summed particles are permuted. Two orders of B are therefore equivalent if
+// they give the same multiset of summed exponents; these are the orbits of the
+// identical-particle symmetries of A, plus any accidental coincidences
+std::vector<XYOrbit> DirectOrbits(const std::string& xAndy_A, const Mono& B) {
+    const std::string xAndy_B = ExtractXY(B);
+    const std::size_t n = B.NParticles();
+    if (xAndy_A.size() != 2*n) {
+        throw std::logic_error("DirectOrbits: A and B have different n");
+    }
+
+    std::vector<XYOrbit> orbits;
+    std::unordered_map<std::string, std::size_t> orbitIndices;
+    std::vector<std::array<char,2>> sums(n);
+    std::string key(2*n, 0);
+    for (const auto& order : *ParticleOrders(B)) {
+        for (std::size_t i = 0; i < n; ++i) {
+            sums[i][0] = xAndy_A[i] + xAndy_B[order[i]];
+            sums[i][1] = xAndy_A[n + i] + xAndy_B[n + order[i]];
+        }
+        std::sort(sums.begin(), sums.end());
+        for (std::size_t i = 0; i < n; ++i) {
+            key[2*i] = sums[i][0];
+            key[2*i + 1] = sums[i][1];
+        }
+        auto index = orbitIndices.emplace(key, orbits.size());
+        if (index.second) {
+            orbits.push_back({ArrangeXY(xAndy_B, order), 1});
+        } else {
+            ++orbits[index.first->second].multiplicity;
         }
-        intermediateCache.emplace(xAndy, std::move(terms));
     }
+    return orbits;
+}
 
-    return intermediateCache[xAndy];
+std::shared_ptr<const TermList> DirectTermsFromXY(const std::string& xAndy) {
+    return directCache.Get(xAndy, [&xAndy]() {
+            return ThetaFromYTilde(*InteractionTermsFromXY(xAndy));
+        });
+}
+
+// the terms are laid out as u+[n-1], u-[n-1], yTilde[n-1]; see YTildeFromY
+std::shared_ptr<const TermList> InteractionTermsFromXY(const std::string& xAndy) {
+    return intermediateCache.Get(xAndy, [&xAndy]() {
+            std::string x(xAndy.begin(), xAndy.begin() + xAndy.size()/2);
+            std::string y(xAndy.begin() + xAndy.size()/2, xAndy.end());
+            std::vector<char> uFromX(UFromX(x));
+            TermList terms(YTildeFromY(y));
+            // the u+ and u- are the first 2(n-1) exponents, in the same order
+            // as in uFromX
+            for (std::size_t t = 0; t < terms.size(); ++t) {
+                char* u = terms.Exponents(t);
+                for (std::size_t i = 0; i < uFromX.size(); ++i) {
+                    u[i] += uFromX[i];
+                    // term.coeff *= std::pow(std::sqrt(2), term.uPlus[i] + term.uMinus[i]);
+                }
+            }
+            return terms;
+        });
 }
 
 // exponent transformations ---------------------------------------------------
@@ -467,9 +802,14 @@ std::vector<char> UFromX(const std::string& x) {
 // u biproducts in addition to the yTilde that you want, but worst of all it has
 // two terms, so you end up with a sum of return terms, each with some 
 // binomial-derived coefficient.
-std::vector<MatrixTerm_Intermediate> YTildeFromY(const std::string& y) {
-    //std::cout << "Transforming this y: " << y << std::endl;
-    std::vector<MatrixTerm_Intermediate> ret;
+TermList YTildeFromY(const std::string& y) {
+    // the terms are polynomials in the k = n-1 u+, then the u-, then the yTilde
+    const std::size_t k = y.size() - 1;
+    SparsePoly ret(3*k);
+    // the interaction integrals don't use the coefficients, so they need to 
+    // know how many terms were collected into each one instead: that's the
+    // same polynomial with all of the coefficients set to 1
+    SparsePoly counts(3*k);
     // i here is the i'th particle (pair); each one only sees those whose
     // numbers are lower, so we can treat them using lower particle numbers
     //
@@ -480,109 +820,131 @@ std::vector<MatrixTerm_Intermediate> YTildeFromY(const std::string& y) {
     // we begin with y_n because it's different from the others; it's restricted
     // to be the negative sum of all other y_i, so we can replace it directly at
     // the beginning; sadly this produces a bunch of terms
-    std::vector<YTerm> yTerms = EliminateYn(y);
-    //std::cout << "yTerms: " << std::endl;
-    //for (const auto& yTerm : yTerms) std::cout << yTerm << std::endl;
-    
-    for (const YTerm& yTerm : yTerms) {
-        std::vector<MatrixTerm_Intermediate> termsFromThisYTerm;
+    const SparsePoly yTerms = EliminateYn(y);
+    for (std::size_t t = 0; t < yTerms.size(); ++t) {
+        const char* yExponents = yTerms.Exponents(t);
         // y_1 handled separately because it doesn't need multinomials. We 
         // always do this step even if yTerm[0] == 0 because it puts the
         // coefficient in and provides somewhere for the other terms to combine
-        termsFromThisYTerm.emplace_back(1);
-        termsFromThisYTerm.back().coeff = yTerm.coeff;
-        termsFromThisYTerm.back().uPlus[0] = yTerm[0];
-        termsFromThisYTerm.back().uMinus[0] = yTerm[0];
-        termsFromThisYTerm.back().yTilde[0] = yTerm[0];
+        std::string first(3*k, 0);
+        first[0] = yExponents[0];
+        first[k] = yExponents[0];
+        first[2*k] = yExponents[0];
+        SparsePoly termsFromThisYTerm(first, yTerms.Coeff(t));
+        SparsePoly countsFromThisYTerm(first, 1);
 
         // terms between y_2 and y_{n-1}, inclusive (beware 1- vs 0-indexing)
-        for (auto i = 1u; i < yTerm.size(); ++i) {
-            if (yTerm[i] == 0) continue;
-            std::vector<MatrixTerm_Intermediate> termsFromThisY;
-            for (char l = 0; l <= yTerm[i]; ++l) {
-                for (const auto& nAndm : Multinomial::GetMVectors(i, yTerm[i]-l)) {
-                    std::vector<MatrixTerm_Intermediate> newTerms(
-                                    YTildeTerms(i, yTerm[i], l, nAndm) );
-                    termsFromThisY.insert(termsFromThisY.end(),
-                                    newTerms.begin(), newTerms.end());
-                    //ret.insert(ret.end(), newTerms.begin(), newTerms.end());
+        for (auto i = 1u; i < k; ++i) {
+            const char a = yExponents[i];
+            if (a == 0) continue;
+            SparsePoly termsFromThisY(3*k);
+            SparsePoly countsFromThisY(3*k);
+            for (char l = 0; l <= a; ++l) {
+                for (const auto& nAndm : Multinomial::GetMVectors(i, a-l)) {
+                    YTildeTerms(i, a, l, nAndm, k, termsFromThisY, 
+                                countsFromThisY);
                 }
             }
-            termsFromThisYTerm = MultiplyIntermediateTerms(
-                            termsFromThisYTerm, termsFromThisY );
+            termsFromThisYTerm *= termsFromThisY;
+            countsFromThisYTerm *= countsFromThisY;
         }
-        //std::cout << "Transformed " << yTerm << " into these:" << std::endl;
-        //for (auto& term : termsFromThisYTerm) std::cout << term << std::endl;
-        ret.insert(ret.end(), termsFromThisYTerm.begin(),
-                        termsFromThisYTerm.end() );
+        ret += termsFromThisYTerm;
+        counts += countsFromThisYTerm;
     }
 
-    //std::cout << "Got these:" << std::endl;
-    //for (auto& term : ret) std::cout << term << std::endl;
-
-    return ret;
+    return PackIntermediate(ret, counts);
 }
 
-std::vector<YTerm> EliminateYn(const std::string& y) {
-    std::vector<YTerm> output;
+// the y_i with y_n replaced by minus the sum of the others, as a polynomial in
+// y_1 through y_{n-1}
+SparsePoly EliminateYn(const std::string& y) {
+    SparsePoly output(y.size()-1);
+    std::string exponents(y.size()-1, 0);
     for (auto nAndm : Multinomial::GetMVectors(y.size()-1, y.back())) {
         coeff_class coeff = Multinomial::Lookup(y.size()-1, nAndm);
         if (y.back() % 2 == 1) coeff = -coeff;
         do {
-                output.emplace_back(coeff, y, nAndm);
+            for (std::size_t i = 0; i < exponents.size(); ++i) {
+                exponents[i] = y[i] + nAndm[i+1];
+            }
+            output.Add(exponents, coeff);
         } while (std::prev_permutation(nAndm.begin()+1, nAndm.end()));
     }
     return output;
 }
 
 // i is the y from y_i; a is the exponent of y_i; l is a binomial index; nAndm
-// is a multinomial vector with total order a-l
-std::vector<MatrixTerm_Intermediate> YTildeTerms(
-		const unsigned int i, const char a, const char l, std::string nAndm) {
-    std::vector<MatrixTerm_Intermediate> ret;
-
-    coeff_class coeff = YTildeCoefficient(a, l, nAndm);
+// is a multinomial vector with total order a-l. The resulting terms, which are
+// polynomials in k each of u+, u- and yTilde, are added to terms (and to 
+// counts with coefficient 1)
+void YTildeTerms(const unsigned int i, const char a, const char l, 
+        std::string nAndm, const std::size_t k, SparsePoly& terms,
+        SparsePoly& counts) {
+    const coeff_class coeff = YTildeCoefficient(a, l, nAndm);
+    std::string exponents(3*k, 0);
     do {
-        ret.emplace_back(i+1);
         for (auto j = 0u; j <= i-1; ++j) {
-            ret.back().uPlus[j] = nAndm[j+1];
-            ret.back().yTilde[j] = nAndm[j+1];
-            ret.back().uMinus[j] = a;
-            // for (auto k = j+1; k < i; ++k) {
-            for (auto k = 0u; k < j; ++k) {
-                ret.back().uMinus[j] += nAndm[k+1];
-                // ret.back().uMinus[k] += nAndm[j+1];
+            exponents[j] = nAndm[j+1];
+            exponents[2*k + j] = nAndm[j+1];
+            exponents[k + j] = a;
+            for (auto m = 0u; m < j; ++m) {
+                exponents[k + j] += nAndm[m+1];
             }
         }
-        ret.back().uPlus[i] = 2*a - l;
-        ret.back().uMinus[i] = l;
-        ret.back().yTilde[i] = l;
-
-        ret.back().coeff = coeff;
+        exponents[i] = 2*a - l;
+        exponents[k + i] = l;
+        exponents[2*k + i] = l;
+        terms.Add(exponents, coeff);
+        counts.Add(exponents, 1);
     } while (std::prev_permutation(nAndm.begin()+1, nAndm.end()));
-    return ret;
 }
 
-std::vector<MatrixTerm_Intermediate> MultiplyIntermediateTerms(
-		const std::vector<MatrixTerm_Intermediate>& termsA, 
-		const std::vector<MatrixTerm_Intermediate>& termsB) {
-    if (termsA.size() == 0 || termsB.size() == 0) {
-        std::cerr << "Warning: asked to multiply two term lists but one was "
-            << "empty. A: " << termsA.size() << "; B: " << termsB.size() << "." 
-            << std::endl;
-        return termsA.size() == 0 ? termsB : termsA;
+// the terms of a polynomial in k each of u+, u- and yTilde, along with the
+// number of terms collected into each. Every term in counts is kept, even if
+// its coefficient in poly has cancelled (or was skipped because of that)
+TermList PackIntermediate(const SparsePoly& poly, const SparsePoly& counts) {
+    TermList output(counts.size(), counts.NumVars());
+    for (std::size_t t = 0; t < counts.size(); ++t) {
+        const char* exponents = counts.Exponents(t);
+        const std::size_t term = poly.Find(exponents);
+        output.Coeff(t) = term < poly.size() ? poly.Coeff(term) : 0;
+        output.Count(t) = static_cast<std::size_t>(counts.Coeff(t));
+        std::copy(exponents, exponents + counts.NumVars(), output.Exponents(t));
     }
-    //if (termsA.size() == 0) return termsB;
-    //if (termsB.size() == 0) return termsA;
-    std::vector<MatrixTerm_Intermediate> output;
-    for (const auto& termA : termsA) {
-        for (const auto& termB : termsB) {
-            output.push_back(termA * termB);
-        }
+    return output;
+}
+
+// the same, for terms which have already been unpacked (e.g. in the tests)
+TermList PackIntermediate(const std::vector<MatrixTerm_Intermediate>& terms) {
+    if (terms.empty()) return TermList();
+    const std::size_t k = terms.front().uPlus.size();
+    TermList output(terms.size(), 3*k);
+    for (std::size_t t = 0; t < terms.size(); ++t) {
+        output.Coeff(t) = terms[t].coeff;
+        output.Count(t) = terms[t].count;
+        char* exponents = output.Exponents(t);
+        std::copy(terms[t].uPlus.begin(), terms[t].uPlus.end(), exponents);
+        std::copy(terms[t].uMinus.begin(), terms[t].uMinus.end(), 
+                  exponents + k);
+        std::copy(terms[t].yTilde.begin(), terms[t].yTilde.end(), 
+                  exponents + 2*k);
     }
     return output;
 }
 
+MatrixTerm_Intermediate UnpackIntermediate(const TermList& terms, 
+        const std::size_t term) {
+    const std::size_t k = terms.Width()/3;
+    const char* exponents = terms.Exponents(term);
+    MatrixTerm_Intermediate output;
+    output.coeff = terms.Coeff(term);
+    output.count = terms.Count(term);
+    output.uPlus.assign(exponents, exponents + k);
+    output.uMinus.assign(exponents + k, exponents + 2*k);
+    output.yTilde.assign(exponents + 2*k, exponents + 3*k);
+    return output;
+}
+
 // the coefficient of a YTildeTerm, i.e. everything that's not a u or yTilde
 coeff_class YTildeCoefficient(const char a, const char l, 
 		const std::string& nAndm) {
@@ -595,284 +957,156 @@ coeff_class YTildeCoefficient(const char a, const char l,
 
 // convert from y-tilde to sines and cosines of theta following (4.32).
 //
-// returned vector has sines of all components in order followed by all cosines
-std::vector<MatrixTerm_Final> ThetaFromYTilde(
-        std::vector<MatrixTerm_Intermediate>& intermediateTerms) {
-    std::vector<MatrixTerm_Final> ret;
+// the returned terms are in the direct layout of kernels.hpp: the u's are
+// followed by the sines of all components in order, then all of the cosines
+TermList ThetaFromYTilde(const TermList& intermediateTerms) {
+    const std::size_t k = intermediateTerms.Width()/3;
+    if (k == 0) return TermList();
+
+    // terms whose coefficients cancelled are only kept for their counts
+    std::size_t numTerms = 0;
+    for (std::size_t t = 0; t < intermediateTerms.size(); ++t) {
+        if (intermediateTerms.Coeff(t) != 0) ++numTerms;
+    }
 
-    for (auto& term : intermediateTerms) {
+    TermList ret(numTerms, 4*k - 2);
+    std::size_t out = 0;
+    for (std::size_t t = 0; t < intermediateTerms.size(); ++t) {
+        if (intermediateTerms.Coeff(t) == 0) continue;
+        const char* term = intermediateTerms.Exponents(t);
+        const char* yTilde = term + 2*k;
+        char* exponents = ret.Exponents(out);
+        ret.Coeff(out) = intermediateTerms.Coeff(t);
+        ret.Count(out) = intermediateTerms.Count(t);
+        ++out;
+
+        std::copy(term, term + 2*k, exponents);
         // sine[i] appears in all yTilde[j] with j > i (strictly greater)
-        std::vector<char> sines(term.yTilde.size()-1, 0);
-        for (auto i = 0u; i < sines.size(); ++i) {
-            for (auto j = i+1; j < term.yTilde.size(); ++j) {
-                sines[i] += term.yTilde[j];
-            }
+        char* sines = exponents + 2*k;
+        for (std::size_t i = 0; i+1 < k; ++i) {
+            for (std::size_t j = i+1; j < k; ++j) sines[i] += yTilde[j];
         }
-        term.yTilde.resize(term.yTilde.size()-1); // so it can become "cosines"
-        ret.emplace_back(term.coeff,
-                std::move(term.uPlus), 
-                std::move(term.uMinus),
-                std::move(sines),
-                std::move(term.yTilde) );
+        // all but the last yTilde become the cosines
+        std::copy(yTilde, yTilde + k - 1, sines + k - 1);
     }
 
     return ret;
 }
 
 // combines two u-and-theta coordinate wavefunctions (called F in Zuhair's
-// notes), each corresponding to one monomial. Each is a sum over many terms, so
-// combining them involves multiplying out two sums.
-std::vector<MatrixTerm_Final> CombineTwoFs(const std::vector<MatrixTerm_Final>& F1,
-		const std::vector<MatrixTerm_Final>& F2) {
-    /*std::cout << "Combining two Fs with sizes " << F1.size() << " and " 
-            << F2.size() << std::endl;*/
-    std::vector<MatrixTerm_Final> ret;
-    for (auto& term1 : F1) {
-        for (auto& term2 : F2) {
-            ret.emplace_back(term1.coeff * term2.coeff,
-                    AddVectors(term1.uPlus, term2.uPlus),
-                    AddVectors(term1.uMinus, term2.uMinus),
-                    AddVectors(term1.sinTheta, term2.sinTheta),
-                    AddVectors(term1.cosTheta, term2.cosTheta));
-        }
+// notes), each corresponding to one monomial, and does the integrals over the
+// product; the actual work is done by Kernels<K>::DirectResult
+coeff_class DirectResult(const TermList& F1, const TermList& F2, 
+        const MATRIX_TYPE type) {
+    if (F1.empty() || F2.empty()) {
+        std::cerr << "No exponents detected; returning 1." << std::endl;
+        return 1;
     }
-    //std::cout << "Combined Fs has " << ret.size() << " terms." << std::endl;
-    return ret;
+    return DispatchK((F1.Width() + 2)/4, [&](auto kernels) {
+            return decltype(kernels)::DirectResult(F1, F2, type);
+        });
 }
 
+// all of the terms of F1*F2 which survive the r integral, unpacked; the 
+// coefficient of each is the number of uncollected pairs of terms giving its
+// exponents
 std::vector<InteractionTerm_Step2> CombineInteractionFs(
         const std::vector<MatrixTerm_Intermediate>& F1, 
         const std::vector<MatrixTerm_Intermediate>& F2) {
+    if (F1.empty() || F2.empty()) return {};
+    const std::size_t k = F1.front().uPlus.size();
+    const TermList packed1 = PackIntermediate(F1);
+    const TermList packed2 = PackIntermediate(F2);
+    const SparsePoly combined = DispatchK(k, [&](auto kernels) {
+            return decltype(kernels)::CombineInteractionFs(packed1, packed2);
+        });
+
+    const std::size_t uSize = 2*k + 2;
+    const std::size_t thetaSize = k >= 2 ? 2*k - 4 : 0;
     std::vector<InteractionTerm_Step2> output;
-    for (const auto& f1 : F1) {
-        for (const auto& f2 : F2) {
-            output.push_back(CombineInteractionFs_OneTerm(f1, f2));
-        }
-    }
-    // terms with odd powers of r will eventually integrate to 0 so ditch them
-    // output.erase(std::remove_if(output.begin(), output.end(),
-                // [](const InteractionTerm_Step2& term){return term.r[0]%2 == 1;}),
-            // output.end());
-    // TODO: verify that this variant targeting all odd powers is legitimate,
-    //        and make sure it's not safe to delete odd r[0] as well
-    output.erase(std::remove_if(output.begin(), output.end(),
-                [](const InteractionTerm_Step2& term)
-                {return term.r[1]%2 == 1 || term.r[2]%2 == 1;}),
-            output.end());
-    return output;
-}
-
-InteractionTerm_Step2 CombineInteractionFs_OneTerm(
-        const MatrixTerm_Intermediate& f1, const MatrixTerm_Intermediate& f2) {
-    InteractionTerm_Step2 output;
-    output.coeff = f1.coeff * f2.coeff;
-
-    output.u.resize(f1.uPlus.size() + f1.uMinus.size() + 2);
-    for (std::size_t i = 0; i < f1.uPlus.size()-1; ++i) {
-        output.u[2*i] = f1.uPlus[i] + f2.uPlus[i];
-        output.u[2*i + 1] = f1.uMinus[i] + f2.uMinus[i];
-    }
-    output.u[output.u.size() - 4] = f1.uPlus.back();
-    output.u[output.u.size() - 3] = f1.uMinus.back();
-    output.u[output.u.size() - 2] = f2.uPlus.back();
-    output.u[output.u.size() - 1] = f2.uMinus.back();
-
-    // if n >= 3, do this; for n == 2, theta is empty and r doesn't matter
-    if (f1.yTilde.size() >= 2) {
-        output.theta.resize(f1.yTilde.size()-2 + f2.yTilde.size()-2, 0);
-        // sine[i] appears in all yTilde[j] with j > i (strictly greater)
-        for (auto i = 0u; i < f1.yTilde.size()-2; ++i) {
-            for (auto j = i+1; j < f1.yTilde.size()-1; ++j) {
-                output.theta[2*i] += f1.yTilde[j] + f2.yTilde[j];
-            }
-            output.theta[2*i + 1] = f1.yTilde[i] + f2.yTilde[i];
-        }
-
-        output.alpha = 0;
-        output.r[0] = 0;
-        for (std::size_t i = 0; i < f1.yTilde.size()-1; ++i) {
-            output.alpha += f2.yTilde[i];
-            output.r[0] += f1.yTilde[i] + f2.yTilde[i];
-        }
-        output.r[1] = f1.yTilde.back();
-        output.r[2] = f2.yTilde.back();
-    } else {
-        // set output r so that it doesn't get erased after it's returned
-        output.alpha = 0;
-        output.r = {{0, 0, 0}};
-    }
-    return output;
-}
-
-std::vector<NPlus2Term_Step2> CombineNPlus2Fs(
-        const std::vector<MatrixTerm_Intermediate>& F1, 
-        const std::vector<MatrixTerm_Intermediate>& F2) {
-    std::vector<NPlus2Term_Step2> output;
-    for (const auto& f1 : F1) {
-        for (const auto& f2 : F2) {
-            output.push_back(CombineNPlus2Fs_OneTerm(f1, f2));
+    output.reserve(combined.size());
+    for (std::size_t t = 0; t < combined.size(); ++t) {
+        const char* exponents = combined.Exponents(t);
+        output.emplace_back();
+        InteractionTerm_Step2& step2 = output.back();
+        step2.coeff = combined.Coeff(t);
+        step2.u.assign(exponents, exponents + uSize);
+        step2.theta.assign(exponents + uSize, exponents + uSize + thetaSize);
+        for (std::size_t i = 0; i < 3; ++i) {
+            step2.r[i] = exponents[uSize + thetaSize + i];
         }
+        step2.alpha = exponents[uSize + thetaSize + 3];
     }
-    // terms with odd powers of r will eventually integrate to 0 so ditch them
-    output.erase(std::remove_if(output.begin(), output.end(),
-                [](const NPlus2Term_Step2& term){return term.r%2 == 1;}),
-            output.end());
     return output;
 }
 
-NPlus2Term_Step2 CombineNPlus2Fs_OneTerm(
-        const MatrixTerm_Intermediate& f1, const MatrixTerm_Intermediate& f2) {
-    // std::cout << f1 << " |U| " << f2 << std::endl;
-
-    NPlus2Term_Step2 output;
-    output.coeff = f1.coeff * f2.coeff;
-
-    output.u.resize(f1.uPlus.size() + f1.uMinus.size() + 4);
-    for (std::size_t i = 0; i < f1.uPlus.size(); ++i) {
-        output.u[2*i] = f1.uPlus[i] + f2.uPlus[i];
-        output.u[2*i + 1] = f1.uMinus[i] + f2.uMinus[i];
-    }
-    output.u[output.u.size() - 4] = f2.uPlus [f2.uPlus .size()-2];
-    output.u[output.u.size() - 3] = f2.uMinus[f2.uMinus.size()-2];
-    output.u[output.u.size() - 2] = f2.uPlus [f2.uPlus .size()-1];
-    output.u[output.u.size() - 1] = f2.uMinus[f2.uMinus.size()-1];
-
-    output.theta.resize(f1.yTilde.size() + f2.yTilde.size() - 2, 0);
-    // sine[i] appears in all yTilde[j] with j > i (strictly greater)
-    for (std::size_t i = 0; i+2 < f1.yTilde.size(); ++i) {
-        for (auto j = i+1; j+1 < f1.yTilde.size(); ++j) {
-            output.theta[2*i] += f1.yTilde[j] + f2.yTilde[j];
-        }
-        output.theta[2*i + 1] = f1.yTilde[i] + f2.yTilde[i];
-    }
-    output.theta[output.theta.size()-2] = f2.yTilde[f2.yTilde.size()-1];
-    output.theta[output.theta.size()-1] = f2.yTilde[f2.yTilde.size()-2];
-
-    output.r = f2.yTilde[f2.yTilde.size()-2] + f2.yTilde[f2.yTilde.size()-1];
-
-    return output;
-}
-
-// WARNING: if type == MAT_MASS this changes the MatrixTerm_Final vector by
-// by changing each term's uMinus entries by -2
-coeff_class FinalResult(std::vector<MatrixTerm_Final>& exponents,
-		const MATRIX_TYPE type) {
-    if (exponents.size() == 0) {
-        std::cerr << "No exponents detected; returning 1." << std::endl;
-        return 1;
-    }
-    // auto n = exponents.front().uPlus.size() + 1;
-    coeff_class totalFromIntegrals = 0;
-    for (auto& term : exponents) {
-        if (type == MAT_INNER) {
-            // just do the integrals
-            totalFromIntegrals += DoAllIntegrals(term);
-        } else if (type == MAT_MASS) {
-            // sum over integral results for every possible 1/x
-            term.uPlus[0] -= 2;
-            totalFromIntegrals += DoAllIntegrals(term);
-            for (std::size_t i = 1; i < term.uPlus.size(); ++i) {
-                term.uPlus[i-1] += 2;
-                term.uMinus[i-1] -= 2;
-                term.uPlus[i] -= 2;
-                totalFromIntegrals += DoAllIntegrals(term);
-            }
-            term.uPlus.back() += 2;
-            term.uMinus.back() -= 2;
-            totalFromIntegrals += DoAllIntegrals(term);
-        }
-    }
-    //std::cout << "Returning FinalResult = " << totalFromIntegrals << std::endl;
-    return totalFromIntegrals;
-}
-
-// do all of the integrals which are possible before mu discretization, and
-// return an object mapping {alpha and r exponents} -> value
-//
-// WARNING: this changes combinedFs so that it can't be reused
-NtoN_Final InteractionOutput(std::vector<InteractionTerm_Step2>& combinedFs, 
-                             const coeff_class prefactor) {
-    NtoN_Final output;
-    for (auto& combinedF : combinedFs) {
-        coeff_class integralPart = prefactor*DoAllIntegrals(combinedF);
-
-        // if (!std::isfinite(static_cast<builtin_class>(integralPart))) {
-            // std::cerr << "Error: integralPart(" << combinedF.u << ", " 
-                // << combinedF.theta << ", " << prefactor << ") is not finite." 
-                // << std::endl;
-        // }
-
-        const NtoN_Final& expansion = Expand(combinedF.r, combinedF.alpha);
-        for (const auto& pair : expansion) {
-            // if (!std::isfinite(static_cast<builtin_class>(pair.second))) {
-                // std::cerr << "Error: Expand(" << combinedF.r 
-                    // << ") returns a non-finite coefficient of " << pair.first
-                    // << "." << std::endl;
-            // }
-
-            if (output.count(pair.first) == 0) {
-                output.emplace(pair.first, pair.second*integralPart);
-            } else {
-                output[pair.first] += pair.second*integralPart;
-            }
-        }
-    }
-    return output;
+// multiply out F1 and F2 and do all of the integrals which are possible before
+// mu discretization, returning an object mapping {alpha and r exponents} -> 
+// value; the work is done by Kernels<K>::CombineInteractionFs and
+// Kernels<K>::InteractionOutput
+NtoN_Final InteractionResult(const TermList& F1, const TermList& F2,
+        const coeff_class prefactor) {
+    if (F1.empty() || F2.empty()) return {};
+    return DispatchK(F1.Width()/3, [&](auto kernels) {
+            typedef decltype(kernels) Kernel;
+            return Kernel::InteractionOutput(
+                    Kernel::CombineInteractionFs(F1, F2), prefactor);
+        });
 }
 
 // do the double multinomial expansion to turn a list of exponents of 
 // {r, sqrt(1-r^2), sqrt(1-alpha^2 r^2)} into a map from exponents of 
 // {alpha^2, r} to their coefficients (both represent a single monomial which is
 // the product of its constituent powers)
-const NtoN_Final& Expand(const std::array<char,3>& r, const char alpha) {
-    static std::unordered_map<std::array<char,3>, NtoN_Final,
-                              boost::hash<std::array<char,3>> > expansionCache;
-    if (expansionCache.count(r) == 0) {
-        NtoN_Final expansion;
-
-        for (char mb = 0; mb <= r[1]/2; ++mb) {
-            for (char mc = 0; mc <= r[2]/2; ++mc) {
-                coeff_class value = Multinomial::Choose(r[1]/2, mb)
-                                  * Multinomial::Choose(r[2]/2, mc);
-                if ((mb + mc)%2 == 1) value = -value;
-
-                // if (std::isnan(static_cast<builtin_class>(value))) {
-                    // std::cerr << "Error: Expand(" << r << ", "
-                        // << std::array<char,2>{{mb, mc}} << ") has a NaN value." 
-                        // << std::endl;
-                // }
-
-
-                std::array<char,2> key{{static_cast<char>(alpha + 2*mc), 
-                                        static_cast<char>(r[0] + 2*mb + 2*mc)}};
-                expansion.emplace(key, value);
+std::shared_ptr<const NtoN_Final> Expand(const std::array<char,3>& r, 
+                                         const char alpha) {
+    static Memo::Cache<std::array<char,4>, NtoN_Final,
+                       boost::hash<std::array<char,4>> > 
+        expansionCache("MatrixInternal::Expand");
+    // alpha goes into the key too, since it shifts the output exponents
+    const std::array<char,4> cacheKey{{r[0], r[1], r[2], alpha}};
+    return expansionCache.Get(cacheKey, [&r, alpha]() {
+            NtoN_Final expansion;
+
+            for (char mb = 0; mb <= r[1]/2; ++mb) {
+                for (char mc = 0; mc <= r[2]/2; ++mc) {
+                    coeff_class value = Multinomial::Choose(r[1]/2, mb)
+                                      * Multinomial::Choose(r[2]/2, mc);
+                    if ((mb + mc)%2 == 1) value = -value;
+
+                    // if (std::isnan(static_cast<builtin_class>(value))) {
+                        // std::cerr << "Error: Expand(" << r << ", "
+                            // << std::array<char,2>{{mb, mc}} << ") has a NaN value." 
+                            // << std::endl;
+                    // }
+
+
+                    std::array<char,2> key{{static_cast<char>(alpha + 2*mc), 
+                                            static_cast<char>(r[0] + 2*mb + 2*mc)}};
+                    expansion.emplace(key, value);
+                }
             }
-        }
 
-        // std::cout << "Expand(" << r << ") =\n";
-        // for (const auto& entry : expansion) {
-            // std::cout << "(" << entry.first << ", " << entry.second << ")"
-                // << std::endl;
-        // }
-
-        expansionCache.emplace(r, std::move(expansion));
-    }
+            // std::cout << "Expand(" << r << ") =\n";
+            // for (const auto& entry : expansion) {
+                // std::cout << "(" << entry.first << ", " << entry.second << ")"
+                    // << std::endl;
+            // }
 
-    return expansionCache[r];
+            return expansion;
+        });
 }
 
-// do all of the integrals which are possible before mu discretization, and
-// return a list of {value, {r exponents}} objects
-//
-// WARNING: this changes combinedFs so that it can't be reused
-std::vector<NPlus2Term_Output> NPlus2Output(
-        std::vector<NPlus2Term_Step2>& combinedFs, const coeff_class prefactor){
-    std::vector<NPlus2Term_Output> output;
-    for (auto& combinedF : combinedFs) {
-        output.emplace_back(prefactor*DoAllIntegrals_NPlus2(combinedF), 
-                combinedF.r );
-    }
-    return output;
+// the same as InteractionResult, but for the n -> n+2 interaction; the
+// output is a list of {value, r exponent} objects
+std::vector<NPlus2Term_Output> NPlus2Result(const TermList& F1, 
+        const TermList& F2, const coeff_class prefactor) {
+    if (F1.empty() || F2.empty()) return {};
+    return DispatchK(F1.Width()/3, [&](auto kernels) {
+            typedef decltype(kernels) Kernel;
+            return Kernel::NPlus2Output(Kernel::CombineNPlus2Fs(F1, F2), 
+                                        prefactor);
+        });
 }
 
 // prefactors -----------------------------------------------------------------
@@ -893,16 +1127,15 @@ coeff_class Prefactor(const Mono& A, const Mono&, const MATRIX_TYPE type) {
 
 // this follows (2.2) in Matrix Formulas.pdf
 coeff_class InnerProductPrefactor(const char n) {
-    static std::unordered_map<char, coeff_class> ipPrefactorCache;
-    if (ipPrefactorCache.count(n) == 0) {
-        coeff_class denominator = std::tgamma(n+1); // tgamma = "true" gamma fcn
-        denominator *= std::pow(8, n-1);
-        denominator *= std::pow(M_PI, 2*n-3);
-        //std::cout << "PREFACTOR: " << 1/denominator << std::endl;
-        ipPrefactorCache.emplace(n, 1/denominator);
-    }
-
-    return ipPrefactorCache[n];
+    static Memo::Cache<char, coeff_class> 
+        ipPrefactorCache("MatrixInternal::InnerProductPrefactor");
+    return *ipPrefactorCache.Get(n, [n]() {
+            coeff_class denominator = std::tgamma(n+1); // tgamma = "true" gamma fcn
+            denominator *= std::pow(8, n-1);
+            denominator *= std::pow(M_PI, 2*n-3);
+            //std::cout << "PREFACTOR: " << 1/denominator << std::endl;
+            return 1/denominator;
+        });
 }
 
 // this follows (2.3) in Matrix Formulas.pdf
@@ -912,166 +1145,114 @@ coeff_class MassMatrixPrefactor(const char n) {
 }
 
 coeff_class InteractionMatrixPrefactor(const char n) {
-    static std::unordered_map<char, coeff_class> sameNPrefactorCache;
-    if (sameNPrefactorCache.count(n) == 0) {
-        coeff_class denominator = std::tgamma(n-1);
-        denominator *= std::pow(M_PI*M_PI, n-1);
-        denominator *= 4*std::pow(8, n);
-        sameNPrefactorCache.emplace(n, 1/denominator);
-    }
-
-    return sameNPrefactorCache[n];
+    static Memo::Cache<char, coeff_class> 
+        sameNPrefactorCache("MatrixInternal::InteractionMatrixPrefactor");
+    return *sameNPrefactorCache.Get(n, [n]() {
+            coeff_class denominator = std::tgamma(n-1);
+            denominator *= std::pow(M_PI*M_PI, n-1);
+            denominator *= 4*std::pow(8, n);
+            return 1/denominator;
+        });
 }
 
 coeff_class NPlus2MatrixPrefactor(const char n) {
-    static std::unordered_map<char, coeff_class> nPlus2PrefactorCache;
-    if (nPlus2PrefactorCache.count(n) == 0) {
-        coeff_class denominator = std::tgamma(n);
-        denominator *= 6;
-        denominator *= std::pow(M_PI, 2*n);
-        denominator *= std::pow(8, n+1);
-        nPlus2PrefactorCache.emplace(n, 1/denominator);
-    }
-
-    return nPlus2PrefactorCache[n];
+    static Memo::Cache<char, coeff_class> 
+        nPlus2PrefactorCache("MatrixInternal::NPlus2MatrixPrefactor");
+    return *nPlus2PrefactorCache.Get(n, [n]() {
+            coeff_class denominator = std::tgamma(n);
+            denominator *= 6;
+            denominator *= std::pow(M_PI, 2*n);
+            denominator *= std::pow(8, n+1);
+            return 1/denominator;
+        });
 }
 
 // integrals ------------------------------------------------------------------
 
-// do all the integrals for a direct matrix computation
-coeff_class DoAllIntegrals(const MatrixTerm_Final& term) {
-    std::size_t n = term.uPlus.size() + 1;
-    coeff_class output = term.coeff;
+// this is the integral of uplus^a uminus^b d(uplus) instead of d(u), which is
+// B(a/2 + 1, b/2 + 1)
+builtin_class UPlusIntegral(const int a, const int b) {
+    return halfBeta(a + 2, b + 2);
+}
 
-    // do the u integrals first
-    for (auto i = 0u; i < n-1; ++i) {
-        output *= UPlusIntegral(term.uPlus[i] + 3, 
-                                term.uMinus[i] + 5*(n - (i+1)) - 2);
-    }
+// this is the integral over the "theta" veriables from 0 to pi; it implements 
+// Zuhair's 5.35, where a is the exponent of sin(theta) and b is the exponent of 
+// cos(theta).
+builtin_class ThetaIntegral_Short(const int a, const int b) {
+    if (b % 2 == 1) return 0;
+    return halfBeta(a + 1, b + 1);
+}
 
-    // now the theta integrals; sineTheta.size() = cosTheta.size() = n-2.
-    // All but the last one are short, while the last one is long
-    //
-    // these have constant terms which differ from Nikhil's because his i
-    // starts at 1 instead of 0, so I use (i+1) instead
-    if (n >= 3) {
-        for (auto i = 0u; i < n-3; ++i) {
-            output *= ThetaIntegral_Short(n - (i+1) - 2 + term.sinTheta[i],
-                            term.cosTheta[i] );
-        }
-        output *= ThetaIntegral_Long(term.sinTheta[n-3], term.cosTheta[n-3]);
-    } else {
-        output *= 2;
-    }
-    // std::cout << term.coeff << " * {" << term.uPlus << ", " << term.uMinus
-        // << ", " << term.sinTheta << ", " << term.cosTheta << "} -> " << output 
-        // << std::endl;
-    return output;
+// this is the integral over the "theta" veriables from 0 to 2pi; it implements 
+// Zuhair's 5.36, where a is the exponent of sin(theta) and b is the exponent of
+// cos(theta).
+builtin_class ThetaIntegral_Long(const int a, const int b) {
+    if ((a+b) % 2 == 1) return 0;
+    return 2*ThetaIntegral_Short(a, b);
 }
 
-// do all the integrals for an interaction matrix computation
-//
-// WARNING: this changes the exponents in term, rendering it non-reusable
-coeff_class DoAllIntegrals(InteractionTerm_Step2& term) {
-    // std::cout << "DoAllIntegrals(" << term.u << ", " << term.theta << ")"
-        // << std::endl;
-    auto n = term.u.size()/2;
-
-    // adjust exponents before doing integrals
-    for (std::size_t i = 0; i < n-2; ++i) {
-        term.u[2*i] += 3;
-        term.u[2*i + 1] += 5*(n-i) - 8;
-    }
-    term.u[term.u.size()-1] += 1;
-    term.u[term.u.size()-2] += 1;
-    term.u[term.u.size()-3] += 1;
-    term.u[term.u.size()-4] += 1;
+// make sure the integral tables are big enough for all of the exponents which
+// can appear in matrix elements between n-particle monomials of the given
+// degree, so that they don't have to grow in the middle of an assembly
+void ReserveIntegralTables(const int n, const int degree) {
+    halfBeta.Reserve(2*degree + 5*n + 8);
+}
 
-    for (std::size_t k = 0; k+4 < n; ++k) {
-        term.theta[2*k] += n-k-3;
-    }
+namespace {
 
-    // this part actually does the integrals
-    coeff_class product = 1;
-    for (std::size_t i = 0; i < n; ++i) {
-        product *= UPlusIntegral(term.u[2*i], term.u[2*i + 1]);
+inline builtin_class HalfBetaTable::operator()(const int p, const int q) {
+    if (p < 1 || q < 1) {
+        throw std::domain_error("HalfBetaTable: B(" + std::to_string(p) 
+                + "/2, " + std::to_string(q) + "/2) diverges");
     }
-    for (std::size_t k = 0; k+3 < n; ++k) {
-        product *= ThetaIntegral_Short(term.theta[2*k], term.theta[2*k + 1]);
+    const Table* table = current.load(std::memory_order_acquire);
+    if (table == nullptr || p >= table->side || q >= table->side) {
+        table = Grow(std::max(p, q) + 1);
     }
-    return product;
+    return table->values[p*table->side + q];
 }
 
-// do all the integrals for an n+2 interaction computation
-coeff_class DoAllIntegrals_NPlus2(const NPlus2Term_Step2& term) {
-    std::size_t n = term.u.size()/2 - 1;
-    coeff_class output = term.coeff;
-
-    // do the non-primed u integrals first
-    for (std::size_t i = 0; i < n-1; ++i) {
-        output *= UPlusIntegral(term.u[2*i] + 3, 5*(n - i) - 3 + term.u[2*i + 1]);
-    }
-
-    // next the two primed u integrals (TODO: check additions!!)
-    output *= UPlusIntegral(term.u[2*(n-1)] + 1, term.u[2*(n-1) + 1] + 1);
-    output *= UPlusIntegral(term.u[2*n] + 1, term.u[2*n + 1] + 4);
+void HalfBetaTable::Reserve(const int side) {
+    const Table* table = current.load(std::memory_order_acquire);
+    if (table == nullptr || table->side < side) Grow(side);
+}
 
-    // now the theta integrals; there are n-2 "normal" theta integrals, followed
-    // by one primed one. The primed and the last normal are long (I think?)
-    //
-    // these have constant terms which differ from Zuhair's because his i
-    // starts at 1 instead of 0, so I use (i+1) instead
-    if (n >= 3) {
-        for (auto i = 0u; i < n-3; ++i) {
-            output *= ThetaIntegral_Short(n - (i+1) - 2 + term.theta[2*i],
-                            term.theta[2*i + 1] );
+// build a table with at least the given side length (and at least twice the
+// current one, so that there are only a few of these). The entries are filled
+// in from B(1/2,1/2) = pi, B(1/2,1) = B(1,1/2) = 2 and B(1,1) = 1 using
+// B(x, y+1) = B(x,y) * y/(x+y) and B(x+1, y) = B(x,y) * x/(x+y), in long double
+// so that the rounding errors along the way don't reach the final doubles
+const HalfBetaTable::Table* HalfBetaTable::Grow(const int side) {
+    std::lock_guard<std::mutex> lock(growMutex);
+    const Table* oldTable = current.load(std::memory_order_acquire);
+    if (oldTable != nullptr && oldTable->side >= side) return oldTable;
+
+    const int newSide = std::max({side, 32, 
+            oldTable == nullptr ? 0 : 2*oldTable->side});
+    std::vector<long double> beta(newSide*newSide, 
+            std::numeric_limits<long double>::quiet_NaN());
+    beta[1*newSide + 1] = std::acos(-1.0L);
+    beta[1*newSide + 2] = 2;
+    beta[2*newSide + 1] = 2;
+    beta[2*newSide + 2] = 1;
+    for (int p = 1; p <= 2; ++p) {
+        for (int q = 3; q < newSide; ++q) {
+            beta[p*newSide + q] = beta[p*newSide + q-2] * (q-2) / (p + q-2);
         }
-        output *= ThetaIntegral_Long(term.theta[2*(n-3)],
-                term.theta[2*(n-3) + 1]);
     }
-    // I think this one (the primed one) is guaranteed to be there
-    output *= ThetaIntegral_Long(term.theta[2*(n-2)], term.theta[2*(n-2) + 1]);
-
-    // std::cout << "DOALLINTEGRALS_OUTPUT:" << output << '\n';
-    return output;
-}
-
-// this is the integral of uplus^a uminus^b d(uplus) instead of d(u)
-builtin_class UPlusIntegral(const builtin_class a, const builtin_class b) {
-    std::array<builtin_class,2> abArray{{a,b}};
-    if (b < a) std::swap(abArray[0], abArray[1]);
-    if (uPlusCache.count(abArray) == 0) {
-        uPlusCache.emplace(abArray, gsl_sf_beta(a/2.0 + 1.0, b/2.0 + 1.0));
+    for (int p = 3; p < newSide; ++p) {
+        for (int q = 1; q < newSide; ++q) {
+            beta[p*newSide + q] = beta[(p-2)*newSide + q] * (p-2) / (p-2 + q);
+        }
     }
 
-    return uPlusCache[abArray];
+    std::unique_ptr<Table> newTable(new Table{newSide, 
+            std::vector<builtin_class>(beta.begin(), beta.end())});
+    tables.push_back(std::move(newTable));
+    current.store(tables.back().get(), std::memory_order_release);
+    return tables.back().get();
 }
 
-// this is the integral over the "theta" veriables from 0 to pi; it implements 
-// Zuhair's 5.35, where a is the exponent of sin(theta) and b is the exponent of 
-// cos(theta).
-//
-// results are cached by (a,b); since a and b are symmetric, we only store the
-// results with a <= b, swapping the two parameters if they're the other order
-builtin_class ThetaIntegral_Short(const builtin_class a, const builtin_class b) {
-    if (static_cast<int>(b) % 2 == 1) return 0;
-    std::array<builtin_class,2> abArray{{a,b}};
-    if (b < a) std::swap(abArray[0], abArray[1]);
-    if (thetaCache.count(abArray) == 1) return thetaCache.at(abArray);
-
-    // builtin_class ret = std::exp(std::lgamma((1+a)/2) + std::lgamma((1+b)/2) 
-                    // - std::lgamma((2 + a + b)/2) );
-    builtin_class ret = gsl_sf_beta((a+1.0)/2.0, (b+1.0)/2.0);
-    thetaCache.emplace(abArray, ret);
-    return ret;
-}
-
-// this is the integral over the "theta" veriables from 0 to 2pi; it implements 
-// Zuhair's 5.36, where a is the exponent of sin(theta) and b is the exponent of
-// cos(theta).
-builtin_class ThetaIntegral_Long(const builtin_class a, const builtin_class b) {
-    if (static_cast<int>(a+b) % 2 == 1) return 0;
-    return 2*ThetaIntegral_Short(a, b);
-}
+} // anonymous namespace
 
 } // namespace MatrixInternal
@@ -7,10 +7,16 @@
 
 #include <vector>
 #include <cmath>
-#include <unordered_map> // for caching integral results
+#include <unordered_map>
+#include <limits> // quiet_NaN for unused integral table entries
+#include <stdexcept>
+#include <string>
 #include <algorithm> // std::remove_if
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <sstream> // buffered output from assembly threads
 #include <gsl/gsl_sf_hyperg.h>
-#include <gsl/gsl_sf_gamma.h> // beta function
 #include <boost/functional/hash.hpp>
 
 #include "constants.hpp"
@@ -19,18 +25,26 @@
 #include "basis.hpp"
 #include "io.hpp"
 #include "discretization.hpp"
+#include "memo.hpp"
+#include "kronecker.hpp"
+#include "sparse-poly.hpp"
+#include "term-list.hpp"
+#include "thread-pool.hpp"
 
 // these should be the only functions you have to call from other files -------
 
 coeff_class InnerFock(const Mono& A, const Mono& B);
 DMatrix GramFock(const Basis<Mono>& basis);
 coeff_class InnerProduct(const Mono& A, const Mono& B);
-DMatrix GramMatrix(const Basis<Mono>& basis, const std::size_t partitions);
-DMatrix MassMatrix(const Basis<Mono>& basis, const std::size_t partitions);
-DMatrix KineticMatrix(const Basis<Mono>& basis, const std::size_t partitions);
-DMatrix InteractionMatrix(const Basis<Mono>& basis, const std::size_t partitions);
+KronMatrix GramMatrix(const Basis<Mono>& basis, const std::size_t partitions);
+KronMatrix MassMatrix(const Basis<Mono>& basis, const std::size_t partitions);
+KronMatrix KineticMatrix(const Basis<Mono>& basis, const std::size_t partitions);
+// the interaction matrices print their Fock space terms to log as they go
+DMatrix InteractionMatrix(const Basis<Mono>& basis, const std::size_t partitions,
+                          std::ostream& log = std::cout);
 DMatrix NPlus2Matrix(const Basis<Mono>& basisA, const Basis<Mono>& basisB,
-                     const std::size_t partitions);
+                     const std::size_t partitions, 
+                     std::ostream& log = std::cout);
 
 // internal stuff -------------------------------------------------------------
 
@@ -42,28 +56,27 @@ using ::operator<<;
 
 // the main point of this header
 DMatrix Matrix(const Basis<Mono>& basis, const std::size_t partitions, 
-        const MATRIX_TYPE type);
+        const MATRIX_TYPE type, std::ostream& log = std::cout);
 coeff_class MatrixTerm(const Mono& A, const Mono& B, const MATRIX_TYPE type);
 DMatrix MatrixBlock(const Mono& A, const Mono& B, const MATRIX_TYPE type,
         const std::size_t partitions);
+KronMatrix DirectMatrix(const Basis<Mono>& basis, const std::size_t partitions,
+        const MATRIX_TYPE type);
+DMatrix FockMatrix(const Basis<Mono>& basis, const MATRIX_TYPE type);
+DMatrix FockMatrix_Pairwise(const Basis<Mono>& basis, const MATRIX_TYPE type);
+builtin_class PairCost(const Mono& A, const Mono& B, const MATRIX_TYPE type);
+std::vector<std::size_t> LargestFirst(const std::vector<builtin_class>& costs);
 
-// five structs used in the coordinate transformations for MatrixTerm
-
-struct YTerm {
-    coeff_class coeff;
-    std::string y;
-
-    YTerm() = delete;
-    YTerm(const coeff_class coeff, const std::string& y, 
-            const std::string& nAndm);
-    
-    char operator[](std::size_t i) const { return y[i]; }
-    std::size_t size() const { return y.size(); }
-};
-OStream& operator<<(OStream& os, const YTerm& out);
+// structs used in the coordinate transformations for MatrixTerm. While sums
+// of terms are being multiplied out they're kept as SparsePolys, so that like
+// terms are collected, and the results are cached as TermLists; these are the
+// unpacked forms of the terms, which are only used for testing and output
 
 struct MatrixTerm_Intermediate {
     coeff_class coeff = 1;
+    // how many terms were collected into this one; the interaction integrals 
+    // use this instead of coeff (see CombineInteractionFs)
+    std::size_t count = 1;
     std::vector<char> uPlus;
     std::vector<char> uMinus;
     std::vector<char> yTilde;
@@ -72,28 +85,11 @@ struct MatrixTerm_Intermediate {
     explicit MatrixTerm_Intermediate(const size_t n);
     void Resize(const size_t n);
 };
-MatrixTerm_Intermediate operator*(const MatrixTerm_Intermediate& A,
-			MatrixTerm_Intermediate B);
 OStream& operator<<(OStream& os, const MatrixTerm_Intermediate& out);
 
-struct MatrixTerm_Final {
-    coeff_class coeff = 1;
-    std::vector<char> uPlus;
-    std::vector<char> uMinus;
-    std::vector<char> sinTheta;
-    std::vector<char> cosTheta;
-
-    MatrixTerm_Final() = default;
-    explicit MatrixTerm_Final(const size_t n);
-    // maybe should be rvalue references instead? hopefully it compiles the same
-    MatrixTerm_Final(const coeff_class coeff, 
-                    const std::vector<char>& uPlus, const std::vector<char>& uMinus, 
-                    const std::vector<char>& sinTheta, const std::vector<char>& cosTheta);
-    void Resize(const size_t n);
-};
-
 struct InteractionTerm_Step2 {
-    // coeff(F1) * coeff(F2), not including degeneracies or coeffs of A&B (yet?)
+    // the number of pairs of terms from F1 and F2 which have these exponents;
+    // coeff(F1) * coeff(F2) isn't used by the integrals, so it isn't kept
     coeff_class coeff;
     // u1+, u1-, u2+, u2-, ... , u(n-1)+, u(n-1)-, u'(n-1)+, u'(n-1)-
     std::vector<char> u;
@@ -119,23 +115,6 @@ struct InteractionTerm_Output {
 typedef std::unordered_map<std::array<char,2>, coeff_class,
                            boost::hash<std::array<char,2>> >NtoN_Final;
 
-struct NPlus2Term_Step2 {
-    // coeff(F1) * coeff(F2), not including degeneracies or coeffs of A&B (yet?)
-    coeff_class coeff;
-    // u1+, u1-, u2+, u2-, ..., u(n-1)+, u(n-1)-, u'(n-1)+, u'(n-1)-, u'n+, u'n-
-    std::vector<char> u;
-    // sin(theta_1), cos(theta_1), ... , sin(theta_(n-2)), cos(theta_(n-2)),
-    // sin(theta'), cos(theta')
-    std::vector<char> theta;
-    // r, sqrt(1 - r^2), sqrt(1 - alpha^2 r^2)
-    char r;
-};
-
-inline OStream& operator<<(OStream& os, const NPlus2Term_Step2& out) {
-    return os << out.coeff << " * [" << out.u << ", " << out.theta << ", " 
-        << int(out.r) << "]";
-}
-
 struct NPlus2Term_Output {
     // entire constant part of term, including prefactors, degeneracies, etc.
     coeff_class coeff;
@@ -157,22 +136,33 @@ std::vector<NPlus2Term_Output> MatrixTerm_NPlus2(const Mono& A, const Mono& B);
 // coordinate transform functions, called from MatrixTerm
 std::string ExtractXY(const Mono& extractFromThis);
 bool PermuteXY(std::string& xAndy);
+std::shared_ptr<const std::vector<std::vector<char>>> ParticleOrders(
+        const Mono& mono);
+std::string ArrangeXY(const std::string& xAndy, const std::vector<char>& order);
+
+// one orbit of B's particle orders under the symmetries of the direct integrals
+// (given A), with the number of orders in it
+struct XYOrbit {
+    std::string xAndy;
+    unsigned int multiplicity;
+};
+std::vector<XYOrbit> DirectOrbits(const std::string& xAndy_A, const Mono& B);
 std::array<std::string,2> CombineXandY(const std::array<std::string,2>& xAndy_A,
 		std::array<std::string,2> xAndy_B);
 
 std::vector<char> UFromX(const std::string& x);
-std::vector<MatrixTerm_Final> ThetaFromY(const std::string y);
-std::vector<MatrixTerm_Intermediate> YTildeFromY(const std::string& y);
-std::vector<MatrixTerm_Final> ThetaFromYTilde(
-		std::vector<MatrixTerm_Intermediate>& intermediateTerms);
+TermList YTildeFromY(const std::string& y);
+TermList ThetaFromYTilde(const TermList& intermediateTerms);
 
 // coordinate transform helper functions, called from transforms
-std::vector<YTerm> EliminateYn(const std::string& y);
-std::vector<MatrixTerm_Intermediate> YTildeTerms(
-		const unsigned int i, const char a, const char l, std::string nAndm);
-std::vector<MatrixTerm_Intermediate> MultiplyIntermediateTerms(
-		const std::vector<MatrixTerm_Intermediate>& termsA, 
-		const std::vector<MatrixTerm_Intermediate>& termsB);
+SparsePoly EliminateYn(const std::string& y);
+void YTildeTerms(const unsigned int i, const char a, const char l, 
+        std::string nAndm, const std::size_t k, SparsePoly& terms,
+        SparsePoly& counts);
+TermList PackIntermediate(const SparsePoly& poly, const SparsePoly& counts);
+TermList PackIntermediate(const std::vector<MatrixTerm_Intermediate>& terms);
+MatrixTerm_Intermediate UnpackIntermediate(const TermList& terms, 
+        const std::size_t term);
 //MatrixTerm_Intermediate YTildeLastTerm(const unsigned int n, const char a, 
 		//const char l, const std::vector<char>& mVector);
 coeff_class YTildeCoefficient(const char a, const char l, 
@@ -180,32 +170,107 @@ coeff_class YTildeCoefficient(const char a, const char l,
 //coeff_class YTildeLastCoefficient(const char a, const char l, 
 		//const std::vector<char>& mVector);
 
+// Every direct matrix element is a bilinear form in the F's of its monomials:
+// MatrixTerm(A, B) = (prefactors) * sum_{a,b} c_a c_b I(e_a + e_b), where the
+// a's are the terms of F_A, the b's are the terms of F_B for every permutation
+// of B, and I does the integrals over the combined exponents. If we collect all
+// of the distinct exponents e_a in one dictionary and all of the e_b in 
+// another, the whole Fock matrix is C_A^T K C_B, where the C's hold the 
+// coefficients of each monomial on its dictionary and K_{ab} = I(e_a + e_b).
+//
+// This saves a lot of work when the same exponents come up in many monomials
+// (and permutations), but K grows like the product of the dictionary sizes, so
+// FockMatrix compares the work estimates and does whichever is cheaper.
+class FockContraction {
+    public:
+        FockContraction(const Basis<Mono>& basis, const MATRIX_TYPE type);
+
+        // false if the basis isn't suitable, e.g. it has more than one n
+        bool Valid() const { return valid; }
+        builtin_class PairwiseWork() const { return pairwiseWork; }
+        builtin_class ContractionWork() const;
+        DMatrix Evaluate() const;
+
+    private:
+        const Basis<Mono>& basis;
+        MATRIX_TYPE type;
+        bool valid;
+        std::size_t n;
+        // the dictionaries are the exponents of each entry packed one after
+        // another, width chars apiece, in the direct layout of kernels.hpp
+        std::size_t width;
+        std::string dictionaryA;
+        std::string dictionaryB;
+        // (dictionary entry) x (basis monomial)
+        SMatrix coeffsA;
+        SMatrix coeffsB;
+        builtin_class pairwiseWork;
+
+        bool AddTerms(const TermList& terms, 
+                      const std::size_t column, 
+                      std::unordered_map<std::string,std::size_t>& indices,
+                      std::string& dictionary,
+                      std::vector<Triplet>& triplets);
+        std::size_t DictionarySize(const std::string& dictionary) const {
+            return dictionary.size()/width;
+        }
+};
+
+// The interaction matrices are sums of mu parts: the block for the monomials
+// (A, B) is sum_keys c_{AB,key} M_key, where the keys are the exponents left
+// after the Fock space integrals and the M's are MuPart_NtoN or MuPart_NPlus2.
+// Rather than adding up the M's for one pair at a time, a MuContraction is
+// given all of the c's first, then computes each distinct M once and gets every
+// block at once as [M_1 ... M_keys] * C, where the columns of the left side are
+// the M's flattened and C is the (sparse) matrix of the c's.
+class MuContraction {
+    public:
+        // the keys are {n, alpha, r} for MAT_INTER_SAME_N and {n, r, 0} for 
+        // MAT_INTER_N_PLUS_2, as in MuPart_NtoN and MuPart_NPlus2
+        typedef std::array<char,3> Key;
+
+        MuContraction(const MATRIX_TYPE type, const std::size_t partitions);
+
+        // add coeff*M_key to the block with the given index
+        void Add(const std::size_t block, const Key& key, 
+                 const coeff_class coeff);
+        // every block from 0 to numBlocks - 1, with block i in column i
+        // (flattened in column major order, like a DMatrix)
+        DMatrix Evaluate(const std::size_t numBlocks) const;
+        std::size_t Partitions() const { return partitions; }
+
+    private:
+        MATRIX_TYPE type;
+        std::size_t partitions;
+        std::unordered_map<Key, std::size_t, boost::hash<Key>> keyIndices;
+        std::vector<Key> keys;
+        // (key index) x (block index)
+        std::vector<Triplet> triplets;
+};
+std::vector<std::pair<MuContraction::Key, coeff_class>> InteractionTerms(
+        const Mono& A, const Mono& B, const MATRIX_TYPE type, 
+        std::ostream& log);
+void PlanBlocks(const Basis<Mono>& basisA, const Basis<Mono>& basisB,
+        const std::vector<std::pair<std::size_t,std::size_t>>& pairs,
+        const MATRIX_TYPE type, MuContraction& plan, std::ostream& log);
+
 // functions specific to DIRECT computations
-const std::vector<MatrixTerm_Final>& DirectTermsFromXY(const std::string& xAndy);
-std::vector<MatrixTerm_Final> CombineTwoFs(const std::vector<MatrixTerm_Final>& F1,
-		const std::vector<MatrixTerm_Final>& F2);
-coeff_class FinalResult(std::vector<MatrixTerm_Final>& exponents,
-		const MATRIX_TYPE type);
+std::shared_ptr<const TermList> DirectTermsFromXY(const std::string& xAndy);
+coeff_class DirectResult(const TermList& F1, const TermList& F2, 
+        const MATRIX_TYPE type);
 
 // functions specific to INTERACTION computations
-const std::vector<MatrixTerm_Intermediate>& InteractionTermsFromXY(
-        const std::string& xAndy);
+std::shared_ptr<const TermList> InteractionTermsFromXY(const std::string& xAndy);
 std::vector<InteractionTerm_Step2> CombineInteractionFs(
         const std::vector<MatrixTerm_Intermediate>& F1, 
         const std::vector<MatrixTerm_Intermediate>& F2 );
-InteractionTerm_Step2 CombineInteractionFs_OneTerm(
-        const MatrixTerm_Intermediate& F1, const MatrixTerm_Intermediate& F2 );
-NtoN_Final InteractionOutput(std::vector<InteractionTerm_Step2>& combinedFs, 
-                             const coeff_class prefactor);
-const NtoN_Final& Expand(const std::array<char,3>& r, const char alpha);
+NtoN_Final InteractionResult(const TermList& F1, const TermList& F2,
+        const coeff_class prefactor);
+std::shared_ptr<const NtoN_Final> Expand(const std::array<char,3>& r, 
+                                         const char alpha);
 
-std::vector<NPlus2Term_Step2> CombineNPlus2Fs(
-        const std::vector<MatrixTerm_Intermediate>& F1, 
-        const std::vector<MatrixTerm_Intermediate>& F2);
-NPlus2Term_Step2 CombineNPlus2Fs_OneTerm(
-        const MatrixTerm_Intermediate& f1, const MatrixTerm_Intermediate& f2);
-std::vector<NPlus2Term_Output> NPlus2Output(
-        std::vector<NPlus2Term_Step2>& combinedFs, const coeff_class prefactor);
+std::vector<NPlus2Term_Output> NPlus2Result(const TermList& F1, 
+        const TermList& F2, const coeff_class prefactor);
 
 // numerical prefactors used in the various computations
 coeff_class Prefactor(const Mono& A, const Mono& B, const MATRIX_TYPE type);
@@ -214,13 +279,11 @@ coeff_class MassMatrixPrefactor(const char n);
 coeff_class InteractionMatrixPrefactor(const char n);
 coeff_class NPlus2MatrixPrefactor(const char n);
 
-// integrals used in FinalResult
-coeff_class DoAllIntegrals(const MatrixTerm_Final& term);
-coeff_class DoAllIntegrals(InteractionTerm_Step2& term);
-coeff_class DoAllIntegrals_NPlus2(const NPlus2Term_Step2& term);
-builtin_class UPlusIntegral(const builtin_class a, const builtin_class b);
-builtin_class ThetaIntegral_Short(const builtin_class a, const builtin_class b);
-builtin_class ThetaIntegral_Long(const builtin_class a, const builtin_class b);
+// integrals used by the kernels in kernels.hpp
+builtin_class UPlusIntegral(const int a, const int b);
+builtin_class ThetaIntegral_Short(const int a, const int b);
+builtin_class ThetaIntegral_Long(const int a, const int b);
+void ReserveIntegralTables(const int n, const int degree);
 builtin_class RIntegral(const builtin_class a, const builtin_class alpha);
 
 } // namespace MassMatrix
@@ -0,0 +1,75 @@
+#include "memo.hpp"
+
+namespace Memo {
+
+namespace {
+    // the registry is a function-local static so that it's constructed before
+    // (and therefore destroyed after) any cache which registers with it
+    struct Registry {
+        std::mutex mutex;
+        std::vector<CacheBase*> caches;
+        std::size_t defaultByteLimit = 0;
+    };
+
+    Registry& GetRegistry() {
+        static Registry registry;
+        return registry;
+    }
+} // anonymous namespace
+
+CacheBase::CacheBase(const std::string& name): name(name) {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    byteLimit = registry.defaultByteLimit;
+    registry.caches.push_back(this);
+}
+
+CacheBase::~CacheBase() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto& caches = registry.caches;
+    caches.erase(std::remove(caches.begin(), caches.end(), this), caches.end());
+}
+
+std::vector<Stats> AllStats() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<Stats> output;
+    for (const CacheBase* cache : registry.caches) {
+        output.push_back(cache->GetStats());
+    }
+    return output;
+}
+
+void PrintStats(OStream& os) {
+    os << "Memoization caches (hits / misses / entries / kB / evictions):"
+        << endl;
+    for (const Stats& stats : AllStats()) {
+        os << "    " << stats.name.c_str() << ": " << stats.hits
+            << " / " << stats.misses << " / " << stats.entries << " / "
+            << stats.bytes/1024;
+        if (stats.byteLimit != 0) os << " (limit " << stats.byteLimit/1024 << ")";
+        os << " / " << stats.evictions << endl;
+    }
+}
+
+void ClearAll() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (CacheBase* cache : registry.caches) cache->Clear();
+}
+
+void SetByteLimit(const std::size_t limit) {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.defaultByteLimit = limit;
+    for (CacheBase* cache : registry.caches) cache->SetByteLimit(limit);
+}
+
+std::size_t DefaultByteLimit() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return registry.defaultByteLimit;
+}
+
+} // namespace Memo
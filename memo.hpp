@@ -0,0 +1,349 @@
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+// Memoization tables shared by all of the computation threads.
+//
+// A Memo::Cache<Key, Value> maps keys to immutable values which are computed
+// the first time they're asked for. The table is split into shards, each with
+// its own reader-writer lock, so lookups of existing entries only take a shared
+// lock on one shard. If several threads ask for the same missing key at once,
+// only one of them computes it; the rest wait for its result, running tasks
+// from the Pool while they wait. If the thread computing a key asks for it
+// again (e.g. from a Pool task it picked up while computing it), it computes
+// it a second time instead of waiting on itself. Values are computed inside a
+// Pool::Isolation, so a thread waiting on the tasks of its own computation 
+// never picks up one which asks for another thread's key while that thread
+// does the same with this one. The owners' tasks are still run by the other
+// threads, including the ones waiting for their keys.
+//
+// Values are handed out as std::shared_ptr<const Value>, so an entry can be
+// evicted (when the cache is over its byte limit) or cleared while another
+// thread is still using it. Every cache registers itself by name so that its
+// hit/miss/size counters can be printed with Memo::PrintStats().
+
+#include <array>
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <algorithm> // std::remove
+
+#include "constants.hpp"
+#include "term-list.hpp"
+#include "thread-pool.hpp"
+
+namespace Memo {
+
+struct Stats {
+    std::string name;
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+    std::size_t byteLimit = 0;
+    std::size_t evictions = 0;
+};
+
+// the non-template part of every cache, which is what the registry knows about
+class CacheBase {
+    public:
+        explicit CacheBase(const std::string& name);
+        virtual ~CacheBase();
+        CacheBase(const CacheBase&) = delete;
+        CacheBase& operator=(const CacheBase&) = delete;
+
+        const std::string& Name() const { return name; }
+        virtual Stats GetStats() const = 0;
+        virtual void Clear() = 0;
+
+        // 0 means no limit; otherwise entries are evicted (oldest first) once
+        // the approximate size of the cache goes over this many bytes
+        void SetByteLimit(const std::size_t limit) { byteLimit = limit; }
+        std::size_t ByteLimit() const { return byteLimit; }
+
+    protected:
+        std::atomic<std::size_t> hits{0};
+        std::atomic<std::size_t> misses{0};
+        std::atomic<std::size_t> bytes{0};
+        std::atomic<std::size_t> evictions{0};
+        std::atomic<std::size_t> byteLimit{0};
+
+    private:
+        std::string name;
+};
+
+// functions which act on every registered cache
+std::vector<Stats> AllStats();
+void PrintStats(OStream& os);
+void ClearAll();
+// set the byte limit of every cache, including ones created after this call
+void SetByteLimit(const std::size_t limit);
+std::size_t DefaultByteLimit();
+
+// approximate memory used by a key or value, for the byte limit. These only
+// look one level deep, e.g. a vector of vectors counts the outer vector's
+// buffer but not the inner ones'
+template<typename T>
+inline std::size_t ApproxBytes(const T&) {
+    return sizeof(T);
+}
+
+inline std::size_t ApproxBytes(const std::string& str) {
+    return sizeof(str) + str.capacity();
+}
+
+template<typename T>
+inline std::size_t ApproxBytes(const std::vector<T>& vec) {
+    return sizeof(vec) + vec.capacity()*sizeof(T);
+}
+
+template<typename K, typename V, typename H>
+inline std::size_t ApproxBytes(const std::unordered_map<K,V,H>& map) {
+    return sizeof(map) + map.bucket_count()*sizeof(void*)
+        + map.size()*(sizeof(K) + sizeof(V) + 2*sizeof(void*));
+}
+
+inline std::size_t ApproxBytes(const DMatrix& mat) {
+    return sizeof(mat) + mat.size()*sizeof(coeff_class);
+}
+
+inline std::size_t ApproxBytes(const TermList& terms) {
+    return terms.Bytes();
+}
+
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class Cache : public CacheBase {
+    public:
+        typedef std::shared_ptr<const Value> Pointer;
+
+        explicit Cache(const std::string& name): CacheBase(name) {}
+        ~Cache() = default;
+
+        // return the value for key, calling compute() to make it if needed.
+        // If compute() throws, the exception is passed on to everyone waiting
+        // for this key and nothing is stored
+        template<typename Compute>
+        Pointer Get(const Key& key, Compute&& compute);
+        // return the value for key if it's already been computed, else nullptr
+        Pointer Find(const Key& key) const;
+
+        Stats GetStats() const override;
+        void Clear() override;
+
+    private:
+        static constexpr std::size_t SHARDS = 16;
+
+        struct Entry {
+            Pointer value; // null until the value has been computed
+            std::shared_future<Pointer> pending;
+            const void* owner; // identifies this computation of the entry
+            std::thread::id thread; // the thread computing it
+            std::size_t bytes;
+        };
+
+        struct Shard {
+            mutable std::shared_timed_mutex mutex;
+            std::unordered_map<Key, Entry, Hash> map;
+            // finished keys in the order they were computed, for eviction
+            std::deque<Key> order;
+            std::size_t bytes = 0;
+        };
+
+        std::array<Shard, SHARDS> shards;
+
+        Shard& ShardFor(const Key& key);
+        const Shard& ShardFor(const Key& key) const;
+        void Finish(Shard& shard, const Key& key, const void* owner,
+                    const Pointer& value);
+        void Abandon(Shard& shard, const Key& key, const void* owner);
+        template<typename Compute>
+        Pointer Wait(const std::shared_future<Pointer>& pending,
+                     const bool ownThread, Compute&& compute);
+};
+
+template<typename Key, typename Value, typename Hash>
+template<typename Compute>
+typename Cache<Key,Value,Hash>::Pointer Cache<Key,Value,Hash>::Get(
+        const Key& key, Compute&& compute) {
+    Shard& shard = ShardFor(key);
+    const std::thread::id thisThread = std::this_thread::get_id();
+    std::shared_future<Pointer> pending;
+    bool ownThread = false;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+        auto entry = shard.map.find(key);
+        if (entry != shard.map.end()) {
+            if (entry->second.value) {
+                ++hits;
+                return entry->second.value;
+            }
+            pending = entry->second.pending;
+            ownThread = entry->second.thread == thisThread;
+        }
+    }
+    // someone is already computing this one, so wait for them
+    if (pending.valid()) return Wait(pending, ownThread, compute);
+
+    std::promise<Pointer> promise;
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+        auto entry = shard.map.emplace(key, Entry{nullptr,
+                promise.get_future().share(), &promise, thisThread, 0});
+        if (!entry.second) {
+            // somebody got in between the two locks
+            if (entry.first->second.value) {
+                ++hits;
+                return entry.first->second.value;
+            }
+            pending = entry.first->second.pending;
+            ownThread = entry.first->second.thread == thisThread;
+        }
+    }
+    if (pending.valid()) return Wait(pending, ownThread, compute);
+
+    ++misses;
+    Pointer value;
+    try {
+        Pool::Isolation isolation;
+        value = std::make_shared<const Value>(compute());
+    }
+    catch (...) {
+        promise.set_exception(std::current_exception());
+        Abandon(shard, key, &promise);
+        throw;
+    }
+    promise.set_value(value);
+    Finish(shard, key, &promise, value);
+    return value;
+}
+
+// wait for another computation of the same key. If it's further down this
+// thread's own stack it can't finish until this returns, so the value is
+// computed again here (and not stored, since that one will be)
+template<typename Key, typename Value, typename Hash>
+template<typename Compute>
+typename Cache<Key,Value,Hash>::Pointer Cache<Key,Value,Hash>::Wait(
+        const std::shared_future<Pointer>& pending, const bool ownThread,
+        Compute&& compute) {
+    if (ownThread) {
+        ++misses;
+        Pool::Isolation isolation;
+        return std::make_shared<const Value>(compute());
+    }
+    ++hits;
+    return Pool::Future<Pointer>(pending).Get();
+}
+
+template<typename Key, typename Value, typename Hash>
+typename Cache<Key,Value,Hash>::Pointer Cache<Key,Value,Hash>::Find(
+        const Key& key) const {
+    const Shard& shard = ShardFor(key);
+    std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+    auto entry = shard.map.find(key);
+    if (entry == shard.map.end()) return nullptr;
+    return entry->second.value;
+}
+
+// the hashes of small keys (e.g. single chars) don't have very random low
+// bits, so mix them up a bit before picking the shard
+template<typename Key, typename Value, typename Hash>
+typename Cache<Key,Value,Hash>::Shard& Cache<Key,Value,Hash>::ShardFor(
+        const Key& key) {
+    std::size_t hash = Hash()(key);
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return shards[hash % SHARDS];
+}
+
+template<typename Key, typename Value, typename Hash>
+const typename Cache<Key,Value,Hash>::Shard& Cache<Key,Value,Hash>::ShardFor(
+        const Key& key) const {
+    return const_cast<Cache*>(this)->ShardFor(key);
+}
+
+// store the computed value in the table, then evict the oldest entries if the
+// table is too big. The limit is split evenly among the shards, and the newest
+// entry in a shard is never evicted
+template<typename Key, typename Value, typename Hash>
+void Cache<Key,Value,Hash>::Finish(Shard& shard, const Key& key,
+        const void* owner, const Pointer& value) {
+    const std::size_t entryBytes = ApproxBytes(key) + ApproxBytes(*value)
+                                 + sizeof(Entry);
+    std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+    auto entry = shard.map.find(key);
+    // if the cache was cleared while this was being computed, don't store it
+    if (entry == shard.map.end() || entry->second.owner != owner) return;
+    entry->second.value = value;
+    entry->second.pending = std::shared_future<Pointer>();
+    entry->second.owner = nullptr;
+    entry->second.thread = std::thread::id();
+    entry->second.bytes = entryBytes;
+    shard.order.push_back(key);
+    shard.bytes += entryBytes;
+    bytes += entryBytes;
+
+    const std::size_t shardLimit = byteLimit/SHARDS;
+    if (shardLimit == 0) return;
+    while (shard.bytes > shardLimit && shard.order.size() > 1) {
+        auto oldest = shard.map.find(shard.order.front());
+        shard.order.pop_front();
+        if (oldest == shard.map.end()) continue;
+        shard.bytes -= oldest->second.bytes;
+        bytes -= oldest->second.bytes;
+        shard.map.erase(oldest);
+        ++evictions;
+    }
+}
+
+// remove a pending entry whose computation failed, so that the next request
+// for it tries again
+template<typename Key, typename Value, typename Hash>
+void Cache<Key,Value,Hash>::Abandon(Shard& shard, const Key& key,
+        const void* owner) {
+    std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+    auto entry = shard.map.find(key);
+    if (entry != shard.map.end() && entry->second.owner == owner) {
+        shard.map.erase(entry);
+    }
+}
+
+template<typename Key, typename Value, typename Hash>
+Stats Cache<Key,Value,Hash>::GetStats() const {
+    Stats stats;
+    stats.name = Name();
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.bytes = bytes;
+    stats.byteLimit = byteLimit;
+    stats.evictions = evictions;
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+        stats.entries += shard.map.size();
+    }
+    return stats;
+}
+
+// entries which are still being computed are dropped as well; whoever is
+// computing them still gets their result, but it isn't stored
+template<typename Key, typename Value, typename Hash>
+void Cache<Key,Value,Hash>::Clear() {
+    for (auto& shard : shards) {
+        std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+        bytes -= shard.bytes;
+        shard.bytes = 0;
+        shard.map.clear();
+        shard.order.clear();
+    }
+}
+
+} // namespace Memo
+
+#endif
@@ -1,7 +1,12 @@
 #include "mono.hpp"
 
 Mono::Mono(const std::vector<particle>& particles, const coeff_class& coeff): 
-    coeff(coeff), particles(particles) {
+    coeff(coeff), nParticles(particles.size()) {
+    if(particles.size() > MAX_PARTICLES){
+        throw std::length_error("Mono: " + std::to_string(particles.size())
+                + " particles is more than MAX_PARTICLES");
+    }
+    std::copy(particles.begin(), particles.end(), this->particles.begin());
     Order();
 }
 
@@ -11,9 +16,14 @@ Mono::Mono(const std::vector<int>& pm, const std::vector<int>& pt,
         std::cerr << "Error: attempted to construct a monomial out of particle "
             << "data with different sizes: {" << pm.size() << "," << pt.size()
             << "}. It will be blank instead." << std::endl;
+        Update();
         return;
     }
-    particles.resize(pm.size());
+    if(pm.size() > MAX_PARTICLES){
+        throw std::length_error("Mono: " + std::to_string(pm.size())
+                + " particles is more than MAX_PARTICLES");
+    }
+    nParticles = pm.size();
     for(auto i = 0u; i < pm.size(); ++i){
         particles[i].pm = pm[i];
         particles[i].pt = pt[i];
@@ -49,30 +59,18 @@ void Mono::ChangePt(const int i, const char newValue) {
     Order();
 }
 
-// note: like all operations on completed Monos, this assumes both are ordered
-bool Mono::operator==(const Mono& other) const {
-    if(particles.size() != other.particles.size()){
-        std::cerr << "Error: asked to compare two monomials with different "
-            << "numbers of particles." << std::endl;
-        return false;
-    }
-    for(unsigned int i = 0; i < particles.size(); ++i){
-        if(particles[i].pm != other.particles[i].pm
-                    || particles[i].pt != other.particles[i].pt) return false;
-    }
-    return true;
-}
-
 std::ostream& operator<<(std::ostream& os, const Mono& out) {
     return os << out.HumanReadable();
 }
 
 std::string MathematicaOutput(const Mono& out) {
     std::stringstream ss;
+    const std::vector<particle> particles(out.particles.begin(),
+            out.particles.begin() + out.nParticles);
     if (std::abs<builtin_class>(out.coeff - 1) < EPSILON) {
-        ss << out.particles;
+        ss << particles;
     } else {
-        ss << out.coeff << " * " << out.particles;
+        ss << out.coeff << " * " << particles;
     }
     return ss.str();
 }
@@ -84,7 +82,8 @@ std::string Mono::HumanReadable() const {
     if(std::abs<builtin_class>(Coeff() - 1) > EPSILON) {
         os << std::abs<builtin_class>(Coeff()) << "*{";
     }
-    for(auto& p : particles) {
+    for(auto i = 0u; i < NParticles(); ++i) {
+        const particle& p = particles[i];
         if(p.pm != 0){
             os << "M";
             if(p.pm != 1) os << "^" << std::to_string(p.pm);
@@ -105,29 +104,29 @@ Mono Mono::operator-() const {
     return ret;
 }
 
-int Mono::TotalPm() const {
-    int total = 0;
-    for(auto& p : particles) total += p.pm;
-    return total;
-}
-
-int Mono::TotalPt() const {
-    int total = 0;
-    for(auto& p : particles) total += p.pt;
-    return total;
-}
-
 // if the Mono is ordered, particles[0] is guaranteed to have the highest Pm
 int Mono::MaxPm() const {
-    if(particles.size() < 1) return -1;
+    if(nParticles < 1) return -1;
     return particles[0].pm;
 }
 
-// for this, we have to actually check
-int Mono::MaxPt() const {
-    int max = -1;
-    for(auto& p : particles) if(p.pt > max) max = p.pt;
-    return max;
+// recomputes the totals and the key; called whenever the momenta change, once
+// the particles are back in order. The key is an FNV-1a hash of the momenta
+void Mono::Update() {
+    totalPm = 0;
+    totalPt = 0;
+    maxPt = -1;
+    std::uint64_t newKey = 14695981039346656037ull ^ nParticles;
+    for(auto i = 0u; i < nParticles; ++i){
+        totalPm += particles[i].pm;
+        totalPt += particles[i].pt;
+        if(particles[i].pt > maxPt) maxPt = particles[i].pt;
+        newKey = (newKey ^ static_cast<unsigned char>(particles[i].pm))
+            * 1099511628211ull;
+        newKey = (newKey ^ static_cast<unsigned char>(particles[i].pt))
+            * 1099511628211ull;
+    }
+    key = newKey;
 }
 
 // return a vector containing one entry per distinguishable particle in *this.
@@ -172,8 +171,18 @@ bool Mono::ParticlePrecedence(const particle& a, const particle& b) {
     return a.pt > b.pt;
 }
 
+// the monos are almost always in order already, or have one particle out of
+// place after ChangePm/ChangePt, so this is an insertion sort
 void Mono::Order() {
-    std::sort(particles.begin(), particles.end(), ParticlePrecedence);
+    for(auto i = 1u; i < nParticles; ++i){
+        const particle p = particles[i];
+        auto j = i;
+        for(; j > 0 && ParticlePrecedence(p, particles[j-1]); --j){
+            particles[j] = particles[j-1];
+        }
+        particles[j] = p;
+    }
+    Update();
 }
 
 Mono Mono::OrderCopy() const {
@@ -183,7 +192,9 @@ Mono Mono::OrderCopy() const {
 }
 
 std::vector<int> Mono::IdentifyNodes() const {
-    return ::IdentifyNodes(particles);
+    return ::IdentifyNodes([this](unsigned int i){ return 
+                std::array<int, 2>({{particles[i].pm, particles[i].pt}}); },
+                NParticles());
 }
 
 std::vector<int> Mono::IdentifyPmNodes() const {
@@ -214,7 +225,7 @@ bool Mono::IsNull() const {
 
 // NOTE! These break ordering, so you have to re-order when you're done!
 Mono Mono::DerivPm(const unsigned int part) const {
-    if(part >= particles.size()){
+    if(part >= NParticles()){
         std::cerr << "Error: monomial told to take a derivative of momentum Pm["
             << part << "], but it only knows about " << NParticles() << "."
             << std::endl;
@@ -227,7 +238,7 @@ Mono Mono::DerivPm(const unsigned int part) const {
 }
 
 Mono Mono::DerivPt(const unsigned int part) const {
-    if(part >= particles.size()){
+    if(part >= NParticles()){
         std::cerr << "Error: monomial told to take a derivative of momentum Pt["
             << part << "], but it only knows about " << NParticles() << "."
             << std::endl;
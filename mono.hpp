@@ -7,6 +7,8 @@
 #include <ostream>
 #include <cmath>        // lgamma
 #include <algorithm>    // next_permutation
+#include <cstdint>      // uint64_t
+#include <functional>   // hash
 
 #include "constants.hpp"
 #include "construction.hpp"
@@ -28,9 +30,22 @@
 // * std::cout << someMono; will print the mono in this format:
 // coeff * {p1_m, p2_m, ... }{p1_t, p2_t, ...}. You may prefer
 // someMono.HumanReadable(), which more resembles how you'd write it on a board.
+// * The particles are kept in a fixed array of MAX_PARTICLES, so copying a 
+// mono never allocates. The totals and a 64-bit key made from the (ordered)
+// momenta are updated whenever the momenta change, so they're free to read;
+// Key() is the hash. Two monos with different keys are never equal, but 
+// different monos can (very rarely) share a key, so anything looked up by key
+// has to compare the monos it finds with the one it wants.
 class Mono {
     coeff_class coeff;
-    std::vector<particle> particles;
+    std::array<particle, MAX_PARTICLES> particles{};
+    unsigned char nParticles = 0;
+    short totalPm = 0;
+    short totalPt = 0;
+    short maxPt = -1;
+    std::uint64_t key = 0;
+
+    void Update();
 
     std::vector<int> IdentifyNodes() const;
     template<typename T> std::vector<int> IdentifyNodes(T (*value)(particle)) const;
@@ -38,7 +53,7 @@ class Mono {
     std::vector<int> IdentifyPtNodes() const;
 
     public:
-        Mono(): coeff(1) {}
+        Mono(): coeff(1) { Update(); }
         Mono(const std::vector<int>& pm, const std::vector<int>& pt, 
                         const coeff_class& coeff = 1);
         Mono(const std::vector<particle>& particles, 
@@ -47,7 +62,7 @@ class Mono {
         coeff_class& Coeff()		{ return coeff; }
         const coeff_class& Coeff() const	{ return coeff; }
 
-        unsigned int NParticles() const { return particles.size(); }
+        unsigned int NParticles() const { return nParticles; }
 
         const char& Pm(const int i) const;
         //char& Pm(const int i);
@@ -55,10 +70,11 @@ class Mono {
         const char& Pt(const int i) const;
         //char& Pt(const int i);
         void ChangePt(const int i, const char newValue);
-        int TotalPm() const;
-        int TotalPt() const;
+        int TotalPm() const { return totalPm; }
+        int TotalPt() const { return totalPt; }
         int MaxPm() const;
-        int MaxPt() const;
+        int MaxPt() const { return maxPt; }
+        std::uint64_t Key() const { return key; }
         int Degree() const { return TotalPm() + TotalPt(); }
         std::vector<size_t> CountIdentical() const;
         std::vector<size_t> PermutationVector() const;
@@ -70,7 +86,11 @@ class Mono {
         template<typename T>
                 Mono& operator/=(const T& x)		 { coeff /= x; return *this; }
 
-        bool operator==(const Mono& other) const;
+        bool operator==(const Mono& other) const {
+            return key == other.key && nParticles == other.nParticles
+                && std::equal(particles.begin(), particles.begin() + nParticles,
+                              other.particles.begin());
+        }
         bool operator!=(const Mono& other) const { return !(*this == other); }
         friend std::ostream& operator<<(std::ostream& os, const Mono& out);
         friend std::string MathematicaOutput(const Mono& out);
@@ -104,6 +124,15 @@ class Mono {
         Mono MultPp(const unsigned int targetParticle) const;
 };
 
+namespace std {
+template<>
+struct hash<Mono> {
+    std::size_t operator()(const Mono& mono) const noexcept {
+        return mono.Key();
+    }
+};
+} // namespace std
+
 // calls the generic IdentifyNodes using the class's particles and (*value)
 template<typename T>
 inline std::vector<int> Mono::IdentifyNodes(T (*value)(particle)) const{
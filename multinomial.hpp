@@ -2,54 +2,109 @@
 #define MULTINOMIAL_HPP
 
 #include <vector>
-#include <set>
+#include <array>
+#include <string>
+#include <algorithm> // sort
 #include <iostream>
 #include <memory> // unique_ptr
-#include <unordered_map>
+#include <mutex>
 
 #include "constants.hpp" // for coeff_class
 #include "io.hpp" // MVectorOut
+#include "partitions.hpp"
+
+// the highest n in the compile-time binomial table; set it with 
+// make MAX_COEFF_ORDER=...
+#ifndef MAX_COEFF_ORDER
+#define MAX_COEFF_ORDER 64
+#endif
 
 namespace Multinomial {
 
 class MultinomialTable;
 
-// sorts mVectors so their n goes up but the Ms go down
-struct MVectorPrecedence {
-    constexpr bool operator()(const std::string& A, const std::string& B) const;
+constexpr int MAX_ORDER = MAX_COEFF_ORDER;
+static_assert(MAX_ORDER >= 0 && MAX_ORDER <= 127, 
+              "MAX_COEFF_ORDER must fit in a char");
+// every multinomial coefficient with n up to this is at most n! < 2^113, so
+// products of binomials give them exactly in coeff_class
+constexpr int EXACT_ORDER = MAX_ORDER < 31 ? MAX_ORDER : 31;
+
+// Pascal's triangle up to MAX_ORDER, made by the compiler
+struct BinomialTable {
+    coeff_class values[MAX_ORDER+1][MAX_ORDER+1];
+};
+
+constexpr BinomialTable MakeBinomialTable() {
+    BinomialTable table{};
+    for (int n = 0; n <= MAX_ORDER; ++n) {
+        table.values[n][0] = 1;
+        for (int m = 1; m <= n; ++m) {
+            table.values[n][m] = table.values[n-1][m-1] + table.values[n-1][m];
+        }
+    }
+    return table;
+}
+
+extern const BinomialTable binomialTable;
+
+// n must be at most MAX_ORDER
+inline coeff_class Binomial(const int n, const int m) {
+    if (m < 0 || m > n) return 0;
+    return binomialTable.values[n][m];
+}
+
+// The mVectors at one n, i.e. the strings {n, m_1, m_2, ...} with the m's
+// sorted from largest to smallest and summing to n. They're stored by n in
+// the order of NextPartition(), so the ms go down, and this is a view of them
+// which stays valid while the table grows
+class MVectorRange {
+    public:
+        MVectorRange(const std::string* first, const std::string* last):
+            first(first), last(last) {}
+
+        const std::string* begin() const { return first; }
+        const std::string* end() const { return last; }
+        std::size_t size() const { return last - first; }
+
+    private:
+        const std::string* first;
+        const std::string* last;
 };
-typedef std::set<std::string, MVectorPrecedence> MVectorContainer;
 
 void Initialize(const char particleNumber, const char highestN);
 void Clear();
 std::unique_ptr<MultinomialTable>& GetTable(const std::size_t n, const char d);
-// void FillTo(const char particleNumber, const char newHighestN);
-MVectorContainer GetMVectors(const unsigned char particleNumber, const char n);
+MVectorRange GetMVectors(const unsigned char particleNumber, const char n);
 // first Choose is binomial, second is multinomial
 coeff_class Choose(const char n, const char m);
-coeff_class Choose(const char particleNumber, const char n, 
+coeff_class Choose(const char particleNumber, const char n,
 		const std::vector<char>& m);
 coeff_class Lookup(const char particleNumber, const std::string& nAndm);
 
+// The coefficients are kept in one array per n, indexed by the rank of the
+// sorted m vector among the partitions of n (see PartitionCounts), so a lookup
+// is a sort of the m's, the rank and an array load. Filling the table to a
+// higher n only adds the new levels
 class MultinomialTable {
     public:
         explicit MultinomialTable(const unsigned char particleNumber);
 
         coeff_class Choose(const char n, const std::vector<char>& m);
-        coeff_class Lookup(std::string nAndm);
+        coeff_class Lookup(const std::string& nAndm);
+        coeff_class Lookup(const char n, const char* m);
         void FillTo(const char newHighestN);
-        MVectorContainer GetMVectors(const unsigned char n);
+        MVectorRange GetMVectors(const unsigned char n);
 
         char HighestN() const { return highestN; }
 
     private:
         const unsigned char particleNumber;
-        MVectorContainer mVectors;
-        std::unordered_map<std::string, coeff_class> table;
+        // both indexed by [n][rank]
+        std::vector<std::vector<std::string>> mVectors;
+        std::vector<std::vector<coeff_class>> coefficients;
+        PartitionCounts counts;
         char highestN;
-
-        void ComputeMVectors(const char newHighestN);
-        static bool AdvanceMVector(std::string& mVector);
 };
 
 } // namespace Multinomial
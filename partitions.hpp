@@ -0,0 +1,247 @@
+#ifndef PARTITIONS_HPP
+#define PARTITIONS_HPP
+
+// In-place enumeration of the integer sequences used to build the states and
+// the multinomial tables. Each kind of sequence has a First and a Next function
+// which work on the size entries starting at an iterator, so the storage
+// belongs to the caller (a std::vector<int>, the end of an mVector string...)
+// and nothing is allocated while stepping through them:
+// * partitions are non-increasing sequences whose sum is some total (or at
+//   most that total), in decreasing lexicographic order from {total, 0, ...};
+// * bounded compositions are sequences of entries in [0, max] whose sum is
+//   some total, in decreasing lexicographic order from {max, ..., max, rest,
+//   0, ...}.
+// The distinct orderings of a multiset are what std::prev_permutation gives
+// when started from the sorted (non-increasing) sequence, which is already in
+// place, so there's nothing extra for those here.
+//
+// PartitionCounts turns partitions and bounded compositions of a fixed total
+// into their positions in the orders above and back again.
+
+#include <vector>
+#include <algorithm> // fill, min
+#include <cstddef>   // size_t
+
+template<typename Iterator>
+inline void FirstPartition(Iterator parts, const int size, const int total) {
+    if (size <= 0) return;
+    std::fill(parts, parts + size, 0);
+    parts[0] = total;
+}
+
+// steps the non-increasing sequence of size entries starting at parts to the
+// next one whose sum is total (if exact) or at most total (if not). Returns
+// false if there isn't one, leaving parts as it was
+template<typename Iterator>
+inline bool NextPartition(Iterator parts, const int size, const int total,
+                          const bool exact) {
+    int before = 0;
+    for (int j = 0; j < size; ++j) before += parts[j];
+    for (int j = size - 1; j >= 0; --j) {
+        before -= parts[j];
+        const int v = parts[j] - 1;
+        if (v < 0) continue;
+        int remaining = total - before - v;
+        // the rest of the sequence can't be bigger than v
+        if (exact && remaining > (size - j - 1)*v) continue;
+        parts[j] = v;
+        for (int k = j + 1; k < size; ++k) {
+            parts[k] = std::min(v, remaining);
+            remaining -= parts[k];
+        }
+        return true;
+    }
+    return false;
+}
+
+// returns false (leaving parts alone) if total doesn't fit in size entries
+template<typename Iterator>
+inline bool FirstComposition(Iterator parts, const int size, const int total,
+                             const int max) {
+    if (total < 0 || total > size*max) return false;
+    int remaining = total;
+    for (int j = 0; j < size; ++j) {
+        parts[j] = std::min(max, remaining);
+        remaining -= parts[j];
+    }
+    return true;
+}
+
+template<typename Iterator>
+inline bool NextComposition(Iterator parts, const int size, const int max) {
+    int after = 0;
+    for (int j = size - 1; j >= 0; --j) {
+        if (parts[j] > 0 && after + 1 <= (size - j - 1)*max) {
+            --parts[j];
+            int remaining = after + 1;
+            for (int k = j + 1; k < size; ++k) {
+                parts[k] = std::min(max, remaining);
+                remaining -= parts[k];
+            }
+            return true;
+        }
+        after += parts[j];
+    }
+    return false;
+}
+
+// The numbers of partitions and bounded compositions with totals up to
+// maxTotal and sizes up to maxSize, used to rank them. Ranks count from 0 and
+// are only among the sequences with the same total (and max)
+class PartitionCounts {
+    public:
+        PartitionCounts(const int maxTotal, const int maxSize);
+
+        int MaxTotal() const { return maxTotal; }
+        int MaxSize() const { return maxSize; }
+
+        // non-increasing sequences of size entries in [0, max] summing to total
+        std::size_t Partitions(const int total, const int size,
+                               const int max) const;
+        std::size_t Partitions(const int total, const int size) const {
+            return Partitions(total, size, total);
+        }
+        // sequences of size entries in [0, max] summing to total
+        std::size_t Compositions(const int total, const int size,
+                                 const int max) const;
+
+        template<typename Iterator>
+        std::size_t PartitionRank(Iterator parts, const int size) const;
+        template<typename Iterator>
+        void PartitionUnrank(std::size_t rank, Iterator parts, const int size,
+                             const int total) const;
+        template<typename Iterator>
+        std::size_t CompositionRank(Iterator parts, const int size,
+                                    const int max) const;
+        template<typename Iterator>
+        void CompositionUnrank(std::size_t rank, Iterator parts,
+                               const int size, const int total,
+                               const int max) const;
+
+    private:
+        int maxTotal;
+        int maxSize;
+        // both indexed by [total][size][max], with max up to maxTotal
+        std::vector<std::size_t> partitions;
+        std::vector<std::size_t> compositions;
+
+        std::size_t Index(const int total, const int size, const int max) const {
+            return (static_cast<std::size_t>(total)*(maxSize + 1) + size)
+                * (maxTotal + 1) + max;
+        }
+};
+
+// a partition either has a first entry of max or all of its entries are less
+// than max; a composition is any allowed first entry followed by a composition
+// of what's left
+inline PartitionCounts::PartitionCounts(const int maxTotal, const int maxSize):
+        maxTotal(maxTotal), maxSize(maxSize),
+        partitions((maxTotal + 1)*(maxSize + 1)*(maxTotal + 1), 0),
+        compositions(partitions.size(), 0) {
+    for (int size = 0; size <= maxSize; ++size) {
+        for (int total = 0; total <= maxTotal; ++total) {
+            for (int max = 0; max <= maxTotal; ++max) {
+                std::size_t& p = partitions[Index(total, size, max)];
+                std::size_t& c = compositions[Index(total, size, max)];
+                if (size == 0 || total == 0) {
+                    p = c = (total == 0);
+                    continue;
+                }
+                if (max > 0) {
+                    p = partitions[Index(total, size, max - 1)];
+                    if (total >= max) {
+                        p += partitions[Index(total - max, size - 1, max)];
+                    }
+                } else {
+                    p = 0;
+                }
+                c = 0;
+                for (int first = 0; first <= std::min(max, total); ++first) {
+                    c += compositions[Index(total - first, size - 1, max)];
+                }
+            }
+        }
+    }
+}
+
+inline std::size_t PartitionCounts::Partitions(const int total, const int size,
+                                               const int max) const {
+    if (total < 0 || size < 0 || max < 0) return 0;
+    return partitions[Index(total, size, std::min(max, total))];
+}
+
+inline std::size_t PartitionCounts::Compositions(const int total,
+        const int size, const int max) const {
+    if (total < 0 || size < 0 || max < 0) return 0;
+    return compositions[Index(total, size, std::min(max, total))];
+}
+
+// everything with the same first j entries and a larger entry j comes first
+template<typename Iterator>
+inline std::size_t PartitionCounts::PartitionRank(Iterator parts,
+                                                  const int size) const {
+    int remaining = 0;
+    for (int j = 0; j < size; ++j) remaining += parts[j];
+    int bound = remaining;
+    std::size_t rank = 0;
+    for (int j = 0; j < size; ++j) {
+        for (int v = std::min(bound, remaining); v > parts[j]; --v) {
+            rank += Partitions(remaining - v, size - j - 1, v);
+        }
+        remaining -= parts[j];
+        bound = parts[j];
+    }
+    return rank;
+}
+
+template<typename Iterator>
+inline void PartitionCounts::PartitionUnrank(std::size_t rank, Iterator parts,
+        const int size, const int total) const {
+    int remaining = total;
+    int bound = total;
+    for (int j = 0; j < size; ++j) {
+        int v = std::min(bound, remaining);
+        for (; v > 0; --v) {
+            const std::size_t count = Partitions(remaining - v, size - j - 1, v);
+            if (rank < count) break;
+            rank -= count;
+        }
+        parts[j] = v;
+        remaining -= v;
+        bound = v;
+    }
+}
+
+template<typename Iterator>
+inline std::size_t PartitionCounts::CompositionRank(Iterator parts,
+        const int size, const int max) const {
+    int remaining = 0;
+    for (int j = 0; j < size; ++j) remaining += parts[j];
+    std::size_t rank = 0;
+    for (int j = 0; j < size; ++j) {
+        for (int v = std::min(max, remaining); v > parts[j]; --v) {
+            rank += Compositions(remaining - v, size - j - 1, max);
+        }
+        remaining -= parts[j];
+    }
+    return rank;
+}
+
+template<typename Iterator>
+inline void PartitionCounts::CompositionUnrank(std::size_t rank,
+        Iterator parts, const int size, const int total, const int max) const {
+    int remaining = total;
+    for (int j = 0; j < size; ++j) {
+        int v = std::min(max, remaining);
+        for (; v > 0; --v) {
+            const std::size_t count = Compositions(remaining - v, size - j - 1,
+                                                   max);
+            if (rank < count) break;
+            rank -= count;
+        }
+        parts[j] = v;
+        remaining -= v;
+    }
+}
+
+#endif
@@ -1,5 +1,10 @@
 #include "poly.hpp"
 
+Poly::Poly(const Mono starter) {
+    terms.push_back(starter);
+    index.emplace(starter.Key(), 0);
+}
+
 // the reason this uses += rather than a copy is so that coefficients can be
 // added for monomials which appear more than once
 Poly::Poly(const std::vector<Mono>& terms){
@@ -7,22 +12,78 @@ Poly::Poly(const std::vector<Mono>& terms){
         std::cerr << "Warning! A Poly has been constructed from an empty Mono."
             << std::endl;
     }
+    reserve(terms.size());
+    std::vector<std::size_t> cancelled;
     for(auto& newTerm : terms){
-        *this += newTerm;
+        Accumulate(newTerm, cancelled);
     }
+    RemoveCancelled(cancelled);
 }
 
-Poly& Poly::operator+=(const Mono& x){
-    if(std::abs<builtin_class>(x.Coeff()) < EPSILON) return *this;
+void Poly::reserve(const std::size_t numTerms) {
+    terms.reserve(numTerms);
+    index.reserve(numTerms);
+}
 
-    for(auto it = terms.begin(); it != terms.end(); ++it) {
-        if(*it == x){
-            it->Coeff() += x.Coeff();
-            if(std::abs<builtin_class>(it->Coeff()) < EPSILON) terms.erase(it);
-            return *this;
+// the position of x in terms, or terms.size() if it's not there; the terms
+// with x's key still have to be compared with x (see Mono::Key())
+std::size_t Poly::Find(const Mono& x) const {
+    auto range = index.equal_range(x.Key());
+    for(auto it = range.first; it != range.second; ++it){
+        if(terms[it->second] == x) return it->second;
+    }
+    return terms.size();
+}
+
+// adds x to the terms, returning whether it cancelled one of them. Cancelled
+// terms are taken out of the index straight away (so adding the same mono 
+// again puts it at the end, as before) but they're only taken out of terms by
+// RemoveCancelled, which does all of them at once
+bool Poly::Accumulate(const Mono& x, std::vector<std::size_t>& cancelled) {
+    if(std::abs<builtin_class>(x.Coeff()) < EPSILON) return false;
+
+    auto range = index.equal_range(x.Key());
+    for(auto it = range.first; it != range.second; ++it){
+        Mono& term = terms[it->second];
+        if(term != x) continue;
+        term.Coeff() += x.Coeff();
+        if(std::abs<builtin_class>(term.Coeff()) < EPSILON){
+            cancelled.push_back(it->second);
+            index.erase(it);
+            return true;
         }
+        return false;
     }
+    index.emplace(x.Key(), terms.size());
     terms.push_back(x);
+    return false;
+}
+
+// takes the cancelled terms out while keeping the others in order
+void Poly::RemoveCancelled(std::vector<std::size_t>& cancelled) {
+    if(cancelled.empty()) return;
+    std::sort(cancelled.begin(), cancelled.end());
+    std::size_t next = 0;
+    std::size_t kept = 0;
+    for(std::size_t i = 0; i < terms.size(); ++i){
+        if(next < cancelled.size() && cancelled[next] == i){
+            ++next;
+            continue;
+        }
+        if(kept != i) terms[kept] = terms[i];
+        ++kept;
+    }
+    terms.resize(kept);
+    index.clear();
+    for(std::size_t i = 0; i < terms.size(); ++i){
+        index.emplace(terms[i].Key(), i);
+    }
+    cancelled.clear();
+}
+
+Poly& Poly::operator+=(const Mono& x){
+    std::vector<std::size_t> cancelled;
+    if(Accumulate(x, cancelled)) RemoveCancelled(cancelled);
     return *this;
 }
 
@@ -31,16 +92,20 @@ Poly& Poly::operator-=(const Mono& x){
 }
 
 Poly& Poly::operator+=(const Poly& x){
+    std::vector<std::size_t> cancelled;
     for(auto& mn : x.terms){
-        *this += mn;
+        Accumulate(mn, cancelled);
     }
+    RemoveCancelled(cancelled);
     return *this;
 }
 
 Poly& Poly::operator-=(const Poly& x){
+    std::vector<std::size_t> cancelled;
     for(auto& mn : x.terms){
-        *this -= mn;
+        Accumulate(-mn, cancelled);
     }
+    RemoveCancelled(cancelled);
     return *this;
 }
 
@@ -75,19 +140,13 @@ Poly Poly::operator-() const{
 }
 
 bool Poly::operator==(const Poly& other) const{
-    bool found;
     for(auto& term1 : terms){
-        found = false;
-        for(auto& term2 : other.terms){
-            if(term1 == term2){
-                if(std::abs<builtin_class>(term1.Coeff() - term2.Coeff()) > EPSILON) {
-                    return false;
-                }
-                found = true;
-                break;
-            }
+        const std::size_t position = other.Find(term1);
+        if(position == other.terms.size()) return false;
+        const Mono& term2 = other.terms[position];
+        if(std::abs<builtin_class>(term1.Coeff() - term2.Coeff()) > EPSILON) {
+            return false;
         }
-        if(!found) return false;
     }
     return true;
 }
@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>       // uint64_t
+#include <unordered_map>
 #include "mono.hpp"
 #include "io.hpp"
 
@@ -16,13 +18,29 @@
 // array. This can also be iterated through with begin() and end().
 // * The output stream operator std::cout << somePoly prints the Poly as a
 // sum of its constituent monos.
+// * The terms stay in the order they were first added, and are found by their
+// Mono::Key() in a hash index, so adding a mono to a Poly is O(1) (amortized).
+// The momenta of the terms must not be changed through the non-const 
+// accessors, since the index wouldn't know about it; the coefficients can be.
 class Poly {
     std::vector<Mono> terms;
+    // Key() of each term -> its position in terms
+    std::unordered_multimap<std::uint64_t, std::size_t> index;
+
+    std::size_t Find(const Mono& x) const;
+    bool Accumulate(const Mono& x, std::vector<std::size_t>& cancelled);
+    void RemoveCancelled(std::vector<std::size_t>& cancelled);
 
     public:
         explicit Poly() {}
-        explicit Poly(const Mono starter) { terms.push_back(starter); }
+        explicit Poly(const Mono starter);
         explicit Poly(const std::vector<Mono>& terms);
+        // coefficients(i) times the i'th of a list of distinct monos (e.g. a 
+        // column on a Basis<Mono>), without looking for repeats
+        template<typename MonoIterator>
+        Poly(const DVector& coefficients, MonoIterator monos);
+
+        void reserve(const std::size_t numTerms);
 
         Poly& operator+=(const Mono& x);
         Poly& operator-=(const Mono& x);
@@ -69,6 +87,18 @@ class Poly {
 
 };
 
+template<typename MonoIterator>
+Poly::Poly(const DVector& coefficients, MonoIterator monos) {
+    reserve(coefficients.size());
+    for (Eigen::Index i = 0; i < coefficients.size(); ++i, ++monos) {
+        Mono term(*monos);
+        term *= coefficients(i);
+        if (std::abs<builtin_class>(term.Coeff()) < EPSILON) continue;
+        index.emplace(term.Key(), terms.size());
+        terms.push_back(term);
+    }
+}
+
 template<typename T>
 Poly& Poly::operator*=(const T& y){
     for(Mono& m : terms){
@@ -0,0 +1,57 @@
+#include "sparse-poly.hpp"
+
+SparsePoly::SparsePoly(const std::string& exponents, const coeff_class coeff):
+    numVars(exponents.size()) {
+    Add(exponents, coeff);
+}
+
+void SparsePoly::Add(const std::string& termExponents, const coeff_class coeff) {
+    if (termExponents.size() != numVars) {
+        throw std::logic_error("SparsePoly::Add: term has the wrong number of "
+                               "variables");
+    }
+    Add(termExponents.data(), coeff);
+}
+
+void SparsePoly::Reserve(const std::size_t numTerms) {
+    exponents.reserve(numTerms*numVars);
+    coeffs.reserve(numTerms);
+    std::size_t numSlots = 16;
+    while (numSlots < 2*numTerms) numSlots *= 2;
+    if (numSlots > slots.size()) Rehash(numSlots);
+}
+
+SparsePoly& SparsePoly::operator+=(const SparsePoly& other) {
+    if (other.numVars != numVars) {
+        throw std::logic_error("SparsePoly: adding polynomials in different "
+                               "numbers of variables");
+    }
+    for (std::size_t term = 0; term < other.size(); ++term) {
+        Add(other.Exponents(term), other.Coeff(term));
+    }
+    return *this;
+}
+
+SparsePoly& SparsePoly::operator*=(const SparsePoly& other) {
+    if (other.numVars != numVars) {
+        throw std::logic_error("SparsePoly: multiplying polynomials in "
+                               "different numbers of variables");
+    }
+    const std::size_t n = numVars;
+    *this = Product(*this, other, n,
+            [n](const char* a, const char* b, char* output) {
+                for (std::size_t i = 0; i < n; ++i) output[i] = a[i] + b[i];
+                return true;
+            });
+    return *this;
+}
+
+void SparsePoly::Rehash(const std::size_t numSlots) {
+    slots.assign(numSlots, 0);
+    const std::size_t mask = numSlots - 1;
+    for (std::size_t term = 0; term < size(); ++term) {
+        std::size_t slot = Hash(Exponents(term)) & mask;
+        while (slots[slot] != 0) slot = (slot + 1) & mask;
+        slots[slot] = term + 1;
+    }
+}
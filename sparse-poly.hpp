@@ -0,0 +1,137 @@
+#ifndef SPARSE_POLY_HPP
+#define SPARSE_POLY_HPP
+
+// A SparsePoly is a polynomial in a fixed number of variables, with one char
+// per variable for the exponents, the same way exponent lists are passed around
+// in the rest of the program (see e.g. ExtractXY). The exponents of all the
+// terms are packed one after another into a single buffer, and a hash table of
+// indices into it is used to find terms, so adding a term whose exponents are
+// already there just adds to its coefficient: like terms are always collected.
+//
+// This is used for the coordinate transformations in matrix.cpp, where every
+// coefficient is a product of multinomials: these are integers which are
+// exact in coeff_class, so collecting terms doesn't lose any precision.
+// Terms whose coefficients cancel are left in with coefficient 0.
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring> // memcmp
+#include <algorithm> // max
+#include <stdexcept>
+
+#include "constants.hpp"
+
+class SparsePoly {
+    public:
+        explicit SparsePoly(const std::size_t numVars = 0): numVars(numVars) {}
+        SparsePoly(const std::string& exponents, const coeff_class coeff);
+
+        std::size_t NumVars() const { return numVars; }
+        std::size_t size() const { return coeffs.size(); }
+        bool empty() const { return coeffs.empty(); }
+        // the exponents of the given term, which are NumVars() chars long
+        const char* Exponents(const std::size_t term) const {
+            return exponents.data() + term*numVars;
+        }
+        const coeff_class& Coeff(const std::size_t term) const {
+            return coeffs[term];
+        }
+
+        // the index of the term with the given exponents, or size() if there
+        // isn't one
+        std::size_t Find(const char* termExponents) const;
+
+        void Add(const char* termExponents, const coeff_class coeff);
+        void Add(const std::string& termExponents, const coeff_class coeff);
+        void Reserve(const std::size_t numTerms);
+
+        // the product of A and B, a polynomial in numVars variables, where the
+        // exponents of each pair of terms are combined by
+        // combine(expA, expB, output), which returns false if the product
+        // should be dropped; nothing is stored for dropped terms
+        template<typename Combine>
+        static SparsePoly Product(const SparsePoly& A, const SparsePoly& B,
+                                  const std::size_t numVars, Combine&& combine);
+
+        SparsePoly& operator+=(const SparsePoly& other);
+        // the ordinary product, where the exponents of the two terms are added
+        SparsePoly& operator*=(const SparsePoly& other);
+
+    private:
+        std::size_t numVars;
+        // term i's exponents are exponents[i*numVars] to [(i+1)*numVars - 1]
+        std::string exponents;
+        std::vector<coeff_class> coeffs;
+        // open addressing table of (term index + 1), with 0 for empty slots;
+        // its size is always a power of 2 and at least twice the term count
+        std::vector<std::uint32_t> slots;
+
+        std::size_t Hash(const char* termExponents) const;
+        void Rehash(const std::size_t numSlots);
+};
+
+inline SparsePoly operator+(SparsePoly A, const SparsePoly& B) { return A += B; }
+inline SparsePoly operator*(SparsePoly A, const SparsePoly& B) { return A *= B; }
+
+inline void SparsePoly::Add(const char* termExponents, const coeff_class coeff) {
+    if (2*(size() + 1) > slots.size()) Rehash(std::max<std::size_t>(16,
+                                                            2*slots.size()));
+    const std::size_t mask = slots.size() - 1;
+    for (std::size_t slot = Hash(termExponents) & mask; ;
+            slot = (slot + 1) & mask) {
+        if (slots[slot] == 0) {
+            slots[slot] = size() + 1;
+            exponents.append(termExponents, numVars);
+            coeffs.push_back(coeff);
+            return;
+        }
+        const std::size_t term = slots[slot] - 1;
+        if (std::memcmp(Exponents(term), termExponents, numVars) == 0) {
+            coeffs[term] += coeff;
+            return;
+        }
+    }
+}
+
+inline std::size_t SparsePoly::Find(const char* termExponents) const {
+    if (slots.empty()) return size();
+    const std::size_t mask = slots.size() - 1;
+    for (std::size_t slot = Hash(termExponents) & mask; slots[slot] != 0;
+            slot = (slot + 1) & mask) {
+        const std::size_t term = slots[slot] - 1;
+        if (std::memcmp(Exponents(term), termExponents, numVars) == 0) {
+            return term;
+        }
+    }
+    return size();
+}
+
+// FNV-1a, with the top bits folded down since only the low bits are used
+inline std::size_t SparsePoly::Hash(const char* termExponents) const {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < numVars; ++i) {
+        hash ^= static_cast<unsigned char>(termExponents[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash ^ (hash >> 29);
+}
+
+template<typename Combine>
+SparsePoly SparsePoly::Product(const SparsePoly& A, const SparsePoly& B,
+                               const std::size_t numVars, Combine&& combine) {
+    SparsePoly output(numVars);
+    std::string combined(numVars, 0);
+    for (std::size_t a = 0; a < A.size(); ++a) {
+        if (A.Coeff(a) == 0) continue;
+        for (std::size_t b = 0; b < B.size(); ++b) {
+            if (B.Coeff(b) == 0) continue;
+            if (combine(A.Exponents(a), B.Exponents(b), &combined[0])) {
+                output.Add(combined.data(), A.Coeff(a)*B.Coeff(b));
+            }
+        }
+    }
+    return output;
+}
+
+#endif
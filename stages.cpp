@@ -0,0 +1,129 @@
+#include "stages.hpp"
+
+namespace Stages {
+
+namespace {
+    // keyed by {n, degree, odd, options}
+    Memo::Cache<std::array<int,4>, Monomials, boost::hash<std::array<int,4>> >
+        monomialsCache("Stages::GetMonomials");
+    // keyed by {n, maxDegree, odd, options}
+    Memo::Cache<std::array<int,4>, States, boost::hash<std::array<int,4>> >
+        statesCache("Stages::GetStates");
+} // anonymous namespace
+
+std::shared_ptr<const Monomials> GetMonomials(const int n, const int degree,
+                                              const bool odd,
+                                              const Arguments& args) {
+    const std::array<int,4> key{{n, degree, odd, args.options & KEY_OPTIONS}};
+    auto monomials = monomialsCache.Get(key, [n, degree, odd, &args]() {
+            StepOutput output(args);
+            Basis<Mono> basis(n, degree, output.Args(),
+                              odd ? Parity::Odd : Parity::Even);
+            return Monomials{std::move(basis), output.ConsoleText()};
+        });
+    *args.console << monomials->log;
+    return monomials;
+}
+
+std::vector<Basis<Mono>> InputBases(const int n, const int maxDegree,
+                                    const bool odd, const Arguments& args) {
+    std::vector<Basis<Mono>> inputBases;
+    for (int deg = n; deg <= maxDegree; ++deg) {
+        inputBases.push_back(GetMonomials(n, deg, odd, args)->basis);
+    }
+    return inputBases;
+}
+
+// this is Orthogonalize() with the Gram matrix kept as well
+std::shared_ptr<const States> GetStates(const int n, const int maxDegree,
+                                        const bool odd, const Arguments& args) {
+    const std::array<int,4> key{{n, maxDegree, odd,
+                                 args.options & KEY_OPTIONS}};
+    auto states = statesCache.Get(key, [n, maxDegree, odd, &args]() {
+            StepOutput output(args);
+            OStream& console = *output.Args().console;
+            const std::vector<Basis<Mono>> inputBases = InputBases(n, maxDegree,
+                    odd, output.Args());
+
+            Timer timer;
+            Basis<Mono> basis = CombineBases(inputBases);
+            Normalize(basis);
+            DMatrix gram = GramFock(basis);
+            std::vector<Poly> orthogonalized;
+            if (gram.rows() != 0) {
+                console << "Gram matrix constructed in "
+                    << timer.TimeElapsedInWords() << "." << endl;
+                orthogonalized = Orthogonalize(basis, gram, console);
+            }
+            Basis<Mono> minBasis = MinimalBasis(orthogonalized);
+            return States{std::move(basis), std::move(gram), 
+                          std::move(orthogonalized), std::move(minBasis), 
+                          output.ConsoleText()};
+        });
+    *args.console << states->log;
+    return states;
+}
+
+std::size_t ApproxBytes(const Monomials& monomials) {
+    return sizeof(monomials) + monomials.log.capacity()
+        + monomials.basis.size()*sizeof(Mono);
+}
+
+std::size_t ApproxBytes(const States& states) {
+    return sizeof(states) + states.log.capacity()
+        + (states.basis.size() + states.minBasis.size())*sizeof(Mono)
+        + states.orthogonalized.size()*sizeof(Poly)
+        + states.gram.size()*sizeof(coeff_class);
+}
+
+} // namespace Stages
+
+#ifdef NO_GUI
+StepOutput::StepOutput(const Arguments& original): args(original) {
+    args.console = &consoleBuffer;
+    args.outStream = (original.outStream == original.console ? &consoleBuffer
+                                                             : &outBuffer);
+}
+
+// the console writes to std::cout as well, so the log goes in with it
+std::ostream& StepOutput::Log() {
+    return consoleBuffer;
+}
+
+std::string StepOutput::ConsoleText() {
+    return consoleBuffer.str();
+}
+
+void StepOutput::WriteTo(const Arguments& original) {
+    *original.outStream << outBuffer.str();
+    original.outStream->flush();
+    *original.console << consoleBuffer.str();
+    original.console->flush();
+}
+#else
+StepOutput::StepOutput(const Arguments& original): args(original),
+        outBuffer(&outText), consoleBuffer(&consoleText) {
+    args.console = &consoleBuffer;
+    args.outStream = (original.outStream == original.console ? &consoleBuffer
+                                                             : &outBuffer);
+}
+
+std::ostream& StepOutput::Log() {
+    return logBuffer;
+}
+
+std::string StepOutput::ConsoleText() {
+    consoleBuffer.flush();
+    return consoleText.toStdString();
+}
+
+void StepOutput::WriteTo(const Arguments& original) {
+    outBuffer.flush();
+    consoleBuffer.flush();
+    *original.outStream << outText;
+    original.outStream->flush();
+    *original.console << consoleText;
+    original.console->flush();
+    std::cout << logBuffer.str() << std::flush;
+}
+#endif
@@ -0,0 +1,98 @@
+#ifndef STAGES_HPP
+#define STAGES_HPP
+
+// The stages of the calculation which only depend on the states at one n,
+// degree and parity: generating the monomials, their Gram matrix, the
+// orthogonalized basis states and the minimal basis of monomials they use.
+//
+// Each stage is memoized in a Memo::Cache, so it's done at most once per
+// process however many things ask for it (the even and odd passes, the -s
+// output, the tests). Whatever a stage prints while it's being computed is
+// kept with its result and printed again for every request, so the output
+// doesn't depend on which request happened to get there first.
+
+#include <array>
+#include <string>
+#include <vector>
+#include <memory>
+#include <sstream>
+
+#include <boost/functional/hash.hpp>
+
+#include "constants.hpp"
+#include "mono.hpp"
+#include "poly.hpp"
+#include "basis.hpp"
+#include "memo.hpp"
+#include "timer.hpp"
+#include "gram-schmidt.hpp"
+
+// Everything printed by one step of a calculation. Steps which run at the same
+// time each print into their own StepOutput (through the streams of Args() and
+// through Log()), and their outputs are written out afterwards in whatever
+// order the steps would have been done one at a time
+class StepOutput {
+    public:
+        explicit StepOutput(const Arguments& original);
+        StepOutput(const StepOutput&) = delete;
+        StepOutput& operator=(const StepOutput&) = delete;
+
+        const Arguments& Args() const { return args; }
+        // for the terms printed by the matrix functions, which use std::cout
+        std::ostream& Log();
+        // what's been printed to the console so far
+        std::string ConsoleText();
+        void WriteTo(const Arguments& original);
+
+    private:
+        Arguments args;
+#ifdef NO_GUI
+        std::ostringstream outBuffer;
+        std::ostringstream consoleBuffer;
+#else
+        QString outText;
+        QString consoleText;
+        QTextStream outBuffer;
+        QTextStream consoleBuffer;
+        std::ostringstream logBuffer;
+#endif
+};
+
+namespace Stages {
+
+// the options which change the states, and so go into the keys; everything
+// else only changes what gets printed
+constexpr int KEY_OPTIONS = OPT_ALLMINUS;
+
+// the monomials of one parity with n particles and the given degree
+struct Monomials {
+    Basis<Mono> basis;
+    std::string log;
+};
+
+// the states of one parity with n particles, using every degree from n up to
+// some maximum
+struct States {
+    // all of the input monomials, combined and normalized
+    Basis<Mono> basis;
+    DMatrix gram;
+    std::vector<Poly> orthogonalized;
+    Basis<Mono> minBasis;
+    std::string log;
+};
+
+std::shared_ptr<const Monomials> GetMonomials(const int n, const int degree,
+                                              const bool odd,
+                                              const Arguments& args);
+std::vector<Basis<Mono>> InputBases(const int n, const int maxDegree,
+                                    const bool odd, const Arguments& args);
+std::shared_ptr<const States> GetStates(const int n, const int maxDegree,
+                                        const bool odd, const Arguments& args);
+
+// for the byte limits of the caches
+std::size_t ApproxBytes(const Monomials& monomials);
+std::size_t ApproxBytes(const States& states);
+
+} // namespace Stages
+
+#endif
@@ -0,0 +1,47 @@
+#include "term-list.hpp"
+
+TermList::TermList(const std::size_t numTerms, const std::size_t width):
+    numTerms(numTerms), width(width) {
+    if (numTerms == 0) return;
+    // value-initialized, so every coefficient, count and exponent starts at 0
+    block.reset(new coeff_class[BlockSize(numTerms, width)]());
+}
+
+TermList::TermList(const TermList& other):
+    numTerms(other.numTerms), width(other.width) {
+    if (numTerms == 0) return;
+    const std::size_t blockSize = BlockSize(numTerms, width);
+    block.reset(new coeff_class[blockSize]);
+    std::memcpy(block.get(), other.block.get(), blockSize*sizeof(coeff_class));
+}
+
+TermList::TermList(TermList&& other) noexcept:
+    numTerms(other.numTerms), width(other.width),
+    block(std::move(other.block)) {
+    other.numTerms = 0;
+    other.width = 0;
+}
+
+TermList& TermList::operator=(const TermList& other) {
+    return *this = TermList(other);
+}
+
+TermList& TermList::operator=(TermList&& other) noexcept {
+    if (this == &other) return *this;
+    numTerms = other.numTerms;
+    width = other.width;
+    block = std::move(other.block);
+    other.numTerms = 0;
+    other.width = 0;
+    return *this;
+}
+
+// the number of coeff_class entries needed for the coefficients, the counts
+// and the exponents, with the last two rounded up to a whole entry
+std::size_t TermList::BlockSize(const std::size_t numTerms,
+                                const std::size_t width) {
+    static_assert(alignof(coeff_class) >= alignof(std::size_t),
+                  "TermList's counts would be misaligned");
+    const std::size_t tailBytes = numTerms*(sizeof(std::size_t) + width);
+    return numTerms + (tailBytes + sizeof(coeff_class) - 1)/sizeof(coeff_class);
+}
@@ -0,0 +1,74 @@
+#ifndef TERM_LIST_HPP
+#define TERM_LIST_HPP
+
+// A TermList is a fixed list of terms, each of which has a coefficient, a count
+// and the same number of char exponents, all stored in one block of memory:
+// first every coefficient, then every count, then the exponents of each term
+// one after another. It's what the memo tables in matrix.cpp keep for the F's
+// of each monomial, so a cached F is a single allocation that the kernels can
+// read straight through, instead of a vector of terms which each own a few
+// little vectors of their own.
+//
+// The count of a term is how many terms were collected into it when it was
+// built (see YTildeFromY); only the interaction integrals use it.
+
+#include <memory>
+#include <cstdint>
+#include <cstring> // memcpy
+#include <utility> // move
+
+#include "constants.hpp"
+
+class TermList {
+    public:
+        TermList(): numTerms(0), width(0) {}
+        // numTerms terms of width exponents each, with coefficient 0, count 0
+        // and all exponents 0
+        TermList(const std::size_t numTerms, const std::size_t width);
+        TermList(const TermList& other);
+        // a list which has been moved from is left empty
+        TermList(TermList&& other) noexcept;
+        TermList& operator=(const TermList& other);
+        TermList& operator=(TermList&& other) noexcept;
+
+        std::size_t size() const { return numTerms; }
+        bool empty() const { return numTerms == 0; }
+        // the number of exponents in each term
+        std::size_t Width() const { return width; }
+
+        const coeff_class& Coeff(const std::size_t term) const {
+            return block[term];
+        }
+        coeff_class& Coeff(const std::size_t term) { return block[term]; }
+        std::size_t Count(const std::size_t term) const { return Counts()[term]; }
+        std::size_t& Count(const std::size_t term) { return Counts()[term]; }
+        // the exponents of the given term, which are Width() chars long
+        const char* Exponents(const std::size_t term) const {
+            return AllExponents() + term*width;
+        }
+        char* Exponents(const std::size_t term) {
+            return AllExponents() + term*width;
+        }
+
+        std::size_t Bytes() const {
+            return sizeof(*this) + BlockSize(numTerms, width)*sizeof(coeff_class);
+        }
+
+    private:
+        std::size_t numTerms;
+        std::size_t width;
+        // the block is made of coeff_class so that it's aligned for them; the
+        // counts and exponents come after the first numTerms entries
+        std::unique_ptr<coeff_class[]> block;
+
+        static std::size_t BlockSize(const std::size_t numTerms,
+                                     const std::size_t width);
+        std::size_t* Counts() const {
+            return reinterpret_cast<std::size_t*>(block.get() + numTerms);
+        }
+        char* AllExponents() const {
+            return reinterpret_cast<char*>(Counts() + numTerms);
+        }
+};
+
+#endif
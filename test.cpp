@@ -25,19 +25,21 @@ bool RunAllTests(const Arguments& args) {
     int numP = 3;
     int degree = 7;
     // std::size_t partitions = 4;
-    std::vector<Basis<Mono>> allEvenBases;
-    std::vector<Basis<Mono>> allOddBases;
-    for (int deg = numP; deg <= degree; ++deg) {
-            splitBasis<Mono> degBasis(numP, deg, args);
-            allEvenBases.push_back(degBasis.EvenBasis());
-            allOddBases.push_back(degBasis.OddBasis());
-    }
-    std::vector<Poly> evenStates = ::Orthogonalize(allEvenBases, console, false);
-    std::vector<Poly> oddStates = ::Orthogonalize(allOddBases, console, true);
-    Basis<Mono> minBasis = ::MinimalBasis(evenStates);
+    const auto evenStates = ::Stages::GetStates(numP, degree, false, args);
+    const auto oddStates = ::Stages::GetStates(numP, degree, true, args);
+    const Basis<Mono>& minBasis = evenStates->minBasis;
     // result &= Test::InteractionMatrix(minBasis, args);
 
     result &= MuPart_NtoN(args);
+    result &= KronMatrix(minBasis, console);
+    result &= ThreadPool(args);
+    result &= Memo(args);
+    result &= Stages(args);
+    result &= DirichletCfgs(console);
+    result &= Partitions(console);
+    result &= FindInBasis(*evenStates, console);
+    result &= PolyArithmetic(console);
+    result &= Multinomial(console);
 
     return result;
 }
@@ -71,8 +73,9 @@ bool InteractionTermsFromXY(OStream& console) {
     };
     for (const auto& xy : testCases) {
         console << "CASE: " << MVectorOut(xy) << endl;
-        for (const auto& term : ::MatrixInternal::InteractionTermsFromXY(xy)) {
-            console << term << endl;
+        auto terms = ::MatrixInternal::InteractionTermsFromXY(xy);
+        for (std::size_t t = 0; t < terms->size(); ++t) {
+            console << ::MatrixInternal::UnpackIntermediate(*terms, t) << endl;
         }
     }
 
@@ -150,7 +153,7 @@ bool Expand(OStream& console) {
                                            {{5, 4, 0}},
                                            {{2, 2, 4}}};
     for (const auto& rCase : rCases) {
-        ::MatrixInternal::NtoN_Final expanded(::MatrixInternal::Expand(rCase, 0));
+        ::MatrixInternal::NtoN_Final expanded(*::MatrixInternal::Expand(rCase, 0));
         console << rCase << " ->\n";
         for (const auto& pair : expanded) {
             console << '(' << pair.first << ',' << pair.second << ")\n";
@@ -170,6 +173,18 @@ bool UPlusIntegral(OStream& console) {
     passed &= UPlusIntegral_Case(5, 2, 0.0634921, console);
     passed &= UPlusIntegral_Case(2, 4, 0.0833333, console);
     passed &= UPlusIntegral_Case(8, 8, 0.0015873, console);
+    passed &= UPlusIntegral_Case(1, 3, 0.19635, console);
+    passed &= UPlusIntegral_Case(61, 78, 2.97787e-22, console);
+    // the table exists by now, but exponents outside it still have to be caught
+    for (const int a : {-1, -3}) {
+        try {
+            ::MatrixInternal::ThetaIntegral_Short(a, 0);
+            console << "ThetaIntegral_Short(" << a << ", 0) didn't throw (FAIL)"
+                << endl;
+            passed = false;
+        }
+        catch (const std::domain_error&) {}
+    }
 
     if (passed) {
         console << "----- PASSED -----" << endl;
@@ -180,7 +195,7 @@ bool UPlusIntegral(OStream& console) {
     }
 }
 
-bool UPlusIntegral_Case(const builtin_class a, const builtin_class b, 
+bool UPlusIntegral_Case(const int a, const int b, 
         const builtin_class expected, OStream& console) {
     constexpr builtin_class tol = 1e-5;
     builtin_class answer = ::MatrixInternal::UPlusIntegral(a, b);
@@ -233,11 +248,60 @@ bool Hypergeometric(OStream& console) {
     passed &= HypergeometricPFQ_Reg_Case<3,2>({{1,2,-3}}, {{-4,-5}}, 0.6, 0.0, console);
     passed &= HypergeometricPFQ_Reg_Case<3,2>({{1,2,3}}, {{-4,-5}}, 0.6, 4.61311e14, console);
 
-    // argument x=1 requires special treatment that's not implemented yet
-    // passed &= HypergeometricPFQ_Case<2,1>({{1,2}}, {{4}}, 1.0, 3.0, console);
-    // passed &= HypergeometricPFQ_Reg_Case<2,1>({{1,2}}, {{4}}, 1.0, 0.5, console);
-    // passed &= HypergeometricPFQ_Case<3,2>({{1,2,3}}, {{4,5}}, 1.0, 1.56475, console);
-    // passed &= HypergeometricPFQ_Reg_Case<3,2>({{1,2,3}}, {{4,5}}, 1.0, 0.0108663, console);
+    // the batches have to give exactly what the single arguments give,
+    // including the special cases (x=1 here) and with more than one batch
+    std::array<builtin_class,2*HYPERGEO_LANES + 3> xs;
+    for (std::size_t i = 0; i < xs.size(); ++i) xs[i] = builtin_class(i)/(xs.size() - 1);
+    std::array<HypergeoResult,xs.size()> batch;
+    HypergeometricPFQ_Reg_Batch<3,2>({{1,2,-3}}, {{4,5}}, xs.data(), xs.size(),
+                                     batch.data());
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        passed &= (batch[i].status != HypergeoStatus::Failed);
+        passed &= (batch[i].value == HypergeometricPFQ_Reg<3,2>({{1,2,-3}}, {{4,5}}, xs[i]));
+    }
+    HypergeometricPFQ_Reg_Batch<2,1>({{0.5,1.5}}, {{2.5}}, xs.data(), 
+                                     xs.size() - 1, batch.data());
+    for (std::size_t i = 0; i + 1 < xs.size(); ++i) {
+        passed &= (batch[i].status != HypergeoStatus::Failed);
+        passed &= (batch[i].value == HypergeometricPFQ_Reg<2,1>({{0.5,1.5}}, {{2.5}}, xs[i]));
+    }
+
+    // argument x=1
+    passed &= HypergeometricPFQ_Case<2,1>({{1,2}}, {{4}}, 1.0, 3.0, console);
+    passed &= HypergeometricPFQ_Reg_Case<2,1>({{1,2}}, {{4}}, 1.0, 0.5, console);
+    passed &= HypergeometricPFQ_Case<3,2>({{1,2,3}}, {{4,5}}, 1.0, 1.56475, console);
+    passed &= HypergeometricPFQ_Reg_Case<3,2>({{1,2,3}}, {{4,5}}, 1.0, 0.0108663, console);
+    // here the series from Thomae's relation terminates after 2 terms
+    passed &= HypergeoStatus_Case(HypergeoThomae_Reg({{3.5,0.5,0.25}}, 
+                {{2.5,4.1}}), HypergeoStatus::Transformed, 0.117202207469961,
+            console);
+
+    // the slow series near x=1 are accelerated, 2F1 is transformed near x=1 
+    // and below x=-1, and anything else outside |x| < 1 fails
+    const builtin_class nearOne = 0.999;
+    passed &= HypergeoStatus_Case(HypergeometricPFQ_Reg_Status<2,1>({{1,1}}, 
+                {{2}}, nearOne), HypergeoStatus::Accelerated, 
+            -std::log1p(-nearOne)/nearOne, console);
+    passed &= HypergeoStatus_Case(HypergeometricPFQ_Reg_Status<3,2>({{1,1,1}},
+                {{2,2}}, 1), HypergeoStatus::Accelerated, M_PI*M_PI/6, console);
+    // very close to x=1 the last terms are tiny long before the rest of the
+    // series is, so it mustn't stop on them alone (values from mpmath's 
+    // hyp3f2, divided by the gammas of the b's; pip install mpmath)
+    passed &= HypergeoStatus_Case(HypergeometricPFQ_Reg_Status<3,2>(
+                {{0.5,0.5,2}}, {{1,3}}, 0.9999), HypergeoStatus::Series,
+            0.707083468481574791, console);
+    passed &= HypergeoStatus_Case(HypergeometricPFQ_Reg_Status<3,2>(
+                {{0.5,0.5,2}}, {{1,3}}, 0.99999), HypergeoStatus::Series,
+            0.707320793857426064, console);
+    passed &= HypergeoStatus_Case(HypergeometricPFQ_Reg_Status<2,1>({{0.5,0.5}},
+                {{1.5}}, 0.97), HypergeoStatus::Transformed, 
+            std::asin(std::sqrt(0.97))/std::sqrt(0.97)/std::tgamma(1.5), 
+            console);
+    passed &= HypergeoStatus_Case(HypergeometricPFQ_Reg_Status<2,1>({{1,1}}, 
+                {{2}}, -3), HypergeoStatus::Transformed, std::log(4.0)/3, 
+            console);
+    passed &= (HypergeometricPFQ_Reg_Status<3,2>({{1,2,3}}, {{4,5}}, 
+                1.5).status == HypergeoStatus::Failed);
 
     if (passed) {
         console << "----- PASSED -----" << endl;
@@ -247,6 +311,26 @@ bool Hypergeometric(OStream& console) {
     return passed;
 }
 
+// these are checked more tightly than the HypergeometricPFQ cases, since being
+// accurate where the plain series isn't is the point of the other strategies
+bool HypergeoStatus_Case(const HypergeoResult& result, 
+        const HypergeoStatus expected, const builtin_class expectedValue,
+        OStream& console) {
+    constexpr builtin_class tol = 1e-8;
+    const builtin_class answer = static_cast<builtin_class>(result.value);
+    console << "HypergeoResult{" << answer << ", " 
+        << static_cast<int>(result.status) << ", " << result.iterations << "}";
+    if (result.status == expected 
+            && std::abs(answer - expectedValue) <= tol*std::abs(expectedValue)) {
+        console << " == " << expectedValue << " (PASS)" << endl;
+        return true;
+    } else {
+        console << " != {" << expectedValue << ", " 
+            << static_cast<int>(expected) << "} (FAIL)" << endl;
+        return false;
+    }
+}
+
 bool InteractionMatrix(const Basis<Mono>& basis, const Arguments& args) {
     OStream& console = *args.console;
     console << "----- ::InteractionMatrix -----" << endl;
@@ -258,7 +342,7 @@ bool InteractionMatrix(const Basis<Mono>& basis, const Arguments& args) {
 bool MuPart_NtoN(const Arguments& args) {
     OStream& console = *args.console;
     console << "----- ::MuPart_NtoN -----" << endl;
-    DMatrix muPart = ::MuPart_NtoN(3, {{0, 0}}, 5);
+    DMatrix muPart = *::MuPart_NtoN(3, {{0, 0}}, 5);
     DMatrix reference(5, 5);
     reference << 0.2385140, 0.1321650, 0.0947868, 0.0783601, 0.0683649,
                  0.1321650, 0.1717750, 0.1140410, 0.0866316, 0.0733793,
@@ -277,4 +361,417 @@ bool MuPart_NtoN(const Arguments& args) {
     }
 }
 
+// the Kronecker form of the free matrices should agree with the old way of
+// doing things, i.e. sandwiching the dense matrix between discretized polys
+bool KronMatrix(const Basis<Mono>& basis, OStream& console) {
+    console << "----- ::KronMatrix -----" << endl;
+    constexpr std::size_t partitions = 3;
+    ::KronMatrix mono = ::MassMatrix(basis, partitions)
+                      + 2*::KineticMatrix(basis, partitions);
+    DMatrix monoDense = mono.Dense();
+
+    DMatrix polys = DMatrix::Random(basis.size(), 2);
+    SMatrix discPolys = DiscretizePolys(polys, partitions);
+    DMatrix expected = discPolys.transpose()*monoDense*discPolys;
+    DMatrix projected = mono.Project(polys, polys).Dense();
+
+    builtin_class scale = expected.cwiseAbs().maxCoeff();
+    builtin_class error = (projected - expected).cwiseAbs().maxCoeff();
+    for (Eigen::Index i = 0; i < monoDense.rows(); ++i) {
+        for (Eigen::Index j = 0; j < monoDense.cols(); ++j) {
+            builtin_class diff = mono(i, j) - monoDense(i, j);
+            error = std::max(error, std::abs(diff));
+        }
+    }
+    if (error <= 1e-12*scale) {
+        console << "----- PASSED -----" << endl;
+        return true;
+    } else {
+        console << "projected:\n" << projected << "\nexpected:\n" << expected 
+            << '\n';
+        console << "----- FAILED -----" << endl;
+        return false;
+    }
+}
+
+// nested ParallelFors, a TaskGroup and a Future all at once, on more threads 
+// than there are outer tasks, so that the inner ones have to be stolen
+bool ThreadPool(const Arguments& args) {
+    OStream& console = *args.console;
+    console << "----- Pool -----" << endl;
+    Pool::SetThreads(4);
+
+    constexpr std::size_t outer = 3;
+    constexpr std::size_t inner = 100;
+    std::vector<std::size_t> sums(outer, 0);
+    Pool::ParallelFor(outer, [&sums](const std::size_t i) {
+            std::vector<std::size_t> values(inner);
+            Pool::ParallelFor(inner, [&values, i](const std::size_t j) {
+                    values[j] = i*inner + j;
+                });
+            for (auto value : values) sums[i] += value;
+        });
+    std::size_t total = 0;
+    for (auto sum : sums) total += sum;
+
+    std::atomic<std::size_t> groupTotal(0);
+    Pool::TaskGroup group;
+    for (std::size_t i = 0; i < outer*inner; ++i) {
+        group.Run([&groupTotal, i]() { groupTotal += i; });
+    }
+    auto future = Pool::Async([&group, &groupTotal]() { 
+            group.Wait();
+            return groupTotal.load();
+        });
+
+    bool threw = false;
+    try {
+        Pool::ParallelFor(inner, [](const std::size_t j) {
+                if (j == inner/2) throw std::runtime_error("test");
+            });
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+
+    const std::size_t expected = outer*inner*(outer*inner - 1)/2;
+    const std::size_t fromFuture = future.Get();
+    Pool::SetThreads(args.threads);
+    if (total == expected && fromFuture == expected && threw) {
+        console << "----- PASSED -----" << endl;
+        return true;
+    } else {
+        console << "ParallelFor: " << total << ", TaskGroup: " << fromFuture
+            << ", expected " << expected << "; exception " 
+            << (threw ? "rethrown" : "lost") << endl;
+        console << "----- FAILED -----" << endl;
+        return false;
+    }
+}
+
+// a key asked for again while it's being computed, by the thread computing it
+// or by others, mustn't leave anyone waiting forever; nor may keys which wait
+// on the Pool while they're computed, asked for by several tasks at once
+bool Memo(const Arguments& args) {
+    OStream& console = *args.console;
+    console << "----- Memo -----" << endl;
+    Pool::SetThreads(4);
+    ::Memo::Cache<int, int> cache("Test::Memo");
+
+    const int nested = *cache.Get(0, [&cache]() {
+            return *cache.Get(0, []() { return 1; }) + 1;
+        });
+    bool result = (nested == 2 && *cache.Get(0, []() { return 3; }) == 2);
+
+    // while a key waits for its inner ParallelFor, its thread mustn't pick up
+    // the other top-level tasks, which go through the keys in other orders and
+    // so ask for keys the other threads are on; and each key is computed once
+    constexpr int numKeys = 30;
+    constexpr std::size_t inner = 20;
+    constexpr std::size_t outer = 8;
+    std::vector<std::vector<int>> values(outer, std::vector<int>(numKeys));
+    std::array<std::atomic<int>,numKeys> computed{};
+    // nothing can be evicted, or it would be computed again
+    cache.SetByteLimit(0);
+    {
+        Pool::TaskGroup tasks;
+        for (std::size_t t = 0; t < outer; ++t) {
+            tasks.Run([&cache, &values, &computed, t]() {
+                    for (int k = 0; k < numKeys; ++k) {
+                        const int key = 1 + (7*k + 11*int(t)) % numKeys;
+                        values[t][key-1] = *cache.Get(key, 
+                            [&computed, key]() {
+                                ++computed[key-1];
+                                std::atomic<int> total(0);
+                                Pool::ParallelFor(inner, 
+                                        [&total](const std::size_t j) {
+                                            total += j;
+                                        });
+                                return key + total.load();
+                            });
+                    }
+                });
+        }
+        tasks.Wait();
+    }
+    for (int key = 1; key <= numKeys; ++key) {
+        result &= (computed[key-1] == 1);
+        for (std::size_t t = 0; t < outer; ++t) {
+            result &= (values[t][key-1] == key + int(inner*(inner - 1)/2));
+        }
+    }
+    Pool::SetThreads(args.threads);
+
+    if (result) {
+        console << "----- PASSED -----" << endl;
+    } else {
+        console << "----- FAILED -----" << endl;
+    }
+    return result;
+}
+
+// the stages asked for again (with the other parity first this time) should
+// come straight out of the caches, and match Orthogonalize() done from scratch
+bool Stages(const Arguments& args) {
+    OStream& console = *args.console;
+    console << "----- Stages -----" << endl;
+    const int numP = 3;
+    const int degree = 7;
+    const auto oddStates = ::Stages::GetStates(numP, degree, true, args);
+    const auto evenStates = ::Stages::GetStates(numP, degree, false, args);
+    bool result = (oddStates == ::Stages::GetStates(numP, degree, true, args));
+    result &= (evenStates == ::Stages::GetStates(numP, degree, false, args));
+
+    for (const bool odd : {false, true}) {
+        std::vector<Basis<Mono>> inputBases;
+        for (int deg = numP; deg <= degree; ++deg) {
+            splitBasis<Mono> degBasis(numP, deg, args);
+            inputBases.push_back(odd ? degBasis.OddBasis() 
+                                     : degBasis.EvenBasis());
+        }
+        const std::vector<Poly> expected = ::Orthogonalize(inputBases, 
+                                                           console, odd);
+        const auto& states = (odd ? oddStates : evenStates);
+        if (expected.size() != states->orthogonalized.size()) {
+            result = false;
+            continue;
+        }
+        for (std::size_t i = 0; i < expected.size(); ++i) {
+            result &= (expected[i] == states->orthogonalized[i]);
+        }
+    }
+
+    if (result) {
+        console << "----- PASSED -----" << endl;
+    } else {
+        console << "----- FAILED -----" << endl;
+    }
+    return result;
+}
+
+// the states should come out in the same order as the old method, which made
+// every P_- configuration, then every P_\perp configuration for each of those
+// and then filtered them by parity
+bool DirichletCfgs(OStream& console) {
+    console << "----- DirichletCfgs -----" << endl;
+    bool result = true;
+    for (const bool allMinus : {false, true}) {
+        for (int numP = 1; numP <= 5; ++numP) {
+            for (int degree = numP; degree <= numP + 6; ++degree) {
+                const int energy = degree - numP;
+                std::vector<std::vector<particle>> expected;
+                for (auto& minus : GetStatesByDegree<int>(numP, energy, 
+                                                          allMinus, 0)) {
+                    std::vector<particle> cfg(numP);
+                    for (int i = 0; i < numP; ++i) cfg[i].pm = minus[i];
+                    int remaining = energy;
+                    for (auto pm : minus) remaining -= pm;
+                    std::vector<std::vector<particle>> withPerp{cfg};
+                    if (!allMinus) {
+                        withPerp = CombinedCfgs(cfg, CfgsFromNodes(remaining,
+                                                IdentifyNodes(minus), true), 2);
+                    }
+                    for (auto& newCfg : withPerp) {
+                        for (auto& part : newCfg) ++part.pm;
+                        expected.push_back(newCfg);
+                    }
+                }
+
+                for (const Parity parity : 
+                        {Parity::All, Parity::Even, Parity::Odd}) {
+                    auto skip = [&expected, parity](std::size_t next) {
+                        while (next < expected.size() && parity != Parity::All
+                                && splitBasis<Mono>::IsOdd(Mono(expected[next]))
+                                    != (parity == Parity::Odd)) {
+                            ++next;
+                        }
+                        return next;
+                    };
+                    std::size_t next = skip(0);
+                    bool match = true;
+                    for (::DirichletCfgs cfgs(numP, degree, allMinus, parity);
+                            cfgs.Next(); ) {
+                        if (next == expected.size() 
+                                || cfgs.Current() != expected[next]) {
+                            match = false;
+                            break;
+                        }
+                        next = skip(next + 1);
+                    }
+                    if (!match || next != expected.size()) {
+                        console << "Mismatch at N=" << numP << ", D=" << degree
+                            << (allMinus ? " (all minus)" : "") << endl;
+                        result = false;
+                    }
+                }
+            }
+        }
+    }
+
+    if (result) {
+        console << "----- PASSED -----" << endl;
+    } else {
+        console << "----- FAILED -----" << endl;
+    }
+    return result;
+}
+
+// every sequence stepped through should be counted, and have its position as
+// its rank
+bool Partitions(OStream& console) {
+    console << "----- Partitions -----" << endl;
+    const int maxTotal = 9;
+    const int maxSize = 5;
+    const PartitionCounts counts(maxTotal, maxSize);
+    bool result = true;
+    std::vector<int> parts(maxSize);
+    std::vector<int> unranked(maxSize);
+    for (int size = 1; size <= maxSize; ++size) {
+        for (int total = 0; total <= maxTotal; ++total) {
+            std::size_t rank = 0;
+            FirstPartition(parts.begin(), size, total);
+            do {
+                counts.PartitionUnrank(rank, unranked.begin(), size, total);
+                result &= (counts.PartitionRank(parts.begin(), size) == rank);
+                result &= std::equal(parts.begin(), parts.begin() + size,
+                                     unranked.begin());
+                ++rank;
+            } while (NextPartition(parts.begin(), size, total, true));
+            result &= (rank == counts.Partitions(total, size));
+
+            for (int max = 0; max <= 4; ++max) {
+                rank = 0;
+                if (FirstComposition(parts.begin(), size, total, max)) {
+                    do {
+                        counts.CompositionUnrank(rank, unranked.begin(), size,
+                                                 total, max);
+                        result &= (counts.CompositionRank(parts.begin(), size,
+                                                          max) == rank);
+                        result &= std::equal(parts.begin(),
+                                parts.begin() + size, unranked.begin());
+                        ++rank;
+                    } while (NextComposition(parts.begin(), size, max));
+                }
+                result &= (rank == counts.Compositions(total, size, max));
+            }
+        }
+        // the partitions with sums up to some total are all of the above
+        std::size_t upTo = 0;
+        FirstPartition(parts.begin(), size, maxTotal);
+        do {
+            ++upTo;
+        } while (NextPartition(parts.begin(), size, maxTotal, false));
+        std::size_t expected = 0;
+        for (int total = 0; total <= maxTotal; ++total) {
+            expected += counts.Partitions(total, size);
+        }
+        result &= (upTo == expected);
+    }
+
+    if (result) {
+        console << "----- PASSED -----" << endl;
+    } else {
+        console << "----- FAILED -----" << endl;
+    }
+    return result;
+}
+
+// the indexed minimal basis should find the same things as scanning through it
+bool FindInBasis(const ::Stages::States& states, OStream& console) {
+    console << "----- FindInBasis -----" << endl;
+    const Basis<Mono>& indexed = states.minBasis;
+    const Basis<Mono> scanned(std::vector<Mono>(indexed.begin(), 
+                                                indexed.end()));
+    bool result = indexed.Indexed() && !scanned.Indexed();
+    for (std::size_t i = 0; i < indexed.size(); ++i) {
+        result &= (indexed.FindInBasis(indexed[i]) == i);
+    }
+    for (const auto& poly : states.orthogonalized) {
+        result &= (indexed.DenseExpressPoly(poly) 
+                   == scanned.DenseExpressPoly(poly));
+    }
+
+    if (result) {
+        console << "----- PASSED -----" << endl;
+    } else {
+        console << "----- FAILED -----" << endl;
+    }
+    return result;
+}
+
+// terms which cancel should disappear, leaving the others in order, and come
+// back at the end if they're added again
+bool PolyArithmetic(OStream& console) {
+    console << "----- PolyArithmetic -----" << endl;
+    const Mono a({2, 1}, {0, 0});
+    const Mono b({1, 1}, {1, 0});
+    const Mono c({1, 1}, {2, 0});
+    const Mono d({3, 1}, {0, 0});
+
+    Poly poly(std::vector<Mono>{a, 2*b, c, -b, d});
+    bool result = (poly.size() == 4 && poly[1] == b && poly[1].Coeff() == 1);
+    poly -= Poly(std::vector<Mono>{b, a});
+    result &= (poly.size() == 2 && poly[0] == c && poly[1] == d);
+    poly += 3*a;
+    result &= (poly.size() == 3 && poly[2] == a && poly[2].Coeff() == 3);
+    result &= (poly == Poly(std::vector<Mono>{3*a, d, c}));
+    result &= (poly != Poly(std::vector<Mono>{a, d, c}));
+
+    DVector column(3);
+    column << 1, 0, -2;
+    const Basis<Mono> basis(std::vector<Mono>{a, b, c});
+    const Poly fromColumn(column, basis.begin());
+    result &= (fromColumn.size() == 2 && fromColumn[1] == c
+               && fromColumn[1].Coeff() == -2);
+
+    if (result) {
+        console << "----- PASSED -----" << endl;
+    } else {
+        console << "----- FAILED -----" << endl;
+    }
+    return result;
+}
+
+// the tables should give n!/(m_1! m_2! ...) for the m's in any order, and the
+// views of the mVectors shouldn't be disturbed by filling the table further
+bool Multinomial(OStream& console) {
+    console << "----- Multinomial -----" << endl;
+    bool result = true;
+    for (char p = 1; p <= 5; ++p) {
+        const auto early = ::Multinomial::GetMVectors(p, 4);
+        const std::vector<std::string> copied(early.begin(), early.end());
+        for (char n = 0; n <= 9; ++n) {
+            for (const auto& nAndm : ::Multinomial::GetMVectors(p, n)) {
+                coeff_class expected = Factorial(n);
+                for (char i = 1; i <= p; ++i) expected /= Factorial(nAndm[i]);
+                std::string reversed(nAndm);
+                std::reverse(reversed.begin() + 1, reversed.end());
+                result &= (::Multinomial::Lookup(p, nAndm) == expected);
+                result &= (::Multinomial::Lookup(p, reversed) == expected);
+                // the Pascal table must agree with the compile-time binomials
+                result &= (::Multinomial::GetTable(p, n)->Lookup(reversed)
+                           == expected);
+            }
+        }
+        result &= std::equal(copied.begin(), copied.end(), early.begin(),
+                             early.end());
+    }
+    for (char n = 0; n <= 30; ++n) {
+        for (char m = -1; m <= n + 1; ++m) {
+            const coeff_class expected = (m < 0 || m > n) ? 0 :
+                Factorial(n) / (Factorial(m)*Factorial(n - m));
+            result &= (::Multinomial::Choose(n, m) == expected);
+        }
+    }
+    result &= (::Multinomial::Choose(::Multinomial::MAX_ORDER, 1)
+               == ::Multinomial::MAX_ORDER);
+
+    if (result) {
+        console << "----- PASSED -----" << endl;
+    } else {
+        console << "----- FAILED -----" << endl;
+    }
+    return result;
+}
+
 } // namespace Test
@@ -11,6 +11,10 @@
 #include "discretization.hpp"
 #include "gram-schmidt.hpp"
 #include "hypergeo.hpp"
+#include "thread-pool.hpp"
+#include "memo.hpp"
+#include "stages.hpp"
+#include "multinomial.hpp"
 
 // This file contains unit tests for various functions; for a function named
 // Namespace::Function, the test will be Test::Namespace::Function, and will be
@@ -29,14 +33,26 @@ bool InteractionTermsFromXY(OStream& console);
 bool CombineInteractionFs(OStream& console);
 bool Expand(OStream& console);
 bool UPlusIntegral(OStream& console);
-bool UPlusIntegral_Case(const builtin_class a, const builtin_class b, 
+bool UPlusIntegral_Case(const int a, const int b, 
         const builtin_class expected, OStream& console);
 
 } // namespace MatrixInternal
 
 bool Hypergeometric(OStream& console);
+bool HypergeoStatus_Case(const HypergeoResult& result, 
+        const HypergeoStatus expected, const builtin_class expectedValue,
+        OStream& console);
 bool InteractionMatrix(const Basis<Mono>& basis, const Arguments& args);
 bool MuPart_NtoN(const Arguments& args);
+bool KronMatrix(const Basis<Mono>& basis, OStream& console);
+bool ThreadPool(const Arguments& args);
+bool Memo(const Arguments& args);
+bool Stages(const Arguments& args);
+bool DirichletCfgs(OStream& console);
+bool Partitions(OStream& console);
+bool FindInBasis(const ::Stages::States& states, OStream& console);
+bool PolyArithmetic(OStream& console);
+bool Multinomial(OStream& console);
 
 // templates for testing templates --------------------------------------------
 
@@ -0,0 +1,286 @@
+#include "thread-pool.hpp"
+
+#include <deque>
+#include <thread>
+#include <algorithm> // min, max, swap
+
+namespace Pool {
+
+namespace {
+    typedef std::shared_ptr<const Isolation::Node> IsolationPtr;
+
+    // a queued task and the Isolation it was submitted in (null if none)
+    struct Job {
+        std::function<void()> task;
+        IsolationPtr isolation;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> tasks;
+    };
+
+    class Scheduler {
+        public:
+            ~Scheduler() { Stop(); }
+
+            void SetThreads(const unsigned int threads);
+            unsigned int Threads() const;
+            void Submit(std::function<void()> task);
+            bool RunOne();
+
+        private:
+            unsigned int requestedThreads = 0;
+            // queues[i] belongs to worker i, and the last one is for tasks
+            // submitted from outside the pool
+            std::vector<std::unique_ptr<Queue>> queues;
+            std::vector<std::thread> workers;
+            std::atomic<bool> running{false};
+            std::atomic<bool> stopping{false};
+            std::mutex startMutex;
+            // the workers sleep on this when there's nothing queued
+            std::atomic<std::size_t> queued{0};
+            std::mutex sleepMutex;
+            std::condition_variable wake;
+
+            void Start();
+            void Stop();
+            void WorkerLoop(const std::size_t index);
+            bool Take(Queue& queue, const bool fromBack, Job& job);
+    };
+
+    Scheduler& GetScheduler() {
+        static Scheduler scheduler;
+        return scheduler;
+    }
+
+    // the index of this thread's queue if it's one of the workers, or -1
+    thread_local int workerIndex = -1;
+    // the scheduler whose worker this is, so that a thread from a stopped pool
+    // never touches the queues of a new one
+    thread_local const void* workerOf = nullptr;
+    // the innermost Isolation this thread is in, or null
+    thread_local IsolationPtr currentIsolation;
+
+    // whether this thread can run a task submitted in the given Isolation,
+    // i.e. whether that's this thread's Isolation or one nested inside it
+    bool Runnable(const IsolationPtr& isolation) {
+        if (!currentIsolation) return true;
+        for (const Isolation::Node* node = isolation.get(); node != nullptr;
+                node = node->parent.get()) {
+            if (node == currentIsolation.get()) return true;
+        }
+        return false;
+    }
+} // anonymous namespace
+
+void Scheduler::SetThreads(const unsigned int threads) {
+    std::lock_guard<std::mutex> lock(startMutex);
+    requestedThreads = threads;
+    Stop();
+}
+
+unsigned int Scheduler::Threads() const {
+    if (requestedThreads != 0) return requestedThreads;
+    return std::max(1u, std::min(MAX_THREADS,
+                                 std::thread::hardware_concurrency()));
+}
+
+// the calling thread is always one of the Threads(), so there's one worker
+// fewer than that
+void Scheduler::Start() {
+    std::lock_guard<std::mutex> lock(startMutex);
+    if (running) return;
+    const unsigned int numWorkers = Threads() - 1;
+    stopping = false;
+    queues.clear();
+    for (unsigned int i = 0; i <= numWorkers; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned int i = 0; i < numWorkers; ++i) {
+        workers.emplace_back(&Scheduler::WorkerLoop, this, i);
+    }
+    running = true;
+}
+
+// only called with startMutex held (or from the destructor); tasks which are
+// still queued are dropped
+void Scheduler::Stop() {
+    if (!running) return;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+    queued = 0;
+    running = false;
+}
+
+void Scheduler::Submit(std::function<void()> task) {
+    if (!running) Start();
+    const bool ownQueue = workerOf == this && workerIndex >= 0;
+    Queue& queue = *queues[ownQueue ? workerIndex : queues.size() - 1];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Job{std::move(task), currentIsolation});
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        ++queued;
+    }
+    wake.notify_one();
+}
+
+// the first task this thread is allowed to run, looking from the given end;
+// outside of an Isolation, that's always the one at the end
+bool Scheduler::Take(Queue& queue, const bool fromBack, Job& job) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    auto& tasks = queue.tasks;
+    const std::size_t size = tasks.size();
+    for (std::size_t i = 0; i < size; ++i) {
+        const auto next = tasks.begin() + (fromBack ? size - 1 - i : i);
+        if (!Runnable(next->isolation)) continue;
+        job = std::move(*next);
+        tasks.erase(next);
+        --queued;
+        return true;
+    }
+    return false;
+}
+
+// a worker's own queue is used like a stack, so it finishes what it started
+// before moving on; everything else is taken from the front, oldest first
+bool Scheduler::RunOne() {
+    if (!running || queued == 0) return false;
+    const std::size_t numQueues = queues.size();
+    const std::size_t self = workerOf == this && workerIndex >= 0 ?
+        workerIndex : numQueues - 1;
+    Job job;
+    bool found = Take(*queues[self], self != numQueues - 1, job);
+    for (std::size_t i = 1; !found && i < numQueues; ++i) {
+        found = Take(*queues[(self + i) % numQueues], false, job);
+    }
+    if (!found) return false;
+    // the task runs in the Isolation it was submitted in, so that what it 
+    // submits belongs there too
+    std::swap(currentIsolation, job.isolation);
+    job.task();
+    std::swap(currentIsolation, job.isolation);
+    return true;
+}
+
+void Scheduler::WorkerLoop(const std::size_t index) {
+    workerIndex = index;
+    workerOf = this;
+    while (!stopping) {
+        if (RunOne()) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+    }
+    workerIndex = -1;
+    workerOf = nullptr;
+}
+
+void SetThreads(const unsigned int threads) {
+    GetScheduler().SetThreads(threads);
+}
+
+unsigned int Threads() {
+    return GetScheduler().Threads();
+}
+
+void Submit(std::function<void()> task) {
+    GetScheduler().Submit(std::move(task));
+}
+
+bool RunOne() {
+    return GetScheduler().RunOne();
+}
+
+// Isolation ------------------------------------------------------------------
+
+Isolation::Isolation(): outer(currentIsolation) {
+    currentIsolation = std::make_shared<const Node>(Node{outer});
+}
+
+Isolation::~Isolation() {
+    currentIsolation = outer;
+}
+
+// TaskGroup ------------------------------------------------------------------
+
+TaskGroup::~TaskGroup() {
+    WaitForAll();
+}
+
+// the state is shared with the tasks so that it's still there while the last
+// one to finish signals it, even if the group has been destroyed by then
+void TaskGroup::Run(std::function<void()> task) {
+    ++state->pending;
+    std::shared_ptr<State> taskState = state;
+    Submit([taskState, task]() {
+            try {
+                task();
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(taskState->mutex);
+                if (!taskState->failure) {
+                    taskState->failure = std::current_exception();
+                }
+            }
+            std::lock_guard<std::mutex> lock(taskState->mutex);
+            if (--taskState->pending == 0) taskState->done.notify_all();
+        });
+}
+
+void TaskGroup::Wait() {
+    WaitForAll();
+    std::exception_ptr failure;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        std::swap(failure, state->failure);
+    }
+    if (failure) std::rethrow_exception(failure);
+}
+
+void TaskGroup::WaitForAll() {
+    while (state->pending > 0) {
+        if (RunOne()) continue;
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait_for(lock, WAIT_INTERVAL,
+                             [this]() { return state->pending == 0; });
+    }
+}
+
+// ParallelFor ----------------------------------------------------------------
+
+// the tasks are handed out by a shared counter rather than being queued one by
+// one; each helper thread just takes tasks from it until they're all gone
+void ParallelFor(const std::size_t numTasks,
+                 const std::function<void(std::size_t)>& task) {
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    auto work = [&]() {
+        try {
+            for (std::size_t k = next++; k < numTasks; k = next++) task(k);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (!failure) failure = std::current_exception();
+            next = numTasks;
+        }
+    };
+
+    const std::size_t numHelpers = std::min<std::size_t>(Threads(), numTasks);
+    TaskGroup helpers;
+    for (std::size_t t = 1; t < numHelpers; ++t) helpers.Run(work);
+    // this thread takes tasks as well instead of just waiting around
+    work();
+    helpers.Wait();
+    if (failure) std::rethrow_exception(failure);
+}
+
+} // namespace Pool
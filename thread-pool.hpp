@@ -0,0 +1,220 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+// The thread pool shared by everything in the core which runs in parallel.
+//
+// Each worker thread has its own deque of tasks: it adds the tasks it spawns to
+// the back and takes its next task from the back, and when it runs out it
+// steals from the front of the other workers' deques. Tasks submitted from
+// outside the pool (e.g. the main thread) go into a separate shared queue.
+// Any thread which is waiting on the pool (in ParallelFor, TaskGroup::Wait or
+// Future::Get) runs queued tasks while it waits, so these can be nested as
+// deeply as you like without deadlocking or running more than Threads() tasks
+// at once: the waiting thread counts as one of the Threads(). The exception is
+// a task which waits on another task's Future; see Task for those.
+//
+// A thread inside an Isolation only runs the tasks submitted inside it (or
+// inside Isolations nested in it) while it waits, so that whatever it's in the
+// middle of can't end up waiting on something started further up its stack.
+//
+// The pool is started the first time it's used, with the number of threads
+// given to SetThreads() (by default one per core, up to MAX_THREADS).
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <chrono>
+
+#include "constants.hpp"
+
+namespace Pool {
+
+// 0 means one per hardware core, up to MAX_THREADS. This restarts the pool, so
+// it mustn't be called while anything is running on it
+void SetThreads(const unsigned int threads);
+unsigned int Threads();
+
+// the low-level interface: queue a task, which mustn't throw, or run one
+// queued task if there are any (returning false if there weren't)
+void Submit(std::function<void()> task);
+bool RunOne();
+
+// While this is alive, the tasks this thread submits (and the ones they submit
+// in turn) belong to it, and this thread won't run any others. Memo::Cache
+// computes its values inside one, since a value's owner waiting on its own 
+// tasks mustn't pick up one which waits on another thread's value: if that
+// thread has done the same with this value, neither can ever finish
+class Isolation {
+    public:
+        Isolation();
+        ~Isolation();
+        Isolation(const Isolation&) = delete;
+        Isolation& operator=(const Isolation&) = delete;
+
+        // each Isolation is a node in the tree of the ones nested in it
+        struct Node {
+            std::shared_ptr<const Node> parent;
+        };
+
+    private:
+        std::shared_ptr<const Node> outer;
+};
+
+// a set of tasks which can be waited on together. If any of them throws, the
+// first exception is rethrown by Wait()
+class TaskGroup {
+    public:
+        TaskGroup(): state(std::make_shared<State>()) {}
+        // the tasks have to finish before anything they refer to goes away
+        ~TaskGroup();
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void Run(std::function<void()> task);
+        void Wait();
+
+    private:
+        struct State {
+            std::atomic<std::size_t> pending{0};
+            std::mutex mutex;
+            std::condition_variable done;
+            std::exception_ptr failure;
+        };
+        std::shared_ptr<State> state;
+
+        void WaitForAll();
+};
+
+// the result of Async(); Get() runs other tasks until the result is ready
+template<typename T>
+class Future {
+    public:
+        Future() = default;
+        explicit Future(std::shared_future<T> future): future(future) {}
+
+        bool Valid() const { return future.valid(); }
+        bool Ready() const;
+        // rethrows the exception if the task threw one; like 
+        // std::shared_future, this gives a reference to the stored result
+        decltype(auto) Get() const;
+
+    private:
+        std::shared_future<T> future;
+};
+
+template<typename Function>
+auto Async(Function&& function) -> Future<decltype(function())>;
+
+// A task which is only queued once the tasks it comes after have finished, for
+// steps which need the results of others. An Async() task mustn't just Get()
+// the futures it needs, because the thread waiting on them runs whatever is
+// queued, and that can be the step it's waiting for started further down its
+// own stack. Hook up everything with After(), then Start() all of them
+template<typename T>
+class Task {
+    public:
+        template<typename Function>
+        explicit Task(Function&& function);
+
+        Future<T> GetFuture() const { return future; }
+        // this won't be queued until before has finished
+        template<typename U>
+        void After(const Task<U>& before) const;
+        void Start() const { Released(state); }
+
+    private:
+        template<typename U> friend class Task;
+
+        struct State {
+            std::packaged_task<T()> task;
+            // the tasks still to finish, plus one until Start()
+            std::atomic<int> waitingFor{1};
+            std::mutex mutex;
+            std::vector<std::function<void()>> next;
+        };
+        std::shared_ptr<State> state;
+        Future<T> future;
+
+        // one of the things this is waiting for is done
+        static void Released(const std::shared_ptr<State>& state);
+};
+
+// call task(0), ..., task(numTasks-1) on up to Threads() threads, handing out
+// the tasks in order as threads become free. If any task throws, the remaining
+// ones are skipped and the first exception is rethrown here
+void ParallelFor(const std::size_t numTasks,
+                 const std::function<void(std::size_t)>& task);
+
+/******************************************************************************/
+
+// how long waiting threads sleep between looking for tasks to run while the
+// thing they're waiting for is running on another thread
+constexpr std::chrono::microseconds WAIT_INTERVAL(500);
+
+template<typename T>
+bool Future<T>::Ready() const {
+    return future.wait_for(std::chrono::seconds(0))
+        == std::future_status::ready;
+}
+
+template<typename T>
+decltype(auto) Future<T>::Get() const {
+    while (!Ready()) {
+        if (!RunOne()) future.wait_for(WAIT_INTERVAL);
+    }
+    return future.get();
+}
+
+template<typename Function>
+auto Async(Function&& function) -> Future<decltype(function())> {
+    typedef decltype(function()) Result;
+    // std::function has to be copyable, so the packaged_task can't go in it
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+            std::forward<Function>(function));
+    Future<Result> future(task->get_future().share());
+    Submit([task]() { (*task)(); });
+    return future;
+}
+
+template<typename T>
+template<typename Function>
+Task<T>::Task(Function&& function): state(std::make_shared<State>()) {
+    state->task = std::packaged_task<T()>(std::forward<Function>(function));
+    future = Future<T>(state->task.get_future().share());
+}
+
+// before mustn't have been started yet, or it could finish without releasing
+// this
+template<typename T>
+template<typename U>
+void Task<T>::After(const Task<U>& before) const {
+    ++state->waitingFor;
+    std::shared_ptr<State> self = state;
+    std::lock_guard<std::mutex> lock(before.state->mutex);
+    before.state->next.push_back([self]() { Task<T>::Released(self); });
+}
+
+// once nothing's left to wait for, this is queued, and when it's done the
+// tasks after it are released in turn
+template<typename T>
+void Task<T>::Released(const std::shared_ptr<State>& state) {
+    if (--state->waitingFor != 0) return;
+    Submit([state]() {
+            state->task();
+            std::vector<std::function<void()>> next;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                std::swap(next, state->next);
+            }
+            for (const auto& release : next) release();
+        });
+}
+
+} // namespace Pool
+
+#endif